@@ -0,0 +1,177 @@
+#include "atomic-file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+AtomicFile::AtomicFile(const std::string &filename, bool syncToDisk) : target(filename), sync(syncToDisk)
+{
+    // Write through symlinks instead of replacing the link with a regular file
+    char resolved[PATH_MAX];
+    if (realpath(filename.c_str(), resolved) != nullptr)
+    {
+        target = resolved;
+    }
+}
+
+AtomicFile::~AtomicFile()
+{
+    discard();
+}
+
+int AtomicFile::createTemp()
+{
+    discard();
+
+    std::string pattern = target + ".XXXXXX";
+    int fd = mkstemp(&pattern[0]);
+    if (fd < 0)
+        return -1;
+    tempPath = pattern;
+
+    // mkstemp creates the file 0600; keep the mode and owner of the file being replaced
+    struct stat statbuf;
+    if (stat(target.c_str(), &statbuf) == 0)
+    {
+        fchmod(fd, statbuf.st_mode & 07777);
+        if (fchown(fd, statbuf.st_uid, statbuf.st_gid) != 0)
+        {
+            // Not fatal: only root can give files away, and then it succeeds
+        }
+    }
+    else
+    {
+        fchmod(fd, 0644);
+    }
+    return fd;
+}
+
+bool AtomicFile::finishTemp(int fd, bool written)
+{
+    if (!written)
+    {
+        close(fd);
+        discard();
+        return false;
+    }
+    if ((sync && fsync(fd) != 0) || close(fd) != 0)
+    {
+        discard();
+        return false;
+    }
+    return true;
+}
+
+bool AtomicFile::write(std::string_view contents)
+{
+    int fd = createTemp();
+    if (fd < 0)
+        return false;
+
+    size_t done = 0;
+    while (done < contents.size())
+    {
+        ssize_t count = ::write(fd, contents.data() + done, contents.size() - done);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return finishTemp(fd, false);
+        }
+        done += static_cast<size_t>(count);
+    }
+    return finishTemp(fd, true);
+}
+
+bool AtomicFile::write(const std::vector<std::string_view> &segments)
+{
+    int fd = createTemp();
+    if (fd < 0)
+        return false;
+
+    // writev() takes at most IOV_MAX pieces, and may write only part of them
+    std::vector<struct iovec> pieces;
+    pieces.reserve(std::min<size_t>(segments.size(), IOV_MAX));
+    size_t next = 0;
+    while (next < segments.size() || !pieces.empty())
+    {
+        while (next < segments.size() && pieces.size() < IOV_MAX)
+        {
+            const std::string_view &segment = segments[next++];
+            if (!segment.empty())
+                pieces.push_back({const_cast<char *>(segment.data()), segment.size()});
+        }
+        if (pieces.empty())
+            break;
+
+        ssize_t count = writev(fd, pieces.data(), static_cast<int>(pieces.size()));
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return finishTemp(fd, false);
+        }
+
+        // Drop the pieces written in full and advance into the one written in part
+        size_t written = static_cast<size_t>(count);
+        size_t full = 0;
+        while (full < pieces.size() && written >= pieces[full].iov_len)
+        {
+            written -= pieces[full].iov_len;
+            ++full;
+        }
+        pieces.erase(pieces.begin(), pieces.begin() + static_cast<std::ptrdiff_t>(full));
+        if (!pieces.empty())
+        {
+            pieces.front().iov_base = static_cast<char *>(pieces.front().iov_base) + written;
+            pieces.front().iov_len -= written;
+        }
+    }
+    return finishTemp(fd, true);
+}
+
+bool AtomicFile::commit()
+{
+    if (tempPath.empty())
+        return false;
+
+    if (rename(tempPath.c_str(), target.c_str()) != 0)
+    {
+        discard();
+        return false;
+    }
+    tempPath.clear();
+
+    if (sync)
+    {
+        // Persist the directory entry so the rename itself survives a power cut
+        size_t slash = target.find_last_of('/');
+        std::string directory = slash == std::string::npos ? "." : target.substr(0, slash + 1);
+        int fd = open(directory.c_str(), O_RDONLY);
+        if (fd >= 0)
+        {
+            fsync(fd);
+            close(fd);
+        }
+    }
+    return true;
+}
+
+void AtomicFile::discard()
+{
+    if (!tempPath.empty())
+    {
+        unlink(tempPath.c_str());
+        tempPath.clear();
+    }
+}
+
+bool AtomicFile::replace(const std::string &filename, std::string_view contents, bool syncToDisk)
+{
+    AtomicFile file(filename, syncToDisk);
+    return file.write(contents) && file.commit();
+}
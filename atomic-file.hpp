@@ -0,0 +1,90 @@
+#ifndef ATOMIC_FILE_HPP
+#define ATOMIC_FILE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Replace a file atomically by writing a temporary file and renaming it over the target
+ *
+ * The temporary file is created next to the target so the rename stays on one
+ * file system. Readers see either the old or the new contents, never a partially
+ * written file, even if power is lost in the middle of a save.
+ *
+ * Writing and committing are separate steps so several files can be prepared
+ * first and then swapped in together.
+ */
+class AtomicFile
+{
+private:
+    std::string target;
+    std::string tempPath;
+    bool sync;
+
+    /**
+     * @brief Create the temporary file with the mode and owner of the target
+     * @return File descriptor, or -1 if it could not be created
+     */
+    int createTemp();
+
+    /**
+     * @brief Flush and close the written temporary file
+     * @param fd File descriptor from createTemp()
+     * @param written Whether every byte was written
+     * @return true if the temporary file is complete, false if it was discarded
+     */
+    bool finishTemp(int fd, bool written);
+
+public:
+    /**
+     * @brief Constructor
+     * @param filename Path of the file to replace; symlinks are resolved so the link is kept
+     * @param syncToDisk If true, fsync the data and the directory so the change survives a power cut
+     */
+    explicit AtomicFile(const std::string &filename, bool syncToDisk = true);
+
+    /**
+     * @brief Destructor, removes the temporary file if it was never committed
+     */
+    ~AtomicFile();
+
+    AtomicFile(const AtomicFile &other) = delete;
+    AtomicFile &operator=(const AtomicFile &other) = delete;
+
+    /**
+     * @brief Write the new contents to the temporary file with a single buffered write
+     * @param contents New file contents
+     * @return true if successful, false if the temporary file could not be written
+     */
+    bool write(std::string_view contents);
+
+    /**
+     * @brief Write the new contents, given as pieces in file order, to the temporary file
+     * @param segments Pieces of the new contents, written with writev() without joining them first
+     * @return true if successful, false if the temporary file could not be written
+     */
+    bool write(const std::vector<std::string_view> &segments);
+
+    /**
+     * @brief Rename the written temporary file over the target
+     * @return true if successful, false if nothing was written or the rename failed
+     */
+    bool commit();
+
+    /**
+     * @brief Remove the temporary file without touching the target
+     */
+    void discard();
+
+    /**
+     * @brief Write and commit in one step
+     * @param filename Path of the file to replace
+     * @param contents New file contents
+     * @param syncToDisk If true, fsync before and after the rename
+     * @return true if successful, false otherwise
+     */
+    static bool replace(const std::string &filename, std::string_view contents, bool syncToDisk = true);
+};
+
+#endif // ATOMIC_FILE_HPP
@@ -1,357 +1,1497 @@
 #include "config-editor.hpp"
+#include "atomic-file.hpp"
+#include "config-parser.hpp"
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 
-ConfigEditor::ConfigEditor(const std::string &filename)
+ConfigEditor::ConfigEditor(const std::string &filename, LoadMode mode)
 {
-    loadFile(filename);
+    loadFile(filename, mode);
 }
 
-std::string ConfigEditor::trim(const std::string &str)
+bool ConfigEditor::isComment(std::string_view line)
 {
-    size_t start = str.find_first_not_of(" \t");
-    if (start == std::string::npos)
-        return "";
-    size_t end = str.find_last_not_of(" \t");
-    return str.substr(start, end - start + 1);
-}
-
-bool ConfigEditor::isComment(const std::string &line)
-{
-    std::string trimmed = trim(line);
+    std::string_view trimmed = ConfigParser::trim(line);
     return trimmed.empty() || trimmed[0] == '#';
 }
 
-std::pair<std::string, std::string> ConfigEditor::parseKeyValue(const std::string &line)
+std::pair<std::string_view, std::string_view> ConfigEditor::parseKeyValue(std::string_view line)
 {
     size_t pos = line.find('=');
-    if (pos == std::string::npos)
+    if (pos == std::string_view::npos)
     {
-        return {"", ""};
+        return {std::string_view(), std::string_view()};
     }
-    std::string key = trim(line.substr(0, pos));
-    std::string value = trim(line.substr(pos + 1));
-    return {key, value};
+    return {ConfigParser::trim(line.substr(0, pos)), ConfigParser::trim(line.substr(pos + 1))};
+}
+
+std::string_view ConfigEditor::parseCommentedKey(std::string_view line) const
+{
+    std::string_view trimmed = ConfigParser::trim(line);
+    if (trimmed.empty() || trimmed[0] != '#')
+        return std::string_view();
+
+    // Strip the comment markers and see if what remains is a key-value pair
+    size_t bodyStart = trimmed.find_first_not_of('#');
+    if (bodyStart == std::string_view::npos)
+        return std::string_view();
+    ConfigLine body = ConfigParser::classify(trimmed.substr(bodyStart), dialect);
+    if (body.kind != ConfigLine::Kind::KeyValue)
+        return std::string_view();
+    std::string_view key = body.name;
+
+    // Prose comments that merely contain '=' are not commented-out keys
+    if (key.find_first_of(" \t") != std::string_view::npos)
+        return std::string_view();
+    return key;
+}
+
+bool ConfigEditor::isKeyLine(std::string_view line) const
+{
+    return ConfigParser::classify(line, dialect).kind == ConfigLine::Kind::KeyValue;
+}
+
+std::string_view ConfigEditor::keySeparator() const
+{
+    return dialect == ConfigDialect::BeginEnd ? " = " : "=";
+}
+
+void ConfigEditor::replaceLine(const SectionIndex &section, LineId line, std::initializer_list<std::string_view> parts)
+{
+    size_t position = content->lines.positionOf(line);
+    Change change(Change::Kind::Replace);
+    change.line = position;
+    change.section = section.path;
+    change.before = content->lines[position];
+    change.after = content->arena.store(parts);
+
+    content->lines.set(position, change.after);
+    markDirty(position);
+    record(std::move(change));
+}
+
+void ConfigEditor::markDirty(size_t index)
+{
+    content->firstDirtyLine = std::min(content->firstDirtyLine, index);
 }
 
-int ConfigEditor::findKeyInSection(const std::vector<std::string> &sectionPath, const std::string &key)
+/**
+ * @brief Visitor that records the line ranges of sections and keys for the index
+ *
+ * The parser reports line positions; the builder records the id of the line
+ * being fed instead, which rebuildIndex() sets before each line.
+ */
+class ConfigEditor::IndexBuilder : public ConfigVisitor
 {
-    std::vector<std::string> currentPath;
-    bool inTargetSection = false;
+private:
+    ConfigEditor &editor;
+    // Open sections, innermost last, and whether each is the first occurrence of
+    // its path, so a repeated section only records the range of its first occurrence.
+    // Repeated brace blocks are separate entities rather than one section split
+    // up, so their keys are left out and nullptr stands in for their index
+    std::vector<SectionIndex *> openSections;
+    std::vector<bool> firstOccurrence;
 
-    for (size_t i = 0; i < lines.size(); ++i)
+    SectionIndex *current()
     {
-        std::string line = trim(lines[i]);
+        return openSections.empty() ? editor.content->sections.entry(SectionPath()).get() : openSections.back();
+    }
+
+public:
+    LineId line = 0; // Id of the line being fed
 
-        if (isComment(line))
-            continue;
+    explicit IndexBuilder(ConfigEditor &owner) : editor(owner) {}
 
-        // Check for begin statement
-        if (line.find("begin ") == 0)
+    bool enterSection(const SectionScope &scope, size_t) override
+    {
+        SectionPath path = scope.path();
+        // Sections kept from before the rebuild have no begin line yet
+        std::shared_ptr<SectionIndex> &slot = editor.content->sections.entry(path);
+        bool added = !slot;
+        if (added)
+            slot = std::make_shared<SectionIndex>();
+        SectionIndex &section = *slot;
+        bool first = added || section.beginLine == LineTable::END;
+        if (first)
         {
-            std::string sectionName = trim(line.substr(6));
-            currentPath.push_back(sectionName);
-            inTargetSection = (currentPath == sectionPath);
+            section.path = path;
+            section.beginLine = line;
         }
-        // Check for end statement
-        else if (line.find("end ") == 0)
+        bool merged = first || editor.dialect != ConfigDialect::BraceBlocks;
+        openSections.push_back(merged ? &section : nullptr);
+        firstOccurrence.push_back(first);
+        return true;
+    }
+
+    bool exitSection(const SectionScope &, size_t) override
+    {
+        if (firstOccurrence.back())
+            openSections.back()->endLine = line;
+        openSections.pop_back();
+        firstOccurrence.pop_back();
+        return true;
+    }
+
+    bool keyValue(const SectionScope &, std::string_view key, std::string_view, size_t) override
+    {
+        // The key is a view into the line itself; emplace keeps the first
+        // occurrence of duplicated keys. In flat files, which shell scripts
+        // source, the last assignment is the one in effect
+        SectionIndex *section = current();
+        if (!section)
+            return true;
+        section->keyLines.push_back(line);
+        if (editor.dialect == ConfigDialect::FlatKeyValue)
+            section->keys.erase(key);
+        section->keys.emplace(key, line);
+        return true;
+    }
+
+    bool comment(const SectionScope &, std::string_view text, size_t) override
+    {
+        std::string_view key = editor.parseCommentedKey(text);
+        SectionIndex *section = current();
+        if (!key.empty() && section)
         {
-            if (!currentPath.empty())
-            {
-                currentPath.pop_back();
-                inTargetSection = (currentPath == sectionPath);
-            }
+            section->commentedKeyLines.push_back(line);
+            section->commentedKeys.emplace(key, line);
         }
-        // Check for key-value pair
-        else if (inTargetSection && line.find('=') != std::string::npos)
+        return true;
+    }
+};
+
+namespace
+{
+    /**
+     * @brief Visitor that finds the value of a key, used while the file is not loaded
+     */
+    class ValueFinder : public ConfigVisitor
+    {
+    public:
+        SectionPath section;
+        std::string_view key;
+        bool lastWins; // Keep scanning for later assignments, as in flat files
+        bool firstOnly = false; // Stop at the end of the section's first occurrence, as for brace blocks
+        bool found = false;
+        std::string value;
+
+        ValueFinder(const SectionPath &sectionPath, std::string_view keyName, bool last = false)
+            : section(sectionPath), key(keyName), lastWins(last) {}
+
+        bool exitSection(const SectionScope &scope, size_t) override
+        {
+            return !(firstOnly && scope.matches(section));
+        }
+
+        bool keyValue(const SectionScope &scope, std::string_view lineKey, std::string_view lineValue, size_t) override
         {
-            auto kvPair = parseKeyValue(line);
-            if (kvPair.first == key)
+            if (lineKey == key && scope.matches(section))
             {
-                return static_cast<int>(i);
+                found = true;
+                value = std::string(lineValue);
+                return lastWins; // Stop at the first match unless a later one overrides it
             }
+            return true;
+        }
+    };
+
+    /**
+     * @brief Visitor that collects the keys of a section, used while the file is not loaded
+     */
+    class KeyCollector : public ConfigVisitor
+    {
+    public:
+        SectionPath section;
+        bool firstOnly = false; // Stop at the end of the section's first occurrence, as for brace blocks
+        std::vector<std::string> keys;
+
+        explicit KeyCollector(const SectionPath &sectionPath) : section(sectionPath) {}
+
+        bool exitSection(const SectionScope &scope, size_t) override
+        {
+            return !(firstOnly && scope.matches(section));
+        }
+
+        bool keyValue(const SectionScope &scope, std::string_view key, std::string_view, size_t) override
+        {
+            if (!key.empty() && scope.matches(section))
+                keys.emplace_back(key);
+            return true;
+        }
+    };
+
+    /**
+     * @brief Visitor that checks whether a section exists, used while the file is not loaded
+     */
+    class SectionFinder : public ConfigVisitor
+    {
+    public:
+        SectionPath section;
+        bool found = false;
+
+        explicit SectionFinder(const SectionPath &sectionPath) : section(sectionPath) {}
+
+        bool enterSection(const SectionScope &scope, size_t) override
+        {
+            found = scope.matches(section);
+            return !found; // Stop at the first match
         }
+    };
+}
+
+const ConfigEditor::SectionIndex *ConfigEditor::SectionMap::find(const SectionPath &path) const
+{
+    const std::shared_ptr<Shard> &shard = shards[path.id() % SHARD_COUNT];
+    if (!shard)
+        return nullptr;
+    auto it = shard->find(path);
+    return it == shard->end() ? nullptr : it->second.get();
+}
+
+std::shared_ptr<ConfigEditor::SectionIndex> &ConfigEditor::SectionMap::entry(const SectionPath &path)
+{
+    // Path ids are handed out in order, so they spread evenly over the shards
+    std::shared_ptr<Shard> &shard = shards[path.id() % SHARD_COUNT];
+    if (!shard)
+        shard = std::make_shared<Shard>();
+    return ownShard(shard)[path];
+}
+
+ConfigEditor::SectionMap::Shard &ConfigEditor::SectionMap::ownShard(std::shared_ptr<Shard> &shard)
+{
+    if (shard.use_count() > 1)
+        shard = std::make_shared<Shard>(*shard);
+    return *shard;
+}
+
+void ConfigEditor::rebuildIndex()
+{
+    // Reset the sections in place instead of clearing the map, so references to
+    // them stay valid when an insert renumbers the lines and triggers a rebuild.
+    // Entries still shared with a copy or snapshot get a fresh one instead; no
+    // editing operation holds a reference to those
+    content->sections.forEach([](const SectionPath &path, std::shared_ptr<SectionIndex> &section)
+                              {
+                                  if (section.use_count() > 1)
+                                      section = std::make_shared<SectionIndex>();
+                                  else
+                                      *section = SectionIndex();
+                                  section->path = path;
+                                  section->beginLine = LineTable::END; });
+    std::shared_ptr<SectionIndex> &root = content->sections.entry(SectionPath());
+    if (!root)
+        root = std::make_shared<SectionIndex>();
+    root->beginLine = 0;
+
+    IndexBuilder builder(*this);
+    ConfigParser parser(builder, dialect);
+    for (auto line = content->lines.begin(); line != content->lines.end(); ++line)
+    {
+        builder.line = line.id();
+        parser.feedLine(*line);
     }
+    // Sections left open end at end of file
+    builder.line = LineTable::END;
+    parser.finish();
+    content->sections.entry(SectionPath())->endLine = LineTable::END;
+}
 
-    return -1; // Key not found
+bool ConfigEditor::materialize()
+{
+    if (!streaming)
+        return true;
+    return loadFile(loadedFrom, LoadMode::Buffered);
 }
 
-int ConfigEditor::findSectionEnd(const std::vector<std::string> &sectionPath)
+void ConfigEditor::reindexKeys(SectionIndex &section)
 {
-    std::vector<std::string> currentPath;
+    section.keys.clear();
+    section.commentedKeys.clear();
 
-    for (size_t i = 0; i < lines.size(); ++i)
+    for (LineId line : section.keyLines)
+    {
+        // emplace keeps the first occurrence of duplicated keys
+        section.keys.emplace(parseKeyValue(content->lines.text(line)).first, line);
+    }
+    for (LineId line : section.commentedKeyLines)
     {
-        std::string line = trim(lines[i]);
+        section.commentedKeys.emplace(parseCommentedKey(content->lines.text(line)), line);
+    }
+}
 
-        if (isComment(line))
-            continue;
+void ConfigEditor::repointKeys(SectionIndex &section)
+{
+    // Node handles move the entries over without reallocating them; only the
+    // bucket array of the new map is allocated
+    auto repoint = [this](std::unordered_map<std::string_view, LineId> &lookup, bool commented)
+    {
+        if (lookup.empty())
+            return;
+        std::unordered_map<std::string_view, LineId> moved;
+        moved.reserve(lookup.size());
+        while (!lookup.empty())
+        {
+            auto node = lookup.extract(lookup.begin());
+            std::string_view line = content->lines.text(node.mapped());
+            node.key() = commented ? parseCommentedKey(line) : parseKeyValue(line).first;
+            moved.insert(std::move(node));
+        }
+        lookup.swap(moved);
+    };
+    repoint(section.keys, false);
+    repoint(section.commentedKeys, true);
+}
+
+std::string_view ConfigEditor::leadingWhitespace(std::string_view line)
+{
+    size_t end = line.find_first_not_of(" \t");
+    return line.substr(0, end == std::string_view::npos ? line.size() : end);
+}
+
+std::string_view ConfigEditor::keyIndent(const SectionIndex &section)
+{
+    // Try to match existing indentation in the section
+    if (!section.keyLines.empty())
+    {
+        return leadingWhitespace(content->lines.text(section.keyLines.back()));
+    }
+    return nestedIndent(section);
+}
+
+std::string_view ConfigEditor::nestedIndent(const SectionIndex &section)
+{
+    if (section.path.isRoot())
+        return std::string_view(); // Top-level lines are not indented in any dialect
+
+    // wpa_supplicant.conf indents with tabs, graphics configurations with four spaces
+    std::string_view level = dialect == ConfigDialect::BraceBlocks ? "\t" : "    ";
+    return content->arena.store({leadingWhitespace(content->lines.text(section.beginLine)), level});
+}
 
-        if (line.find("begin ") == 0)
+void ConfigEditor::commentKeyLine(SectionIndex &section, LineId line)
+{
+    std::string_view text = content->lines.text(line);
+    // Find the first non-whitespace character and add # before it
+    size_t firstChar = text.find_first_not_of(" \t");
+    if (firstChar != std::string_view::npos)
+    {
+        replaceLine(section, line, {text.substr(0, firstChar), "# ", text.substr(firstChar)});
+    }
+
+    // Move the line over to the commented keys of its section
+    section.keyLines.erase(
+        std::find(section.keyLines.begin(), section.keyLines.end(), line));
+    section.commentedKeyLines.insert(
+        std::lower_bound(section.commentedKeyLines.begin(), section.commentedKeyLines.end(), line),
+        line);
+    reindexKeys(section);
+}
+
+bool ConfigEditor::uncommentKey(SectionIndex &section, std::string_view key)
+{
+    if (section.keys.count(key))
+        return true; // Already active
+
+    auto it = section.commentedKeys.find(key);
+    if (it == section.commentedKeys.end())
+        return false;
+
+    LineId line = it->second;
+    std::string_view text = content->lines.text(line);
+    size_t hashPos = text.find('#');
+    if (hashPos != std::string_view::npos)
+    {
+        // Remove # and following space if present
+        size_t removeEnd = hashPos + 1;
+        if (removeEnd < text.length() && text[removeEnd] == ' ')
         {
-            std::string sectionName = trim(line.substr(6));
-            currentPath.push_back(sectionName);
+            removeEnd++;
         }
-        else if (line.find("end ") == 0)
+        replaceLine(section, line, {text.substr(0, hashPos), text.substr(removeEnd)});
+    }
+
+    // Lines commented with "##" stay comments; only move fully uncommented lines
+    if (!isComment(content->lines.text(line)))
+    {
+        section.commentedKeyLines.erase(
+            std::find(section.commentedKeyLines.begin(), section.commentedKeyLines.end(), line));
+        section.keyLines.insert(
+            std::lower_bound(section.keyLines.begin(), section.keyLines.end(), line),
+            line);
+    }
+    reindexKeys(section);
+    return true;
+}
+
+void ConfigEditor::insertPendingKeys(std::vector<PendingKey> &pending)
+{
+    if (pending.empty())
+        return;
+
+    // Group the new lines by section end, keeping request order within a section
+    std::stable_sort(pending.begin(), pending.end(),
+                     [](const PendingKey &a, const PendingKey &b)
+                     { return a.section->endLine < b.section->endLine; });
+
+    std::vector<size_t> insertedAt;
+    std::vector<std::string_view> texts;
+    std::vector<SectionPath> sectionPaths;
+    insertedAt.reserve(pending.size());
+    texts.reserve(pending.size());
+    sectionPaths.reserve(pending.size());
+    for (const auto &key : pending)
+    {
+        insertedAt.push_back(content->lines.positionOf(key.section->endLine));
+        texts.push_back(content->arena.store({key.indent, key.commented ? "# " : "", key.key, keySeparator(), key.value}));
+        sectionPaths.push_back(key.section->path);
+    }
+    insertLines(insertedAt, std::move(texts), std::move(sectionPaths));
+}
+
+void ConfigEditor::insertLines(const std::vector<size_t> &insertedAt, std::vector<std::string_view> texts,
+                               std::vector<SectionPath> sectionPaths)
+{
+    size_t generation = content->lines.generation();
+    std::vector<LineId> ids = content->lines.insert(insertedAt, texts);
+    markDirty(insertedAt.front());
+
+    Change change(Change::Kind::Insert);
+    change.positions.reserve(texts.size());
+    for (size_t k = 0; k < texts.size(); ++k)
+    {
+        // The k-th new line lands after the k lines inserted before it
+        change.positions.push_back(insertedAt[k] + k);
+    }
+
+    if (content->lines.generation() != generation)
+    {
+        // The table ran out of ids and renumbered every line
+        rebuildIndex();
+    }
+    else
+    {
+        // Other lines keep their ids, so only the new ones need indexing; each
+        // key is looked up as a view into the stored line, which outlives the edit
+        for (size_t k = 0; k < texts.size(); ++k)
         {
-            if (currentPath == sectionPath)
-            {
-                return static_cast<int>(i); // Return the line just before "end"
-            }
-            if (!currentPath.empty())
-            {
-                currentPath.pop_back();
-            }
+            SectionIndex &section = *editSection(sectionPaths[k]);
+            bool commented = isComment(texts[k]);
+            std::vector<LineId> &target = commented ? section.commentedKeyLines : section.keyLines;
+            target.insert(std::lower_bound(target.begin(), target.end(), ids[k]), ids[k]);
+            if (commented)
+                section.commentedKeys.emplace(parseCommentedKey(texts[k]), ids[k]);
+            else
+                section.keys.emplace(parseKeyValue(texts[k]).first, ids[k]);
         }
     }
+    change.texts = std::move(texts);
+    change.sectionPaths = std::move(sectionPaths);
+    record(std::move(change));
+}
 
-    return -1; // Section not found
+void ConfigEditor::eraseLines(const std::vector<size_t> &positions, const std::vector<SectionPath> &sectionPaths)
+{
+    // Take the lines out of their sections first. A key line is only inserted when
+    // no line has its key yet, so its lookup entry can simply be dropped
+    for (size_t k = 0; k < positions.size(); ++k)
+    {
+        SectionIndex &section = *editSection(sectionPaths[k]);
+        LineId line = content->lines.idAt(positions[k]);
+        std::string_view text = content->lines[positions[k]];
+        bool commented = isComment(text);
+        std::vector<LineId> &list = commented ? section.commentedKeyLines : section.keyLines;
+        auto it = std::lower_bound(list.begin(), list.end(), line);
+        if (it != list.end() && *it == line)
+            list.erase(it);
+
+        auto &lookup = commented ? section.commentedKeys : section.keys;
+        auto entry = lookup.find(commented ? parseCommentedKey(text) : parseKeyValue(text).first);
+        if (entry != lookup.end() && entry->second == line)
+            lookup.erase(entry);
+    }
+
+    // Erase from the back so the earlier positions stay valid
+    for (size_t k = positions.size(); k-- > 0;)
+    {
+        content->lines.erase(positions[k]);
+    }
+    markDirty(positions.front());
 }
 
-bool ConfigEditor::loadFile(const std::string &filename)
+void ConfigEditor::reclassifyLine(const SectionPath &sectionPath, LineId line, std::string_view previous)
 {
-    std::ifstream file(filename);
-    if (!file.is_open())
+    // Rewriting the value of a key leaves the index as it is
+    std::string_view text = content->lines.text(line);
+    bool wasActive = isKeyLine(previous);
+    bool isActive = isKeyLine(text);
+    if (wasActive && isActive && parseKeyValue(previous).first == parseKeyValue(text).first)
+        return;
+
+    SectionIndex &section = *editSection(sectionPath);
+
+    for (std::vector<LineId> *list : {&section.keyLines, &section.commentedKeyLines})
+    {
+        auto it = std::lower_bound(list->begin(), list->end(), line);
+        if (it != list->end() && *it == line)
+            list->erase(it);
+    }
+
+    std::vector<LineId> *target = nullptr;
+    if (isActive)
+        target = &section.keyLines;
+    else if (!parseCommentedKey(text).empty())
+        target = &section.commentedKeyLines;
+    if (target)
+        target->insert(std::lower_bound(target->begin(), target->end(), line), line);
+    reindexKeys(section);
+}
+
+ConfigEditor::Content &ConfigEditor::detach()
+{
+    // The line storage is kept alive by the copy's arena and source buffer, and
+    // the copied line table shares its chunks until either side edits them
+    if (content.use_count() > 1)
+        content = std::make_shared<Content>(*content);
+    return *content;
+}
+
+void ConfigEditor::beginStep()
+{
+    redoSteps.clear();
+    undoSteps.emplace_back();
+    recording = true;
+}
+
+void ConfigEditor::endStep()
+{
+    recording = false;
+    if (undoSteps.back().empty())
+        undoSteps.pop_back();
+    while (undoSteps.size() > historyLimit)
+        undoSteps.pop_front();
+}
+
+void ConfigEditor::record(Change change)
+{
+    if (recording)
+        undoSteps.back().push_back(std::move(change));
+}
+
+void ConfigEditor::applyChange(Change &change, bool forward)
+{
+    switch (change.kind)
+    {
+    case Change::Kind::Replace:
+    {
+        detach();
+        std::string_view previous = content->lines[change.line];
+        content->lines.set(change.line, forward ? change.after : change.before);
+        markDirty(change.line);
+        reclassifyLine(change.section, content->lines.idAt(change.line), previous);
+        break;
+    }
+
+    case Change::Kind::Insert:
+        detach();
+        if (forward)
+        {
+            // Recover the positions before insertion from the final ones
+            std::vector<size_t> insertedAt;
+            insertedAt.reserve(change.positions.size());
+            for (size_t k = 0; k < change.positions.size(); ++k)
+                insertedAt.push_back(change.positions[k] - k);
+            insertLines(insertedAt, change.texts, change.sectionPaths);
+        }
+        else
+        {
+            eraseLines(change.positions, change.sectionPaths);
+        }
+        break;
+
+    case Change::Kind::Swap:
+        std::swap(content, change.content);
+        break;
+    }
+}
+
+const ConfigEditor::SectionIndex *ConfigEditor::findSection(const SectionPath &sectionPath) const
+{
+    const SectionIndex *section = content->sections.find(sectionPath);
+    if (!section || section->beginLine == LineTable::END)
+        return nullptr; // Never seen, or gone since the last rebuild
+    return section;
+}
+
+ConfigEditor::SectionIndex *ConfigEditor::editSection(const SectionPath &sectionPath)
+{
+    if (!findSection(sectionPath))
+        return nullptr;
+
+    // Clone only this entry and its shard; the rest stays shared with the copies and snapshots
+    std::shared_ptr<SectionIndex> &section = detach().sections.entry(sectionPath);
+    if (section.use_count() > 1)
+        section = std::make_shared<SectionIndex>(*section);
+    return section.get();
+}
+
+LineId ConfigEditor::findKeyInSection(const SectionPath &sectionPath, std::string_view key)
+{
+    const SectionIndex *section = findSection(sectionPath);
+    if (!section)
+        return LineTable::END;
+
+    auto it = section->keys.find(key);
+    if (it == section->keys.end())
+        return LineTable::END; // Key not found
+    return it->second;
+}
+
+int ConfigEditor::findSectionEnd(const SectionPath &sectionPath)
+{
+    const SectionIndex *section = findSection(sectionPath);
+    if (!section)
+        return -1; // Section not found
+    return static_cast<int>(content->lines.positionOf(section->endLine));
+}
+
+bool ConfigEditor::loadFile(const std::string &filename, LoadMode mode)
+{
+    if (mode == LoadMode::Streaming)
+    {
+        FileStamp stamp = FileStamp::of(filename);
+        if (!stamp.exists)
+        {
+            std::cerr << "Error: Could not open file " << filename << std::endl;
+            return false;
+        }
+        clear();
+        streaming = true;
+        loadedFrom = filename;
+        loadedStamp = stamp;
+        return true;
+    }
+
+    std::shared_ptr<const FileBuffer> buffer =
+        mode == LoadMode::Mapped ? FileBuffer::map(filename) : FileBuffer::read(filename);
+    if (!buffer)
+    {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+
+    loadBuffer(filename, std::move(buffer));
+    return true;
+}
+
+bool ConfigEditor::loadFile(const std::string &filename, const ConfigEditor &base, LoadMode mode)
+{
+    if (mode == LoadMode::Streaming)
+        return loadFile(filename, mode);
+
+    std::shared_ptr<const FileBuffer> buffer =
+        mode == LoadMode::Mapped ? FileBuffer::map(filename) : FileBuffer::read(filename);
+    if (!buffer)
     {
         std::cerr << "Error: Could not open file " << filename << std::endl;
         return false;
     }
+    loadBuffer(filename, std::move(buffer), base);
+    return true;
+}
 
-    lines.clear();
-    std::string line;
-    while (std::getline(file, line))
+void ConfigEditor::loadBuffer(const std::string &filename, std::shared_ptr<const FileBuffer> buffer,
+                              const ConfigEditor &base)
+{
+    // Only a clean, fully loaded base in the same format can stand in for parsing
+    if (base.streaming || !base.content->source || base.dialect != dialect ||
+        base.savedSource != base.content->source || base.content->firstDirtyLine != SIZE_MAX ||
+        buffer->view() != base.savedSource->view())
     {
-        lines.push_back(line);
+        loadBuffer(filename, std::move(buffer));
+        return;
     }
 
-    file.close();
-    return true;
+    // Same bytes: the lines of base view an identical buffer, so share them and
+    // drop the one just read
+    clear();
+    content = base.content;
+    savedSource = base.savedSource;
+    loadedFrom = filename;
+    savedId = content->saveId;
+    loadedHash = base.loadedHash;
+    loadedStamp = FileStamp::of(filename);
+}
+
+void ConfigEditor::loadBuffer(const std::string &filename, std::shared_ptr<const FileBuffer> buffer)
+{
+    clear();
+    content->source = std::move(buffer);
+    savedSource = content->source;
+    loadedFrom = filename;
+    loadedHash = FileBuffer::hash(content->source->view());
+    loadedStamp = FileStamp::of(filename);
+
+    // Split into views on '\n' the same way std::getline would: no empty
+    // trailing line for a final newline, carriage returns are kept
+    std::string_view contents = content->source->view();
+    std::vector<std::string_view> lines;
+    lines.reserve(static_cast<size_t>(std::count(contents.begin(), contents.end(), '\n')) + 1);
+    size_t start = 0;
+    while (start < contents.size())
+    {
+        size_t newline = contents.find('\n', start);
+        if (newline == std::string_view::npos)
+        {
+            lines.push_back(contents.substr(start));
+            break;
+        }
+        lines.push_back(contents.substr(start, newline - start));
+        start = newline + 1;
+    }
+    content->lines.assign(lines);
+    markWritten();
+
+    rebuildIndex();
 }
 
 bool ConfigEditor::saveFile(const std::string &filename)
 {
-    std::ofstream file(filename);
-    if (!file.is_open())
+    // Nothing was edited in streaming mode, so the loaded file already has these contents
+    if (streaming && filename == loadedFrom && FileStamp::of(filename) == loadedStamp)
+        return true;
+    if (!materialize())
+        return false;
+
+    // Nothing changed since the file was loaded or last saved
+    if (savedId != 0 && content->saveId == savedId && content->firstDirtyLine == SIZE_MAX &&
+        filename == loadedFrom && FileStamp::of(filename) == loadedStamp)
+    {
+        return true;
+    }
+
+    if (saveStrategy == SaveStrategy::PatchInPlace && patchFile(filename))
+        return true;
+
+    // Skip the write entirely if the file already holds exactly these contents
+    std::string contents = getContents();
+    if (isUpToDate(filename, contents))
+    {
+        return true;
+    }
+
+    if (!AtomicFile::replace(filename, contents, syncOnSave))
     {
         std::cerr << "Error: Could not write to file " << filename << std::endl;
         return false;
     }
 
-    for (const auto &line : lines)
+    markSaved(filename, contents);
+    return true;
+}
+
+std::string ConfigEditor::getContents()
+{
+    std::string contents;
+    if (!materialize())
+        return contents;
+
+    size_t total = 0;
+    for (const auto &line : content->lines)
+    {
+        total += line.size() + 1;
+    }
+    contents.reserve(total);
+    for (const auto &line : content->lines)
     {
-        file << line << std::endl;
+        contents.append(line);
+        contents.push_back('\n');
     }
+    return contents;
+}
 
-    file.close();
-    return true;
+ConfigEditor::Rendering ConfigEditor::render()
+{
+    static const std::string_view NEWLINE = "\n";
+    Rendering rendering;
+    if (!materialize())
+        return rendering;
+
+    // Unedited lines still lie one after another in the source buffer, each
+    // followed by its newline, so a run of them is a single piece
+    std::string_view source = content->source ? content->source->view() : std::string_view();
+    std::less<const char *> before;
+    const char *runStart = nullptr;
+    const char *runEnd = nullptr;
+    auto endRun = [&]
+    {
+        if (runStart)
+            rendering.segments.emplace_back(runStart, static_cast<size_t>(runEnd - runStart));
+        runStart = nullptr;
+    };
+    for (const auto &line : content->lines)
+    {
+        const char *end = line.data() + line.size();
+        bool inSource = !source.empty() && !before(line.data(), source.data()) &&
+                        before(end, source.data() + source.size()) && *end == '\n';
+        if (!inSource)
+        {
+            endRun();
+            rendering.segments.push_back(line);
+            rendering.segments.push_back(NEWLINE);
+        }
+        else if (runStart && runEnd == line.data())
+        {
+            runEnd = end + 1;
+        }
+        else
+        {
+            endRun();
+            runStart = line.data();
+            runEnd = end + 1;
+        }
+    }
+    endRun();
+
+    for (std::string_view segment : rendering.segments)
+    {
+        rendering.size += segment.size();
+        rendering.hash = FileBuffer::hash(segment, rendering.hash);
+    }
+    return rendering;
 }
 
-bool ConfigEditor::setValue(const std::vector<std::string> &sectionPath,
-                            const std::string &key,
-                            const std::string &value)
+bool ConfigEditor::isUpToDate(const std::string &filename, const Rendering &rendering) const
 {
+    if (filename != loadedFrom || FileStamp::of(filename) != loadedStamp)
+        return false;
+    std::optional<uint64_t> hash = savedHash();
+    return hash && *hash == rendering.hash;
+}
 
-    int lineIndex = findKeyInSection(sectionPath, key);
+bool ConfigEditor::isUpToDate(const std::string &filename, std::string_view contents) const
+{
+    if (filename != loadedFrom || FileStamp::of(filename) != loadedStamp)
+        return false;
+    std::optional<uint64_t> hash = savedHash();
+    return hash && *hash == FileBuffer::hash(contents);
+}
+
+std::optional<uint64_t> ConfigEditor::savedHash() const
+{
+    if (loadedHash)
+        return loadedHash;
+    // Unknown after a patched save; the lines tell it for as long as they are unchanged
+    if (savedId == 0 || content->saveId != savedId || content->firstDirtyLine != SIZE_MAX)
+        return std::nullopt;
+    uint64_t hash = FileBuffer::HASH_SEED;
+    for (std::string_view line : content->lines)
+    {
+        hash = FileBuffer::hash(line, hash);
+        hash = FileBuffer::hash("\n", hash);
+    }
+    loadedHash = hash;
+    return loadedHash;
+}
+
+void ConfigEditor::markSaved(const std::string &filename, const std::string &contents)
+{
+    loadedFrom = filename;
+    loadedHash = FileBuffer::hash(contents);
+    loadedStamp = FileStamp::of(filename);
+    rebaseOnto(contents);
+}
+
+void ConfigEditor::markSaved(const std::string &filename, const Rendering &rendering)
+{
+    loadedFrom = filename;
+    loadedHash = rendering.hash;
+    loadedStamp = FileStamp::of(filename);
+    // Edited lines are not in the source buffer, so no buffer holds the file any more
+    if (content->firstDirtyLine != SIZE_MAX)
+        savedSource.reset();
+    markWritten();
+}
+
+void ConfigEditor::markWritten()
+{
+    // Ids only have to differ between saves, also of editors on other threads
+    static std::atomic<uint64_t> lastSaveId{0};
+    detach();
+    content->firstDirtyLine = SIZE_MAX;
+    content->saveId = savedId = ++lastSaveId;
+}
+
+bool ConfigEditor::patchFile(const std::string &filename)
+{
+    // Offsets are only known while the file holds what the last load or save wrote,
+    // with the lines from firstDirtyLine on changed since
+    if (savedId == 0 || content->saveId != savedId || filename != loadedFrom ||
+        content->firstDirtyLine == SIZE_MAX || FileStamp::of(filename) != loadedStamp)
+    {
+        return false;
+    }
+
+    // A private mapping shows later writes to the file, which would change the
+    // text of lines that still view it
+    if (content->source && content->source->isMapped())
+        return false;
+
+    // Lines before the first dirty one are as the file holds them, so the change
+    // starts right after their bytes
+    size_t firstDirty = std::min(content->firstDirtyLine, content->lines.size());
+    size_t offset = content->lines.bytesBefore(firstDirty);
+    size_t size = content->lines.byteSize();
+
+    // Past half the file, a fresh atomic copy costs about the same and is safer
+    if ((size - offset) * 2 > size)
+        return false;
+
+    std::string tail;
+    tail.reserve(size - offset);
+    for (auto line = content->lines.iteratorAt(firstDirty); line != content->lines.end(); ++line)
+    {
+        tail.append(*line);
+        tail.push_back('\n');
+    }
 
-    if (lineIndex != -1)
+    // While the source buffer still is the file, edits that rewrote a line to the
+    // same text do not need to be written
+    size_t same = 0;
+    if (savedSource && savedSource == content->source && offset <= savedSource->view().size())
     {
-        // Key exists, update it
-        std::string originalLine = lines[lineIndex];
-        std::string indent = "";
+        std::string_view original = savedSource->view().substr(offset);
+        while (same < tail.size() && same < original.size() && tail[same] == original[same])
+            ++same;
+        if (same == tail.size() && same == original.size())
+        {
+            markWritten();
+            return true;
+        }
+    }
+
+    int fd = open(filename.c_str(), O_WRONLY);
+    if (fd < 0)
+        return false;
 
-        // Preserve original indentation
-        for (char c : originalLine)
+    size_t done = same;
+    while (done < tail.size())
+    {
+        ssize_t count = pwrite(fd, tail.data() + done, tail.size() - done, static_cast<off_t>(offset + done));
+        if (count < 0)
         {
-            if (c == ' ' || c == '\t')
-            {
-                indent += c;
-            }
-            else
-            {
-                break;
-            }
+            if (errno == EINTR)
+                continue;
+            close(fd);
+            return false;
         }
+        done += static_cast<size_t>(count);
+    }
 
-        lines[lineIndex] = indent + key + " = " + value;
-        return true;
+    bool ok = true;
+    if (size < loadedStamp.size)
+        ok = ftruncate(fd, static_cast<off_t>(size)) == 0;
+    if (ok && syncOnSave)
+        ok = fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (!ok)
+        return false;
+
+    // No buffer holds the file any more, and its hash is only worked out if asked for
+    loadedStamp = FileStamp::of(filename);
+    loadedHash.reset();
+    savedSource.reset();
+    markWritten();
+    return true;
+}
+
+void ConfigEditor::rebaseOnto(const std::string &contents)
+{
+    // Copies and snapshots keep the content they share; the lines move in a clone
+    detach();
+
+    // Undo may bring back lines viewing the old text, so keep its storage around
+    if (undoSteps.empty() && redoSteps.empty())
+    {
+        content->retained.clear();
     }
     else
     {
-        // Key doesn't exist, add it to the section
-        int sectionEndIndex = findSectionEnd(sectionPath);
-        if (sectionEndIndex != -1)
-        {
-            // Determine indentation by looking at other lines in the section
-            std::string indent = "    "; // Default indentation
+        content->retained.push_back(content->source);
+        content->retained.push_back(std::make_shared<LineArena>(std::move(content->arena)));
+    }
 
-            // Try to match existing indentation in the section
-            for (int i = sectionEndIndex - 1; i >= 0; --i)
-            {
-                std::string line = lines[i];
-                if (!isComment(line) && line.find('=') != std::string::npos)
-                {
-                    indent = "";
-                    for (char c : line)
-                    {
-                        if (c == ' ' || c == '\t')
-                        {
-                            indent += c;
-                        }
-                        else
-                        {
-                            break;
-                        }
-                    }
-                    break;
-                }
-            }
+    content->source = FileBuffer::copyOf(contents);
+    savedSource = content->source;
 
-            std::string newLine = indent + key + " = " + value;
-            lines.insert(lines.begin() + sectionEndIndex, newLine);
-            return true;
-        }
+    std::string_view copy = content->source->view();
+    size_t start = 0;
+    content->lines.transform([&](std::string_view line)
+                             {
+                                 std::string_view moved = copy.substr(start, line.size());
+                                 start += line.size() + 1;
+                                 return moved; });
+
+    // The key maps view the old line text too, so re-point them before freeing it
+    content->sections.forEach([this](const SectionPath &, std::shared_ptr<SectionIndex> &section)
+                              {
+                                  if (section.use_count() > 1)
+                                      section = std::make_shared<SectionIndex>(*section);
+                                  repointKeys(*section); });
+    content->arena.release();
+    markWritten();
+}
+
+void ConfigEditor::setDialect(ConfigDialect syntax)
+{
+    dialect = syntax;
+    if (!streaming && !content->lines.empty())
+    {
+        detach();
+        rebuildIndex();
     }
+}
 
-    std::cerr << "Error: Could not find section path" << std::endl;
-    return false;
+ConfigDialect ConfigEditor::getDialect() const
+{
+    return dialect;
 }
 
-std::string ConfigEditor::getValue(const std::vector<std::string> &sectionPath, const std::string &key)
+bool ConfigEditor::addSection(const SectionPath &sectionPath)
 {
-    int lineIndex = findKeyInSection(sectionPath, key);
-    if (lineIndex != -1)
+    if (!materialize())
+        return false;
+    if (findSection(sectionPath))
+        return true; // Already there; the root always is
+    if (dialect == ConfigDialect::FlatKeyValue)
     {
-        auto kvPair = parseKeyValue(lines[lineIndex]);
-        return kvPair.second;
+        std::cerr << "Error: This configuration format has no sections" << std::endl;
+        return false;
     }
-    return ""; // Key not found
+    if (!findSection(sectionPath.parent()))
+        return false;
+
+    // The section lines change the index in ways a line-level change cannot
+    // replay, so the whole content is the undo step, like restore()
+    beginStep();
+    Change change(Change::Kind::Swap);
+    change.content = content;
+    detach();
+
+    const SectionIndex &parent = *findSection(sectionPath.parent());
+    std::string_view indent = nestedIndent(parent);
+    const std::string &name = sectionPath.name();
+    std::vector<std::string_view> texts;
+    if (dialect == ConfigDialect::BraceBlocks)
+        texts = {content->arena.store({indent, name, "={"}), content->arena.store({indent, "}"})};
+    else
+        texts = {content->arena.store({indent, "begin ", name}), content->arena.store({indent, "end ", name})};
+
+    size_t position = content->lines.positionOf(parent.endLine);
+    content->lines.insert({position, position}, texts);
+    markDirty(position);
+    rebuildIndex();
+
+    record(std::move(change));
+    endStep();
+    return true;
+}
+
+void ConfigEditor::setSyncOnSave(bool sync)
+{
+    syncOnSave = sync;
+}
+
+void ConfigEditor::setSaveStrategy(SaveStrategy strategy)
+{
+    saveStrategy = strategy;
 }
 
-bool ConfigEditor::commentLine(const std::vector<std::string> &sectionPath, const std::string &key)
+bool ConfigEditor::setValue(const SectionPath &sectionPath,
+                            std::string_view key,
+                            std::string_view value)
 {
-    int lineIndex = findKeyInSection(sectionPath, key);
-    if (lineIndex != -1)
+    if (!materialize())
+        return false;
+
+    const SectionIndex *section = findSection(sectionPath);
+    if (section)
     {
-        std::string &line = lines[lineIndex];
-        if (!isComment(line))
+        auto active = section->keys.find(key);
+        if (active != section->keys.end())
         {
-            // Find the first non-whitespace character and add # before it
-            size_t firstChar = line.find_first_not_of(" \t");
-            if (firstChar != std::string::npos)
-            {
-                line.insert(firstChar, "# ");
-            }
+            // Key exists, update it in place and preserve the original indentation;
+            // the section index does not change, so it stays shared with snapshots
+            detach();
+            beginStep();
+            replaceLine(*section, active->second,
+                        {leadingWhitespace(content->lines.text(active->second)), key, keySeparator(), value});
+            endStep();
+            return true;
         }
-        return true;
     }
-    return false;
+
+    if (!section || !applyEdits({{Edit::Action::Set, sectionPath, std::string(key), std::string(value)}}))
+    {
+        std::cerr << "Error: Could not find section path" << std::endl;
+        return false;
+    }
+    return true;
 }
 
-bool ConfigEditor::uncommentLine(const std::vector<std::string> &sectionPath, const std::string &key)
+bool ConfigEditor::applyEdits(const std::vector<Edit> &edits)
 {
-    int lineIndex = findKeyInSection(sectionPath, key);
-    if (lineIndex != -1)
+    if (!materialize())
+        return false;
+
+    // Resolve and validate everything first so a bad edit leaves the file untouched
+    for (size_t i = 0; i < edits.size(); ++i)
+    {
+        const Edit &edit = edits[i];
+        const SectionIndex *section = findSection(edit.sectionPath);
+        if (!section)
+            return false;
+
+        if (edit.action != Edit::Action::Set &&
+            !section->keys.count(edit.key) && !section->commentedKeys.count(edit.key))
+        {
+            // Comment/uncomment may also target a key added earlier in the batch
+            bool addedEarlier = false;
+            for (size_t j = 0; j < i && !addedEarlier; ++j)
+            {
+                addedEarlier = edits[j].sectionPath == edit.sectionPath && edits[j].action == Edit::Action::Set &&
+                               edits[j].key == edit.key;
+            }
+            if (!addedEarlier)
+                return false;
+        }
+    }
+
+    // Rewriting the value of a key leaves its section index as it is, so a
+    // section is only cloned away from copies and snapshots when its keys change
+    detach();
+    beginStep();
+    std::vector<PendingKey> pending;
+    // Keys added earlier in the batch, by key; a key may be added to several sections
+    std::unordered_multimap<std::string_view, size_t> pendingByKey;
+    auto findPending = [&](const SectionPath &sectionPath, std::string_view key) -> PendingKey *
     {
-        std::string &line = lines[lineIndex];
-        size_t hashPos = line.find('#');
-        if (hashPos != std::string::npos)
+        auto range = pendingByKey.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it)
         {
-            // Remove # and following space if present
-            size_t removeEnd = hashPos + 1;
-            if (removeEnd < line.length() && line[removeEnd] == ' ')
+            if (pending[it->second].section->path == sectionPath)
+                return &pending[it->second];
+        }
+        return nullptr;
+    };
+
+    for (const Edit &edit : edits)
+    {
+        // Looked up again for every edit, as an earlier one may have cloned the section
+        const SectionIndex &section = *findSection(edit.sectionPath);
+        auto active = section.keys.find(edit.key);
+        PendingKey *added = active == section.keys.end() ? findPending(edit.sectionPath, edit.key) : nullptr;
+
+        switch (edit.action)
+        {
+        case Edit::Action::Set:
+            if (active != section.keys.end())
+            {
+                // Key exists, update it and preserve the original indentation
+                replaceLine(section, active->second,
+                            {leadingWhitespace(content->lines.text(active->second)), edit.key, keySeparator(), edit.value});
+            }
+            else if (added)
             {
-                removeEnd++;
+                added->value = edit.value;
             }
-            line.erase(hashPos, removeEnd - hashPos);
+            else
+            {
+                // Key doesn't exist, add it to the section end with the others
+                SectionIndex &edited = *editSection(edit.sectionPath);
+                pendingByKey.emplace(edit.key, pending.size());
+                pending.push_back({&edited, keyIndent(edited), edit.key, edit.value, false});
+            }
+            break;
+
+        case Edit::Action::Comment:
+            if (active != section.keys.end())
+                commentKeyLine(*editSection(edit.sectionPath), active->second);
+            else if (added)
+                added->commented = true;
+            break;
+
+        case Edit::Action::Uncomment:
+            if (added)
+                added->commented = false;
+            else if (active == section.keys.end())
+                uncommentKey(*editSection(edit.sectionPath), edit.key);
+            break;
         }
+    }
+
+    insertPendingKeys(pending);
+    endStep();
+    return true;
+}
+
+ConfigEditor::Snapshot ConfigEditor::snapshot()
+{
+    Snapshot saved;
+    if (materialize())
+        saved.content = content;
+    return saved;
+}
+
+bool ConfigEditor::restore(const Snapshot &saved)
+{
+    if (!saved.valid())
+        return false;
+
+    streaming = false;
+    beginStep();
+    Change change(Change::Kind::Swap);
+    change.content = content;
+    content = saved.content;
+    record(std::move(change));
+    endStep();
+    return true;
+}
+
+bool ConfigEditor::undo()
+{
+    if (undoSteps.empty())
+        return false;
+
+    std::vector<Change> step = std::move(undoSteps.back());
+    undoSteps.pop_back();
+    for (auto change = step.rbegin(); change != step.rend(); ++change)
+    {
+        applyChange(*change, false);
+    }
+    redoSteps.push_back(std::move(step));
+    return true;
+}
+
+bool ConfigEditor::redo()
+{
+    if (redoSteps.empty())
+        return false;
+
+    std::vector<Change> step = std::move(redoSteps.back());
+    redoSteps.pop_back();
+    for (auto &change : step)
+    {
+        applyChange(change, true);
+    }
+    undoSteps.push_back(std::move(step));
+    return true;
+}
+
+bool ConfigEditor::canUndo() const
+{
+    return !undoSteps.empty();
+}
+
+bool ConfigEditor::canRedo() const
+{
+    return !redoSteps.empty();
+}
+
+void ConfigEditor::clearHistory()
+{
+    undoSteps.clear();
+    redoSteps.clear();
+}
+
+void ConfigEditor::setHistoryLimit(size_t steps)
+{
+    historyLimit = steps;
+    while (undoSteps.size() > historyLimit)
+        undoSteps.pop_front();
+}
+
+std::string_view ConfigEditor::lookupValue(const SectionPath &sectionPath, std::string_view key,
+                                          std::string &scratch)
+{
+    if (streaming)
+    {
+        ValueFinder finder(sectionPath, key, dialect == ConfigDialect::FlatKeyValue);
+        finder.firstOnly = dialect == ConfigDialect::BraceBlocks;
+        ConfigParser::parseFile(loadedFrom, finder, dialect);
+        scratch = std::move(finder.value);
+        return scratch;
+    }
+
+    LineId line = findKeyInSection(sectionPath, key);
+    if (line != LineTable::END)
+    {
+        return parseKeyValue(content->lines.text(line)).second;
+    }
+    return std::string_view(); // Key not found
+}
+
+std::string ConfigEditor::getValue(const SectionPath &sectionPath, std::string_view key)
+{
+    std::string scratch;
+    return std::string(lookupValue(sectionPath, key, scratch));
+}
+
+bool ConfigEditor::commentLine(const SectionPath &sectionPath, std::string_view key)
+{
+    if (!materialize())
+        return false;
+
+    LineId line = findKeyInSection(sectionPath, key);
+    if (line != LineTable::END)
+    {
+        beginStep();
+        commentKeyLine(*editSection(sectionPath), line);
+        endStep();
         return true;
     }
     return false;
 }
 
-bool ConfigEditor::keyExists(const std::vector<std::string> &sectionPath, const std::string &key)
+bool ConfigEditor::uncommentLine(const SectionPath &sectionPath, std::string_view key)
 {
-    return findKeyInSection(sectionPath, key) != -1;
+    if (!materialize())
+        return false;
+
+    SectionIndex *section = editSection(sectionPath);
+    if (!section)
+        return false;
+
+    beginStep();
+    bool uncommented = uncommentKey(*section, key);
+    endStep();
+    return uncommented;
 }
 
-std::vector<std::string> ConfigEditor::getKeysInSection(const std::vector<std::string> &sectionPath)
+bool ConfigEditor::keyExists(const SectionPath &sectionPath, std::string_view key)
 {
-    std::vector<std::string> keys;
-    std::vector<std::string> currentPath;
-    bool inTargetSection = false;
+    if (streaming)
+    {
+        ValueFinder finder(sectionPath, key);
+        finder.firstOnly = dialect == ConfigDialect::BraceBlocks;
+        ConfigParser::parseFile(loadedFrom, finder, dialect);
+        return finder.found;
+    }
+    return findKeyInSection(sectionPath, key) != LineTable::END;
+}
 
-    for (size_t i = 0; i < lines.size(); ++i)
+std::vector<std::string> ConfigEditor::getKeysInSection(const SectionPath &sectionPath)
+{
+    if (streaming)
     {
-        std::string line = trim(lines[i]);
+        KeyCollector collector(sectionPath);
+        collector.firstOnly = dialect == ConfigDialect::BraceBlocks;
+        ConfigParser::parseFile(loadedFrom, collector, dialect);
+        return collector.keys;
+    }
 
-        if (isComment(line))
-            continue;
+    std::vector<std::string> keys;
+    const SectionIndex *section = findSection(sectionPath);
+    if (!section)
+        return keys;
 
-        // Check for begin statement
-        if (line.find("begin ") == 0)
-        {
-            std::string sectionName = trim(line.substr(6));
-            currentPath.push_back(sectionName);
-            inTargetSection = (currentPath == sectionPath);
-        }
-        // Check for end statement
-        else if (line.find("end ") == 0)
+    for (LineId line : section->keyLines)
+    {
+        std::string_view key = parseKeyValue(content->lines.text(line)).first;
+        if (!key.empty())
         {
-            if (!currentPath.empty())
-            {
-                currentPath.pop_back();
-                inTargetSection = (currentPath == sectionPath);
-            }
-        }
-        // Check for key-value pair
-        else if (inTargetSection && line.find('=') != std::string::npos)
-        {
-            auto kvPair = parseKeyValue(line);
-            if (!kvPair.first.empty())
-            {
-                keys.push_back(kvPair.first);
-            }
+            keys.emplace_back(key);
         }
     }
 
     return keys;
 }
 
-bool ConfigEditor::sectionExists(const std::vector<std::string> &sectionPath)
+bool ConfigEditor::sectionExists(const SectionPath &sectionPath)
 {
+    if (streaming)
+    {
+        if (sectionPath.isRoot())
+            return true;
+        SectionFinder finder(sectionPath);
+        ConfigParser::parseFile(loadedFrom, finder, dialect);
+        return finder.found;
+    }
     return findSectionEnd(sectionPath) != -1;
 }
 
 size_t ConfigEditor::getLineCount() const
 {
-    return lines.size();
+    if (streaming)
+    {
+        size_t count = 0;
+        ConfigParser::readLines(loadedFrom, [&count](std::string_view)
+                                { ++count; return true; });
+        return count;
+    }
+    return content->lines.size();
 }
 
 std::string ConfigEditor::getLine(size_t index) const
 {
-    if (index < lines.size())
+    if (streaming)
+    {
+        std::string result;
+        size_t current = 0;
+        ConfigParser::readLines(loadedFrom, [&](std::string_view line)
+                                {
+                                    if (current++ != index)
+                                        return true;
+                                    result = std::string(line);
+                                    return false; });
+        return result;
+    }
+
+    if (index < content->lines.size())
     {
-        return lines[index];
+        return std::string(content->lines[index]);
     }
     return "";
 }
 
 void ConfigEditor::clear()
 {
-    lines.clear();
+    // Snapshots and copies may still hold the old content, so start a new one
+    content = std::make_shared<Content>();
+    savedSource.reset();
+    loadedFrom.clear();
+    savedId = 0;
+    loadedHash.reset();
+    loadedStamp = FileStamp();
+    streaming = false;
+    clearHistory();
 }
 
 void ConfigEditor::printConfig(bool showLineNumbers) const
 {
-    for (size_t i = 0; i < lines.size(); ++i)
+    size_t i = 0;
+    auto print = [&](std::string_view line)
     {
         if (showLineNumbers)
         {
             std::cout << i << ": ";
         }
-        std::cout << lines[i] << std::endl;
+        std::cout << line << std::endl;
+        ++i;
+        return true;
+    };
+
+    if (streaming)
+    {
+        ConfigParser::readLines(loadedFrom, print);
+        return;
+    }
+    for (std::string_view line : content->lines)
+    {
+        print(line);
     }
 }
@@ -1,7 +1,21 @@
 #ifndef CONFIG_EDITOR_HPP
 #define CONFIG_EDITOR_HPP
 
+#include "config-parser.hpp"
+#include "config-schema.hpp"
+#include "file-buffer.hpp"
+#include "line-arena.hpp"
+#include "line-table.hpp"
+#include "section-path.hpp"
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 
@@ -11,49 +25,499 @@
  * This class provides functionality to load, modify, and save configuration files
  * that use a hierarchical structure with "begin" and "end" keywords to define sections.
  * It preserves formatting and indentation while allowing safe modifications.
+ *
+ * The same editor handles the other formats in ConfigDialect, such as the
+ * "network={ ... }" blocks of wpa_supplicant.conf and the flat KEY=VALUE lines of
+ * /boot/network, chosen with setDialect().
+ *
+ * Lines are kept as views into the loaded file contents; only lines that are
+ * edited or inserted get storage of their own, in an arena owned by the editor.
+ * Scanning lines and looking up keys works on views and does not allocate.
+ *
+ * The lines and their index are shared copy-on-write between copies of an editor
+ * and its snapshots, so copying and taking a snapshot are O(1). Edits are recorded
+ * in an undo journal as line-level changes.
+ *
+ * Lines live in a LineTable, and the index refers to them by LineId, so adding a
+ * key costs O(log n) instead of moving every line and index entry after it.
  */
 class ConfigEditor
 {
+public:
+    /**
+     * @brief How loadFile() brings the file contents into memory
+     */
+    enum class LoadMode
+    {
+        Buffered, // Read the whole file with a single read into one heap block
+        Mapped,   // Memory-map the file read-only, no copy of the contents at all
+        Streaming // Read nothing up front; queries stream the file through ConfigParser
+                  // in bounded memory until the first edit loads it (as Buffered)
+    };
+
+    /**
+     * @brief How saveFile() writes changes back to the file they were loaded from
+     */
+    enum class SaveStrategy
+    {
+        AtomicRewrite, // Write a temporary file and rename it over the target
+        PatchInPlace   // Rewrite only the changed tail of the file in place; I/O is
+                       // proportional to the edit, but an interrupted write can
+                       // leave the file damaged
+    };
+
+    /**
+     * @brief The configuration as saveFile() would write it, in pieces, from render()
+     *
+     * Runs of unedited lines are single views into the loaded file contents,
+     * newlines included, so rendering copies no text; only edited and inserted
+     * lines are pieces of their own. The views are valid until the editor changes.
+     */
+    struct Rendering
+    {
+        std::vector<std::string_view> segments; // Pieces of the file, in order
+        size_t size = 0;                        // Total bytes
+        uint64_t hash = FileBuffer::HASH_SEED;  // FileBuffer::hash() of the whole file
+    };
+
+    /**
+     * @brief A single operation for applyEdits()
+     */
+    struct Edit
+    {
+        enum class Action
+        {
+            Set,      // Set or add "key = value"
+            Comment,  // Comment out the key
+            Uncomment // Re-enable a commented-out key
+        };
+
+        Action action;
+        SectionPath sectionPath;
+        std::string key;
+        std::string value; // Only used by Action::Set
+    };
+
 private:
-    std::vector<std::string> lines;
+    /**
+     * @brief Lines of a single section, built once by rebuildIndex()
+     *
+     * A section path may appear more than once in a file; all occurrences are
+     * merged into one entry and the first occurrence is used for insertions.
+     * Repeated brace blocks, such as the network={ blocks of wpa_supplicant.conf,
+     * each describe something of their own, so only the first one is indexed.
+     * The root section (empty path) has no begin line and ends at end of file
+     * (LineTable::END).
+     */
+    struct SectionIndex
+    {
+        SectionPath path;
+        LineId beginLine = 0;
+        LineId endLine = 0;
+        std::vector<LineId> keyLines;          // Active "key = value" lines, in file order
+        std::vector<LineId> commentedKeyLines; // "# key = value" lines, in file order
+        // Key -> first active / commented line; the keys are views into the lines
+        std::unordered_map<std::string_view, LineId> keys;
+        std::unordered_map<std::string_view, LineId> commentedKeys;
+    };
+
+    /**
+     * @brief Section index entries by path, split into shards shared copy-on-write
+     *
+     * Copying the map copies SHARD_COUNT pointers. Changing it through entry() or
+     * forEach() first clones the shard it touches if a copy still shares it, so a
+     * snapshot of a file with many sections is cheap to take and to edit.
+     */
+    class SectionMap
+    {
+    public:
+        /**
+         * @brief Look up the entry of a path
+         * @param path Section path
+         * @return The entry, or nullptr if the path has none
+         */
+        const SectionIndex *find(const SectionPath &path) const;
+
+        /**
+         * @brief Get the slot of a path for changing, adding an empty one if missing
+         * @param path Section path
+         * @return Slot holding the entry; nullptr if it was just added. Stays valid
+         *         until the map is copied
+         *
+         * The entry itself may still be shared with a copy of the map; only the slot
+         * is not.
+         */
+        std::shared_ptr<SectionIndex> &entry(const SectionPath &path);
+
+        /**
+         * @brief Call a function with the path and slot of every entry
+         * @param visit Called as visit(path, slot), in no particular order
+         */
+        template <typename Visit>
+        void forEach(Visit visit)
+        {
+            for (std::shared_ptr<Shard> &shard : shards)
+            {
+                if (!shard)
+                    continue;
+                for (auto &slot : ownShard(shard))
+                    visit(slot.first, slot.second);
+            }
+        }
+
+    private:
+        static const size_t SHARD_COUNT = 256;
+        using Shard = std::unordered_map<SectionPath, std::shared_ptr<SectionIndex>>;
+
+        std::array<std::shared_ptr<Shard>, SHARD_COUNT> shards; // nullptr until a path falls in it
+
+        static Shard &ownShard(std::shared_ptr<Shard> &shard);
+    };
+
+    /**
+     * @brief A key line queued by applyEdits() for insertion at its section end
+     */
+    struct PendingKey
+    {
+        SectionIndex *section;
+        std::string_view indent;
+        std::string_view key;
+        std::string_view value;
+        bool commented;
+    };
+
+    static const size_t DEFAULT_HISTORY_LIMIT = 1000;
 
     /**
-     * @brief Remove leading and trailing whitespace from a string
-     * @param str Input string
-     * @return Trimmed string
+     * @brief Lines and section index, shared between copies and snapshots of an editor
+     *
+     * Never modified while shared: editing operations call detach() first, which
+     * clones the content if a copy or snapshot still refers to it. The clone shares
+     * the section index too, and editSection() clones only the entry about to change
+     * and its shard of the map, so the first edit after a snapshot does not cost the
+     * number of sections or keys in the file.
      */
-    std::string trim(const std::string &str);
+    struct Content
+    {
+        LineTable lines;
+        SectionMap sections;                      // Shared with clones until edited
+        std::shared_ptr<const FileBuffer> source; // Contents the unedited lines point into
+        LineArena arena;                          // Storage for edited and inserted lines
+        size_t firstDirtyLine = SIZE_MAX;         // Lines before this one are as saveId wrote them
+        uint64_t saveId = 0;                      // Load or save these lines were last written by, 0 if none
+        std::vector<std::shared_ptr<const void>> retained; // Storage of earlier saves that undo can bring lines back from
+    };
+
+    /**
+     * @brief A line-level change recorded in the undo journal
+     */
+    struct Change
+    {
+        enum class Kind
+        {
+            Replace, // The text of one line was replaced
+            Insert,  // Lines were inserted
+            Swap     // The whole content was replaced by restore() or addSection()
+        };
+
+        Kind kind;
+        size_t line = 0;                       // Replace: line position
+        SectionPath section;                   // Replace: section the line belongs to
+        std::string_view before;               // Replace: text before the change
+        std::string_view after;                // Replace: text after the change
+        std::vector<size_t> positions;         // Insert: positions of the new lines, ascending
+        std::vector<std::string_view> texts;   // Insert: text of each new line
+        std::vector<SectionPath> sectionPaths; // Insert: section of each new line
+        std::shared_ptr<Content> content;      // Swap: the content on the other side of the change
+        explicit Change(Kind changeKind) : kind(changeKind) {}
+    };
+
+    std::shared_ptr<Content> content = std::make_shared<Content>();
+    std::shared_ptr<const FileBuffer> savedSource; // Buffer holding exactly what loadedFrom holds on disk
+    std::string loadedFrom;  // File the current contents were loaded from or last saved to
+    uint64_t savedId = 0;    // saveId of the content that file holds, 0 if unknown
+    mutable std::optional<uint64_t> loadedHash; // Hash of the contents of that file; after a
+                                                // patched save only worked out once asked for
+    FileStamp loadedStamp;   // On-disk version of that file when it was loaded or saved
+    bool syncOnSave = true;
+    bool streaming = false; // Loaded with LoadMode::Streaming and not edited yet
+    SaveStrategy saveStrategy = SaveStrategy::AtomicRewrite;
+    ConfigDialect dialect = ConfigDialect::BeginEnd;
+    std::deque<std::vector<Change>> undoSteps;  // One entry per public editing call, oldest first
+    std::vector<std::vector<Change>> redoSteps; // Undone steps, most recently undone last
+    size_t historyLimit = DEFAULT_HISTORY_LIMIT;
+    bool recording = false; // Changes are being recorded into undoSteps.back()
 
     /**
      * @brief Check if a line is a comment (starts with # or is empty)
      * @param line Input line
      * @return true if line is a comment, false otherwise
      */
-    bool isComment(const std::string &line);
+    static bool isComment(std::string_view line);
 
     /**
      * @brief Parse a key-value pair from a configuration line
      * @param line Input line containing key = value
-     * @return Pair of key and value strings
+     * @return Pair of trimmed key and value, as views into the line
      */
-    std::pair<std::string, std::string> parseKeyValue(const std::string &line);
+    static std::pair<std::string_view, std::string_view> parseKeyValue(std::string_view line);
 
     /**
-     * @brief Find the line index for a specific key within a section
-     * @param sectionPath Vector of section names representing the path
+     * @brief Find the line of a specific key within a section
+     * @param sectionPath Section path
      * @param key Key to search for
-     * @return Line index if found, -1 if not found
+     * @return Line id if found, LineTable::END if not found
      */
-    int findKeyInSection(const std::vector<std::string> &sectionPath, const std::string &key);
+    LineId findKeyInSection(const SectionPath &sectionPath, std::string_view key);
 
     /**
      * @brief Find the end line of a section for insertion purposes
-     * @param sectionPath Vector of section names representing the path
-     * @return Line index of section end, -1 if section not found
+     * @param sectionPath Section path
+     * @return Line position of section end, -1 if section not found
+     */
+    int findSectionEnd(const SectionPath &sectionPath);
+
+    /**
+     * @brief Parse the key of a commented-out "# key = value" line
+     * @param line Input line
+     * @return Key name as a view into the line, or empty if the comment is not a key-value line
+     */
+    std::string_view parseCommentedKey(std::string_view line) const;
+
+    /**
+     * @brief Check if a line is an active key-value line in the current dialect
+     * @param line Input line
+     * @return true if the parser reports the line as a key-value pair
+     */
+    bool isKeyLine(std::string_view line) const;
+
+    /**
+     * @brief Get what goes between key and value on lines this editor writes
+     * @return " = " for BeginEnd, "=" for the other dialects
+     */
+    std::string_view keySeparator() const;
+
+    /**
+     * @brief Find the index entry of a section
+     * @param sectionPath Section path
+     * @return Pointer to the entry, nullptr if the section does not exist
+     */
+    const SectionIndex *findSection(const SectionPath &sectionPath) const;
+
+    /**
+     * @brief Find the index entry of a section to change it
+     * @param sectionPath Section path
+     * @return Pointer to the entry, nullptr if the section does not exist
+     *
+     * Detaches the content and clones the entry if a copy or snapshot still
+     * shares it, so the entry can be modified.
+     */
+    SectionIndex *editSection(const SectionPath &sectionPath);
+
+    /**
+     * @brief Replace the contents of a line with text stored in the arena
+     * @param section Section the line belongs to
+     * @param line Line id
+     * @param parts Pieces of the new line content, concatenated in order
+     */
+    void replaceLine(const SectionIndex &section, LineId line, std::initializer_list<std::string_view> parts);
+
+    /**
+     * @brief Record that a line no longer matches the loaded file
+     * @param index Line position (0-based)
+     */
+    void markDirty(size_t index);
+
+    /**
+     * @brief Overwrite the changed tail of the loaded file in place
+     * @param filename Path to the file, which must be the one the contents were loaded from
+     * @return true if the file was patched and the editor marked as saved, false if a
+     *         full rewrite should be done instead
+     *
+     * Only the lines from the first dirty one on are rendered and written; the file
+     * offset they start at comes from the line table.
+     */
+    bool patchFile(const std::string &filename);
+
+    /**
+     * @brief Record that the file now holds the lines as they are
+     *
+     * Gives the content a new saveId, detaching it from copies and snapshots first,
+     * so later edits are patched relative to this state.
+     */
+    void markWritten();
+
+    /**
+     * @brief Get the hash of the file last loaded or saved
+     * @return The hash, or nothing if it is unknown and the lines no longer tell it
+     */
+    std::optional<uint64_t> savedHash() const;
+
+    /**
+     * @brief Point all lines into a fresh copy of the saved contents
+     * @param contents Contents that were just written, one line per entry of lines
+     *
+     * Afterwards the source matches the file on disk again, so unchanged lines
+     * render as one piece, and the arena is released. Content shared with a copy
+     * or snapshot is detached first.
+     */
+    void rebaseOnto(const std::string &contents);
+
+    class IndexBuilder;
+
+    /**
+     * @brief Rebuild the section index from scratch with a single pass of ConfigParser over all lines
+     */
+    void rebuildIndex();
+
+    /**
+     * @brief Load a file opened with LoadMode::Streaming before it is edited
+     * @return true if the lines are loaded, false if the file could not be read
+     */
+    bool materialize();
+
+    /**
+     * @brief Rebuild the key lookup maps of a section from its line lists
+     * @param section Section index entry to refresh
+     */
+    void reindexKeys(SectionIndex &section);
+
+    /**
+     * @brief Point the key lookup maps of a section at the current line text
+     * @param section Section index entry to update
+     *
+     * Unlike reindexKeys(), this keeps the map nodes and only swaps the key views,
+     * for when the lines moved to new storage without changing.
+     */
+    void repointKeys(SectionIndex &section);
+
+    /**
+     * @brief Get the indentation of a line
+     * @param line Input line
+     * @return Leading spaces and tabs, as a view into the line
+     */
+    static std::string_view leadingWhitespace(std::string_view line);
+
+    /**
+     * @brief Pick the indentation for a key added to a section
+     * @param section Section the key is added to
+     * @return Indentation of the section's last key, or one level deeper than the
+     *         section's begin line if it has no keys yet
+     */
+    std::string_view keyIndent(const SectionIndex &section);
+
+    /**
+     * @brief Get the indentation for a line nested one level inside a section
+     * @param section The enclosing section
+     * @return Nothing for the root, otherwise the begin line's indentation plus one level
+     */
+    std::string_view nestedIndent(const SectionIndex &section);
+
+    /**
+     * @brief Comment out an active key line and move it in the index
+     * @param section Section the line belongs to
+     * @param line Line id of the key
+     */
+    void commentKeyLine(SectionIndex &section, LineId line);
+
+    /**
+     * @brief Uncomment a commented-out key and move it in the index
+     * @param section Section the key belongs to
+     * @param key Key name
+     * @return true if the key is active afterwards, false if it was not found
+     */
+    bool uncommentKey(SectionIndex &section, std::string_view key);
+
+    /**
+     * @brief Insert queued key lines at their section ends in one pass
+     * @param pending Key lines to insert; reordered by section end
+     */
+    void insertPendingKeys(std::vector<PendingKey> &pending);
+
+    /**
+     * @brief Insert key lines into their sections and record the change
+     * @param insertedAt Sorted line positions, before any insertion, to insert each line before
+     * @param texts Text of each new line
+     * @param sectionPaths Section of each new line
+     */
+    void insertLines(const std::vector<size_t> &insertedAt, std::vector<std::string_view> texts,
+                     std::vector<SectionPath> sectionPaths);
+
+    /**
+     * @brief Remove key lines inserted by insertLines()
+     * @param positions Sorted positions of the lines to remove
+     * @param sectionPaths Section of each line
+     */
+    void eraseLines(const std::vector<size_t> &positions, const std::vector<SectionPath> &sectionPaths);
+
+    /**
+     * @brief Move a key line between the active and commented lists after its text changed
+     * @param sectionPath Section the line belongs to
+     * @param line Line id
+     * @param previous Text of the line before the change
+     */
+    void reclassifyLine(const SectionPath &sectionPath, LineId line, std::string_view previous);
+
+    /**
+     * @brief Make sure the content is not shared with a copy or snapshot before editing it
+     * @return Content owned by this editor alone
+     */
+    Content &detach();
+
+    /**
+     * @brief Start recording the changes of one public editing call as an undo step
+     */
+    void beginStep();
+
+    /**
+     * @brief Finish the undo step started by beginStep()
+     */
+    void endStep();
+
+    /**
+     * @brief Add a change to the undo step being recorded, if any
+     * @param change Change to record
+     */
+    void record(Change change);
+
+    /**
+     * @brief Apply a recorded change again or revert it
+     * @param change Change to apply
+     * @param forward true to redo the change, false to undo it
+     */
+    void applyChange(Change &change, bool forward);
+
+    /**
+     * @brief Look up a value without copying it
+     * @param sectionPath Section path
+     * @param key Key name
+     * @param scratch Storage for the value when it cannot be viewed in place (streaming mode)
+     * @return Value, empty if the key is not found; valid until the next edit
      */
-    int findSectionEnd(const std::vector<std::string> &sectionPath);
+    std::string_view lookupValue(const SectionPath &sectionPath, std::string_view key, std::string &scratch);
 
 public:
+    /**
+     * @brief State of the configuration saved by snapshot() and brought back by restore()
+     *
+     * Taking a snapshot only shares the editor's content; the editor makes its own
+     * copy the next time it is edited. A snapshot stays valid after the editor is
+     * saved, edited or destroyed.
+     */
+    class Snapshot
+    {
+    private:
+        friend class ConfigEditor;
+        std::shared_ptr<Content> content;
+
+    public:
+        /**
+         * @brief Check whether the snapshot holds a state
+         * @return true if taken with snapshot(), false if default-constructed
+         */
+        bool valid() const { return content != nullptr; }
+    };
+
     /**
      * @brief Default constructor
      */
@@ -62,15 +526,16 @@ public:
     /**
      * @brief Constructor that loads a file immediately
      * @param filename Path to the configuration file
+     * @param mode How to bring the file into memory
      */
-    explicit ConfigEditor(const std::string &filename);
+    explicit ConfigEditor(const std::string &filename, LoadMode mode = LoadMode::Buffered);
 
     /**
      * @brief Destructor
      */
     ~ConfigEditor() = default;
 
-    // Copy constructor and assignment operator
+    // Copy constructor and assignment operator; copies share the content until either is edited
     ConfigEditor(const ConfigEditor &other) = default;
     ConfigEditor &operator=(const ConfigEditor &other) = default;
 
@@ -81,20 +546,159 @@ public:
     /**
      * @brief Load a configuration file into memory
      * @param filename Path to the configuration file
+     * @param mode How to bring the file into memory; Mapped avoids copying the
+     *             contents, which pays off when loading many files
+     * @return true if successful, false if file could not be opened
+     */
+    bool loadFile(const std::string &filename, LoadMode mode = LoadMode::Buffered);
+
+    /**
+     * @brief Load a configuration file, reusing another editor's parse of the same contents
+     * @param filename Path to the configuration file
+     * @param base Editor that already loaded a file, e.g. the same file in another
+     *             copy of a system image; it is only read, never changed
+     * @param mode How to bring the file into memory; Streaming ignores the base
      * @return true if successful, false if file could not be opened
+     *
+     * If the file holds exactly what base loaded and base has not been edited since,
+     * the lines and index of base are shared copy-on-write instead of splitting and
+     * indexing the file again. Otherwise this is the same as loadFile(filename, mode).
+     * Several editors may load from one base at the same time on different threads.
+     */
+    bool loadFile(const std::string &filename, const ConfigEditor &base, LoadMode mode = LoadMode::Buffered);
+
+    /**
+     * @brief Load a configuration from contents that are already in memory
+     * @param filename Name the contents are saved under, e.g. a path inside a disk
+     *                 image; isUpToDate() and markSaved() compare against it
+     * @param buffer The contents, e.g. from Fat32Image::read()
      */
-    bool loadFile(const std::string &filename);
+    void loadBuffer(const std::string &filename, std::shared_ptr<const FileBuffer> buffer);
+
+    /**
+     * @brief Load a configuration from contents in memory, reusing another editor's parse
+     * @param filename Name the contents are saved under
+     * @param buffer The contents
+     * @param base Editor whose lines and index are shared if it loaded the same
+     *             contents and is unchanged, as for loadFile() with a base
+     */
+    void loadBuffer(const std::string &filename, std::shared_ptr<const FileBuffer> buffer, const ConfigEditor &base);
 
     /**
      * @brief Save the current configuration to a file
      * @param filename Path where to save the configuration
      * @return true if successful, false if file could not be written
+     *
+     * The file is replaced atomically through a temporary file, so an interrupted
+     * save never leaves a truncated configuration behind. Nothing is written at
+     * all if the contents are unchanged from what was loaded from (or last saved
+     * to) the same file.
+     *
+     * With SaveStrategy::PatchInPlace, saving back to the loaded file writes only
+     * the bytes from the first change onwards, as long as that is less than half
+     * of the file and the file was not modified by anyone else in the meantime;
+     * otherwise it falls back to the atomic rewrite. Only that tail is rendered, so
+     * a patched save costs about the size of the tail rather than of the file.
+     * Memory-mapped contents are always rewritten atomically.
      */
     bool saveFile(const std::string &filename);
 
+    /**
+     * @brief Render the configuration exactly as saveFile() would write it
+     * @return File contents, empty if a streamed file could not be read
+     *
+     * Together with isUpToDate() and markSaved() this lets a caller write several
+     * files itself, e.g. to commit them as one group.
+     */
+    std::string getContents();
+
+    /**
+     * @brief Render the configuration as pieces that can be written without joining them
+     * @return The pieces, empty if a streamed file could not be read
+     *
+     * For a document shared from a base with ConfigEditor::loadFile(const std::string &,
+     * const ConfigEditor &, LoadMode), the unchanged bytes come straight from the
+     * base's buffer, so writing a device's copy costs about its edits plus the write.
+     */
+    Rendering render();
+
+    /**
+     * @brief Check whether a file already holds a rendering
+     * @param filename Path of the file
+     * @param rendering Rendering from render()
+     * @return true if the file is the one last loaded or saved, unchanged on disk
+     *         since, and the rendering matches it
+     */
+    bool isUpToDate(const std::string &filename, const Rendering &rendering) const;
+
+    /**
+     * @brief Check whether a file already holds the given contents
+     * @param filename Path of the file
+     * @param contents Contents from getContents()
+     * @return true if the file is the one last loaded or saved, unchanged on disk
+     *         since, and the contents match it
+     */
+    bool isUpToDate(const std::string &filename, std::string_view contents) const;
+
+    /**
+     * @brief Record that the caller wrote contents from getContents() to a file
+     * @param filename Path the contents were written to
+     * @param contents The contents written
+     *
+     * Afterwards the editor behaves as if saveFile(filename) had written them.
+     */
+    void markSaved(const std::string &filename, const std::string &contents);
+
+    /**
+     * @brief Record that the caller wrote a rendering from render() to a file
+     * @param filename Path the rendering was written to
+     * @param rendering The rendering written
+     *
+     * Unlike markSaved(const std::string &, const std::string &) the lines are
+     * not moved into a copy of the file, so nothing is copied.
+     */
+    void markSaved(const std::string &filename, const Rendering &rendering);
+
+    /**
+     * @brief Choose how saveFile() writes changes back to the loaded file
+     * @param strategy Save strategy; AtomicRewrite is the default
+     */
+    void setSaveStrategy(SaveStrategy strategy);
+
+    /**
+     * @brief Choose whether saveFile() flushes the new file to disk before returning
+     * @param sync If true (the default), fsync the file and its directory; false trades
+     *             durability on power loss for lower save latency
+     */
+    void setSyncOnSave(bool sync);
+
+    /**
+     * @brief Choose the syntax of the configuration file
+     * @param syntax Format to parse and write; BeginEnd is the default
+     *
+     * Set it before loadFile(). A file already loaded is indexed again.
+     */
+    void setDialect(ConfigDialect syntax);
+
+    /**
+     * @brief Get the syntax of the configuration file
+     * @return Format used to parse and write
+     */
+    ConfigDialect getDialect() const;
+
+    /**
+     * @brief Add an empty section at the end of its parent section
+     * @param sectionPath Path of the new section; its parent must exist
+     * @return true if the section was added or already exists, false if the parent
+     *         does not exist or the dialect has no sections
+     *
+     * Adding a section is a single undo step.
+     */
+    bool addSection(const SectionPath &sectionPath);
+
     /**
      * @brief Set or update a configuration value in a specific section
-     * @param sectionPath Vector of section names representing the hierarchical path
+     * @param sectionPath Section path, e.g. {"winmgr", "display 1"}
      * @param key Configuration key name
      * @param value Configuration value
      * @return true if successful, false if section path not found
@@ -102,58 +706,162 @@ public:
      * @example
      * editor.setValue({"winmgr", "display 1"}, "video-mode", "1920 x 1080 @ 60");
      */
-    bool setValue(const std::vector<std::string> &sectionPath,
-                  const std::string &key,
-                  const std::string &value);
+    bool setValue(const SectionPath &sectionPath,
+                  std::string_view key,
+                  std::string_view value);
+
+    /**
+     * @brief Set a key from the configuration schema to a typed value
+     * @tparam Key Schema key tag, e.g. ConfigSchema::DisplayVideoMode
+     * @param sectionPath Section path, e.g. {"winmgr", "display 1"}
+     * @param value Value to set; validated against the schema and written in canonical form
+     * @return true if successful, false if the value is out of range or the section path is not found
+     *
+     * @example
+     * editor.set<ConfigSchema::DisplayVideoMode>({"winmgr", "display 1"}, {1920, 1080, 60});
+     */
+    template <typename Key>
+    bool set(const SectionPath &sectionPath, const typename Key::value_type &value)
+    {
+        ConfigSchema::FormattedValue text;
+        if (!ConfigSchema::format<Key>(value, text))
+            return false;
+        return setValue(sectionPath, Key::info.name, text.view());
+    }
+
+    /**
+     * @brief Get the typed value of a key from the configuration schema
+     * @tparam Key Schema key tag, e.g. ConfigSchema::DisplayCursor
+     * @param sectionPath Section path, e.g. {"winmgr", "display 1"}
+     * @return Parsed value, or std::nullopt if the key is missing or its value is invalid
+     */
+    template <typename Key>
+    std::optional<typename Key::value_type> get(const SectionPath &sectionPath)
+    {
+        std::string scratch;
+        return ConfigSchema::parse<Key>(lookupValue(sectionPath, Key::info.name, scratch));
+    }
+
+    /**
+     * @brief Apply a set of edits with a single pass over the file
+     * @param edits Operations to apply, in order
+     * @return true if successful, false if a section path or a key to
+     *         (un)comment was not found, in which case nothing is changed
+     *
+     * Keys that do not exist yet are collected and appended together at the
+     * end of their section, instead of being inserted one by one.
+     *
+     * @example
+     * editor.applyEdits({{ConfigEditor::Edit::Action::Set, {"winmgr", "display 1"}, "cursor", "on"},
+     *                    {ConfigEditor::Edit::Action::Set, {"winmgr", "globals"}, "keymap", "en_US_101"}});
+     */
+    bool applyEdits(const std::vector<Edit> &edits);
+
+    /**
+     * @brief Take a snapshot of the current lines in O(1)
+     * @return Snapshot to pass to restore()
+     *
+     * An editor loaded with LoadMode::Streaming loads the file first.
+     */
+    Snapshot snapshot();
+
+    /**
+     * @brief Bring back the lines saved in a snapshot
+     * @param saved Snapshot taken from this editor or a copy of it
+     * @return true if restored, false if the snapshot is not valid
+     *
+     * Restoring is recorded in the undo journal like any other edit.
+     */
+    bool restore(const Snapshot &saved);
+
+    /**
+     * @brief Revert the most recent editing call
+     * @return true if a step was undone, false if there is nothing to undo
+     *
+     * Every call to setValue(), set(), applyEdits(), commentLine(), uncommentLine()
+     * or restore() is one step. Steps survive saveFile().
+     */
+    bool undo();
+
+    /**
+     * @brief Apply the most recently undone step again
+     * @return true if a step was redone, false if there is nothing to redo
+     *
+     * Any new edit clears the steps that can be redone.
+     */
+    bool redo();
+
+    /**
+     * @brief Check whether undo() has a step to revert
+     * @return true if there is a step to undo
+     */
+    bool canUndo() const;
+
+    /**
+     * @brief Check whether redo() has a step to apply
+     * @return true if there is a step to redo
+     */
+    bool canRedo() const;
+
+    /**
+     * @brief Forget all undo and redo steps
+     */
+    void clearHistory();
+
+    /**
+     * @brief Limit how many steps undo() can go back
+     * @param steps Maximum number of undo steps kept; the oldest are dropped first (default 1000)
+     */
+    void setHistoryLimit(size_t steps);
 
     /**
      * @brief Get a configuration value from a specific section
-     * @param sectionPath Vector of section names representing the hierarchical path
+     * @param sectionPath Section path, e.g. {"winmgr", "display 1"}
      * @param key Configuration key name
      * @return Configuration value if found, empty string if not found
      *
      * @example
      * std::string mode = editor.getValue({"winmgr", "display 1"}, "video-mode");
      */
-    std::string getValue(const std::vector<std::string> &sectionPath, const std::string &key);
+    std::string getValue(const SectionPath &sectionPath, std::string_view key);
 
     /**
      * @brief Comment out a configuration line by adding # at the beginning
-     * @param sectionPath Vector of section names representing the hierarchical path
+     * @param sectionPath Section path, e.g. {"winmgr", "display 1"}
      * @param key Configuration key name to comment out
      * @return true if successful, false if key not found
      */
-    bool commentLine(const std::vector<std::string> &sectionPath, const std::string &key);
+    bool commentLine(const SectionPath &sectionPath, std::string_view key);
 
     /**
      * @brief Uncomment a configuration line by removing # from the beginning
-     * @param sectionPath Vector of section names representing the hierarchical path
+     * @param sectionPath Section path, e.g. {"winmgr", "display 1"}
      * @param key Configuration key name to uncomment
      * @return true if successful, false if key not found
      */
-    bool uncommentLine(const std::vector<std::string> &sectionPath, const std::string &key);
+    bool uncommentLine(const SectionPath &sectionPath, std::string_view key);
 
     /**
      * @brief Check if a key exists in a specific section
-     * @param sectionPath Vector of section names representing the hierarchical path
+     * @param sectionPath Section path, e.g. {"winmgr", "display 1"}
      * @param key Configuration key name
      * @return true if key exists, false otherwise
      */
-    bool keyExists(const std::vector<std::string> &sectionPath, const std::string &key);
+    bool keyExists(const SectionPath &sectionPath, std::string_view key);
 
     /**
      * @brief Get all keys in a specific section
-     * @param sectionPath Vector of section names representing the hierarchical path
+     * @param sectionPath Section path, e.g. {"winmgr", "display 1"}
      * @return Vector of key names found in the section
      */
-    std::vector<std::string> getKeysInSection(const std::vector<std::string> &sectionPath);
+    std::vector<std::string> getKeysInSection(const SectionPath &sectionPath);
 
     /**
      * @brief Check if a section exists
-     * @param sectionPath Vector of section names representing the hierarchical path
+     * @param sectionPath Section path, e.g. {"winmgr", "display 1"}
      * @return true if section exists, false otherwise
      */
-    bool sectionExists(const std::vector<std::string> &sectionPath);
+    bool sectionExists(const SectionPath &sectionPath);
 
     /**
      * @brief Get the number of lines in the configuration
@@ -0,0 +1,274 @@
+#include "config-parser.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    // Block size for streaming reads; lines longer than this grow the carry-over buffer
+    const size_t READ_BLOCK_SIZE = 64 * 1024;
+}
+
+bool ConfigVisitor::enterSection(const SectionScope &, size_t) { return true; }
+bool ConfigVisitor::exitSection(const SectionScope &, size_t) { return true; }
+bool ConfigVisitor::keyValue(const SectionScope &, std::string_view, std::string_view, size_t) { return true; }
+bool ConfigVisitor::comment(const SectionScope &, std::string_view, size_t) { return true; }
+
+void SectionScope::push(std::string_view name)
+{
+    nameBytes.append(name);
+    nameEnds.push_back(nameBytes.size());
+    hashes.push_back(SectionPath::childHash(hashes.empty() ? 0 : hashes.back(), name));
+}
+
+void SectionScope::pop()
+{
+    nameEnds.pop_back();
+    hashes.pop_back();
+    nameBytes.resize(nameEnds.empty() ? 0 : nameEnds.back());
+    if (interned.size() > nameEnds.size())
+        interned.resize(nameEnds.size());
+}
+
+std::string_view SectionScope::name(size_t level) const
+{
+    size_t start = level == 0 ? 0 : nameEnds[level - 1];
+    return std::string_view(nameBytes).substr(start, nameEnds[level] - start);
+}
+
+bool SectionScope::matches(const SectionPath &path) const
+{
+    // The hash rules out almost every other section without touching the path table
+    size_t hash = hashes.empty() ? 0 : hashes.back();
+    if (hash != path.hash())
+        return false;
+    if (interned.size() == nameEnds.size())
+        return (interned.empty() ? SectionPath() : interned.back()) == path;
+
+    std::vector<std::string> names = path.names();
+    if (names.size() != nameEnds.size())
+        return false;
+    for (size_t level = 0; level < names.size(); ++level)
+    {
+        if (names[level] != name(level))
+            return false;
+    }
+    return true;
+}
+
+SectionPath SectionScope::path() const
+{
+    // Intern only the levels not interned yet, so entering nested sections stays cheap
+    while (interned.size() < nameEnds.size())
+    {
+        SectionPath parent = interned.empty() ? SectionPath() : interned.back();
+        interned.push_back(parent.child(name(interned.size())));
+    }
+    return interned.empty() ? SectionPath() : interned.back();
+}
+
+ConfigParser::ConfigParser(ConfigVisitor &configVisitor, ConfigDialect syntax)
+    : visitor(configVisitor), dialect(syntax)
+{
+}
+
+std::string_view ConfigParser::trim(std::string_view text)
+{
+    size_t start = text.find_first_not_of(" \t");
+    if (start == std::string_view::npos)
+        return std::string_view();
+    size_t end = text.find_last_not_of(" \t");
+    return text.substr(start, end - start + 1);
+}
+
+ConfigLine ConfigParser::classify(std::string_view rawLine, ConfigDialect dialect)
+{
+    ConfigLine line;
+    line.text = trim(rawLine);
+    std::string_view text = line.text;
+
+    if (text.empty())
+    {
+        line.kind = ConfigLine::Kind::Blank;
+        return line;
+    }
+    if (text[0] == '#')
+    {
+        line.kind = ConfigLine::Kind::Comment;
+        return line;
+    }
+
+    switch (dialect)
+    {
+    case ConfigDialect::BeginEnd:
+        if (text.compare(0, 6, "begin ") == 0)
+        {
+            line.kind = ConfigLine::Kind::SectionBegin;
+            line.name = trim(text.substr(6));
+            return line;
+        }
+        if (text.compare(0, 4, "end ") == 0)
+        {
+            line.kind = ConfigLine::Kind::SectionEnd;
+            return line;
+        }
+        break;
+
+    case ConfigDialect::BraceBlocks:
+        // "network={" and "network = {" both open a block named "network"
+        if (text.back() == '{')
+        {
+            std::string_view name = trim(text.substr(0, text.size() - 1));
+            if (!name.empty() && name.back() == '=')
+                name = trim(name.substr(0, name.size() - 1));
+            line.kind = ConfigLine::Kind::SectionBegin;
+            line.name = name;
+            return line;
+        }
+        if (text == "}")
+        {
+            line.kind = ConfigLine::Kind::SectionEnd;
+            return line;
+        }
+        break;
+
+    case ConfigDialect::FlatKeyValue:
+        break;
+    }
+
+    size_t pos = text.find('=');
+    if (pos == std::string_view::npos)
+    {
+        line.kind = ConfigLine::Kind::Other;
+        return line;
+    }
+    line.kind = ConfigLine::Kind::KeyValue;
+    line.name = trim(text.substr(0, pos));
+    line.value = trim(text.substr(pos + 1));
+    return line;
+}
+
+bool ConfigParser::feedLine(std::string_view rawLine)
+{
+    if (stopped)
+        return false;
+
+    size_t number = lineNumber++;
+    ConfigLine line = classify(rawLine, dialect);
+    bool keepGoing = true;
+
+    switch (line.kind)
+    {
+    case ConfigLine::Kind::Blank:
+    case ConfigLine::Kind::Other:
+        // Blank lines and unrecognized text carry no information
+        break;
+
+    case ConfigLine::Kind::Comment:
+        keepGoing = visitor.comment(openSections, line.text, number);
+        break;
+
+    case ConfigLine::Kind::SectionBegin:
+        openSections.push(line.name);
+        keepGoing = visitor.enterSection(openSections, number);
+        break;
+
+    case ConfigLine::Kind::SectionEnd:
+        // A stray end outside of any section is ignored
+        if (openSections.depth() > 0)
+        {
+            keepGoing = visitor.exitSection(openSections, number);
+            openSections.pop();
+        }
+        break;
+
+    case ConfigLine::Kind::KeyValue:
+        keepGoing = visitor.keyValue(openSections, line.name, line.value, number);
+        break;
+    }
+
+    stopped = !keepGoing;
+    return keepGoing;
+}
+
+bool ConfigParser::finish()
+{
+    // Unterminated sections end at end of input, innermost first
+    while (!stopped && openSections.depth() > 0)
+    {
+        stopped = !visitor.exitSection(openSections, lineNumber);
+        openSections.pop();
+    }
+    return !stopped;
+}
+
+bool ConfigParser::parse(std::string_view contents, ConfigVisitor &visitor, ConfigDialect dialect)
+{
+    ConfigParser parser(visitor, dialect);
+    size_t start = 0;
+    while (start < contents.size())
+    {
+        size_t newline = contents.find('\n', start);
+        if (newline == std::string_view::npos)
+            newline = contents.size();
+        if (!parser.feedLine(contents.substr(start, newline - start)))
+            return false;
+        start = newline + 1;
+    }
+    return parser.finish();
+}
+
+bool ConfigParser::parseFile(const std::string &filename, ConfigVisitor &visitor, ConfigDialect dialect)
+{
+    ConfigParser parser(visitor, dialect);
+    return readLines(filename, [&parser](std::string_view line)
+                     { return parser.feedLine(line); }) &&
+           parser.finish();
+}
+
+bool ConfigParser::readLines(const std::string &filename, const std::function<bool(std::string_view)> &callback)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    std::string buffer;   // Holds one block plus the unfinished line carried over from the last one
+    size_t carried = 0;   // Bytes at the start of buffer that belong to an unfinished line
+    bool completed = true;
+    while (true)
+    {
+        buffer.resize(carried + READ_BLOCK_SIZE);
+        ssize_t count = read(fd, &buffer[carried], READ_BLOCK_SIZE);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            completed = false;
+            break;
+        }
+        if (count == 0)
+        {
+            // Last line without a trailing newline
+            if (carried > 0)
+                completed = callback(std::string_view(buffer.data(), carried));
+            break;
+        }
+
+        std::string_view block(buffer.data(), carried + static_cast<size_t>(count));
+        size_t start = 0;
+        size_t newline;
+        while (completed && (newline = block.find('\n', start)) != std::string_view::npos)
+        {
+            completed = callback(block.substr(start, newline - start));
+            start = newline + 1;
+        }
+        if (!completed)
+            break;
+
+        carried = block.size() - start;
+        buffer.erase(0, start);
+    }
+
+    close(fd);
+    return completed;
+}
@@ -0,0 +1,237 @@
+#ifndef CONFIG_PARSER_HPP
+#define CONFIG_PARSER_HPP
+
+#include "section-path.hpp"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Syntax of a configuration file
+ */
+enum class ConfigDialect
+{
+    BeginEnd,    // QNX graphics configuration: "begin name" ... "end name" sections, "key = value"
+    BraceBlocks, // wpa_supplicant.conf: "name={" ... "}" blocks, "key=value"
+    FlatKeyValue // /boot/network: "KEY=VALUE" lines, no sections
+};
+
+/**
+ * @brief A single configuration line, taken apart by ConfigParser::classify()
+ */
+struct ConfigLine
+{
+    enum class Kind
+    {
+        Blank,
+        Comment,      // Starts with #
+        SectionBegin, // Opens a section; name holds its name
+        SectionEnd,   // Closes the innermost section
+        KeyValue,     // name holds the key and value the value
+        Other         // Anything else, ignored by the parser
+    };
+
+    Kind kind = Kind::Blank;
+    std::string_view text;  // The trimmed line
+    std::string_view name;  // Trimmed section name or key
+    std::string_view value; // Trimmed value
+};
+
+/**
+ * @brief The sections open at the current line of a parse, as handed to ConfigVisitor
+ *
+ * Names are copied onto a small stack owned by the parser, so its memory is bounded
+ * by the nesting depth. A SectionPath is only interned when path() is called;
+ * matches() compares against an existing handle without interning anything, so a
+ * visitor that only looks for known sections leaves the process-wide path table
+ * alone however many distinct sections the input has.
+ */
+class SectionScope
+{
+private:
+    friend class ConfigParser;
+
+    std::string nameBytes;                     // Names of the open sections, outermost first
+    std::vector<size_t> nameEnds;              // End of each name in nameBytes
+    std::vector<size_t> hashes;                // SectionPath::hash() of each open section
+    mutable std::vector<SectionPath> interned; // Handles interned so far, for the outermost sections
+
+    void push(std::string_view name);
+    void pop();
+
+public:
+    /**
+     * @brief Get the number of open sections
+     * @return Depth, 0 outside of any section
+     */
+    size_t depth() const { return nameEnds.size(); }
+
+    /**
+     * @brief Get the name of an open section
+     * @param level 0 for the outermost section, up to depth() - 1
+     * @return Name, valid until the parser moves past the section
+     */
+    std::string_view name(size_t level) const;
+
+    /**
+     * @brief Get the name of the innermost open section
+     * @return Name, empty outside of any section
+     */
+    std::string_view name() const { return nameEnds.empty() ? std::string_view() : name(nameEnds.size() - 1); }
+
+    /**
+     * @brief Check whether the open sections form a given path, without interning them
+     * @param path Path to compare against
+     * @return true if the innermost open section is that path
+     */
+    bool matches(const SectionPath &path) const;
+
+    /**
+     * @brief Get the interned path of the innermost open section
+     * @return Section path, the root outside of any section
+     */
+    SectionPath path() const;
+};
+
+/**
+ * @brief Callbacks for ConfigParser, one per kind of configuration line
+ *
+ * Every callback receives the 0-based line number and returns true to keep parsing
+ * or false to stop early. The default implementations ignore the line.
+ */
+class ConfigVisitor
+{
+public:
+    virtual ~ConfigVisitor() = default;
+
+    /**
+     * @brief Called for a "begin <name>" line
+     * @param scope Open sections, with the one being entered innermost
+     * @param lineNumber Line number of the begin line
+     */
+    virtual bool enterSection(const SectionScope &scope, size_t lineNumber);
+
+    /**
+     * @brief Called for an "end <name>" line, and at end of input for unterminated sections
+     * @param scope Open sections, with the one being left innermost
+     * @param lineNumber Line number of the end line, or the line count at end of input
+     */
+    virtual bool exitSection(const SectionScope &scope, size_t lineNumber);
+
+    /**
+     * @brief Called for a "key = value" line
+     * @param scope Open sections, with the enclosing one innermost
+     * @param key Trimmed key
+     * @param value Trimmed value
+     * @param lineNumber Line number
+     */
+    virtual bool keyValue(const SectionScope &scope, std::string_view key, std::string_view value, size_t lineNumber);
+
+    /**
+     * @brief Called for a line starting with #
+     * @param scope Open sections, with the enclosing one innermost
+     * @param text Trimmed line, including the leading #
+     * @param lineNumber Line number
+     */
+    virtual bool comment(const SectionScope &scope, std::string_view text, size_t lineNumber);
+};
+
+/**
+ * @brief Streaming (SAX-style) parser for the configuration formats in ConfigDialect
+ *
+ * The parser keeps only the names of the open sections, so it runs in memory bounded
+ * by the nesting depth and the longest line, and only interns section paths that a
+ * visitor asks for. Lines are fed one at a time, from
+ * memory or from a file read in fixed-size blocks, and the visitor can stop the
+ * parse at any point. This is the grammar ConfigEditor indexes.
+ *
+ * @example
+ * ConfigParser::parseFile("graphics-rpi4.conf", visitor);
+ */
+class ConfigParser
+{
+private:
+    ConfigVisitor &visitor;
+    ConfigDialect dialect;
+    SectionScope openSections;
+    size_t lineNumber = 0;
+    bool stopped = false;
+
+public:
+    /**
+     * @brief Constructor
+     * @param configVisitor Visitor receiving the callbacks
+     * @param syntax Format of the input
+     */
+    explicit ConfigParser(ConfigVisitor &configVisitor, ConfigDialect syntax = ConfigDialect::BeginEnd);
+
+    /**
+     * @brief Parse the next line
+     * @param line Line content without the trailing newline
+     * @return true to continue, false if the visitor stopped the parse
+     */
+    bool feedLine(std::string_view line);
+
+    /**
+     * @brief Close sections still open at end of input
+     * @return true if the parse ran to completion, false if the visitor stopped it
+     */
+    bool finish();
+
+    /**
+     * @brief Get the sections open at the current line
+     * @return Open sections, none outside of any section
+     */
+    const SectionScope &currentSection() const { return openSections; }
+
+    /**
+     * @brief Parse in-memory contents
+     * @param contents Configuration text
+     * @param visitor Visitor receiving the callbacks
+     * @param dialect Format of the contents
+     * @return true if the parse ran to completion, false if the visitor stopped it
+     */
+    static bool parse(std::string_view contents, ConfigVisitor &visitor,
+                      ConfigDialect dialect = ConfigDialect::BeginEnd);
+
+    /**
+     * @brief Parse a file in fixed-size blocks without loading it whole
+     * @param filename Path to the configuration file
+     * @param visitor Visitor receiving the callbacks
+     * @param dialect Format of the file
+     * @return true if the parse ran to completion, false if the visitor stopped it or
+     *         the file could not be read
+     */
+    static bool parseFile(const std::string &filename, ConfigVisitor &visitor,
+                          ConfigDialect dialect = ConfigDialect::BeginEnd);
+
+    /**
+     * @brief Read a file line by line in fixed-size blocks
+     * @param filename Path to the file
+     * @param callback Called with each line (without newline); return false to stop
+     * @return true if the whole file was read, false if stopped or the file could not be read
+     *
+     * Lines are split like std::getline: no empty line after a final newline and
+     * carriage returns are kept.
+     */
+    static bool readLines(const std::string &filename, const std::function<bool(std::string_view)> &callback);
+
+    /**
+     * @brief Work out what a line is in the given format
+     * @param line Line content without the trailing newline
+     * @param dialect Format the line belongs to
+     * @return The line's kind and parts, as views into the line
+     */
+    static ConfigLine classify(std::string_view line, ConfigDialect dialect);
+
+    /**
+     * @brief Remove leading and trailing spaces and tabs
+     * @param text Input text
+     * @return View of the trimmed text
+     */
+    static std::string_view trim(std::string_view text);
+};
+
+#endif // CONFIG_PARSER_HPP
@@ -0,0 +1,283 @@
+#ifndef CONFIG_SCHEMA_HPP
+#define CONFIG_SCHEMA_HPP
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Compile-time schema of the known graphics-rpi4.conf keys
+ *
+ * Each known key has a value type, an allowed range and a canonical text form.
+ * Typed key tags (e.g. ConfigSchema::DisplayVideoMode) resolve to their table entry
+ * at compile time and are used with ConfigEditor::get<Key>() / set<Key>(), which
+ * validate and format values without building temporary strings. Keys that are not
+ * in the schema are still read and written as plain strings.
+ *
+ * @example
+ * editor.set<ConfigSchema::DisplayVideoMode>(display, {1920, 1080, 60});
+ * std::optional<bool> composition = editor.get<ConfigSchema::DisplayForceComposition>(display);
+ */
+namespace ConfigSchema
+{
+    /**
+     * @brief Kind of section a key lives in
+     */
+    enum class SectionKind
+    {
+        Globals, // winmgr/globals
+        Display  // winmgr/display N
+    };
+
+    /**
+     * @brief Value type of a key, which decides its canonical text form
+     */
+    enum class ValueType
+    {
+        Integer,   // Decimal integer within [minimum, maximum]
+        Boolean,   // "true" / "false"
+        OnOff,     // "on" / "off"
+        VideoMode, // "<width> x <height> @ <refresh>", width and height within [minimum, maximum]
+        Name       // Single word without whitespace, '=' or '#'
+    };
+
+    /**
+     * @brief Display mode as written to the video-mode key
+     */
+    struct VideoMode
+    {
+        int width = 0;
+        int height = 0;
+        int refreshRate = 0;
+
+        bool operator==(const VideoMode &other) const
+        {
+            return width == other.width && height == other.height && refreshRate == other.refreshRate;
+        }
+        bool operator!=(const VideoMode &other) const { return !(*this == other); }
+    };
+
+    /**
+     * @brief Schema entry of a known key
+     */
+    struct KeyInfo
+    {
+        SectionKind section;
+        std::string_view name;
+        ValueType type;
+        long long minimum;
+        long long maximum;
+    };
+
+    // Highest refresh rate accepted in a video mode, in Hz
+    inline constexpr int MAX_REFRESH_RATE = 480;
+
+    inline constexpr KeyInfo KEYS[] = {
+        {SectionKind::Globals, "keymap", ValueType::Name, 0, 0},
+        {SectionKind::Display, "video-mode", ValueType::VideoMode, 1, 8192},
+        {SectionKind::Display, "stack-size", ValueType::Integer, 4096, 16 * 1024 * 1024},
+        {SectionKind::Display, "force-composition", ValueType::Boolean, 0, 1},
+        {SectionKind::Display, "cursor", ValueType::OnOff, 0, 1},
+    };
+    inline constexpr size_t KEY_COUNT = sizeof(KEYS) / sizeof(KEYS[0]);
+    inline constexpr size_t UNKNOWN_KEY = SIZE_MAX;
+
+    /**
+     * @brief Find the schema entry of a key
+     * @param section Kind of section the key lives in
+     * @param name Key name
+     * @return Index into KEYS, or UNKNOWN_KEY if the key is not in the schema
+     */
+    constexpr size_t findKey(SectionKind section, std::string_view name)
+    {
+        for (size_t i = 0; i < KEY_COUNT; ++i)
+        {
+            if (KEYS[i].section == section && KEYS[i].name == name)
+                return i;
+        }
+        return UNKNOWN_KEY;
+    }
+
+    /**
+     * @brief Typed key tag, bound to its schema entry at compile time
+     * @tparam Id Index into KEYS
+     * @tparam Value C++ type of the value
+     */
+    template <size_t Id, typename Value>
+    struct Key
+    {
+        static_assert(Id != UNKNOWN_KEY, "key is not in the configuration schema");
+        static constexpr size_t id = Id;
+        static constexpr const KeyInfo &info = KEYS[Id];
+        using value_type = Value;
+    };
+
+    using GlobalsKeymap = Key<findKey(SectionKind::Globals, "keymap"), std::string>;
+    using DisplayVideoMode = Key<findKey(SectionKind::Display, "video-mode"), VideoMode>;
+    using DisplayStackSize = Key<findKey(SectionKind::Display, "stack-size"), int>;
+    using DisplayForceComposition = Key<findKey(SectionKind::Display, "force-composition"), bool>;
+    using DisplayCursor = Key<findKey(SectionKind::Display, "cursor"), bool>;
+
+    /**
+     * @brief Stack buffer holding a formatted value
+     */
+    struct FormattedValue
+    {
+        char data[64];
+        size_t size = 0;
+
+        std::string_view view() const { return std::string_view(data, size); }
+    };
+
+    namespace internal
+    {
+        inline bool append(FormattedValue &out, std::string_view text)
+        {
+            if (out.size + text.size() > sizeof(out.data))
+                return false;
+            text.copy(out.data + out.size, text.size());
+            out.size += text.size();
+            return true;
+        }
+
+        inline bool appendInteger(FormattedValue &out, long long value)
+        {
+            auto result = std::to_chars(out.data + out.size, out.data + sizeof(out.data), value);
+            if (result.ec != std::errc())
+                return false;
+            out.size = static_cast<size_t>(result.ptr - out.data);
+            return true;
+        }
+
+        // Parse an integer at the front of text, skipping leading spaces, and advance text past it
+        inline bool consumeInteger(std::string_view &text, long long &value)
+        {
+            size_t start = text.find_first_not_of(' ');
+            if (start == std::string_view::npos)
+                return false;
+            auto result = std::from_chars(text.data() + start, text.data() + text.size(), value);
+            if (result.ec != std::errc())
+                return false;
+            text.remove_prefix(static_cast<size_t>(result.ptr - text.data()));
+            return true;
+        }
+
+        // Skip spaces and expect a separator character
+        inline bool consumeSeparator(std::string_view &text, char separator)
+        {
+            size_t start = text.find_first_not_of(' ');
+            if (start == std::string_view::npos || text[start] != separator)
+                return false;
+            text.remove_prefix(start + 1);
+            return true;
+        }
+
+        inline bool inRange(const KeyInfo &info, long long value)
+        {
+            return value >= info.minimum && value <= info.maximum;
+        }
+    }
+
+    /**
+     * @brief Validate a typed value and write its canonical text form
+     * @tparam K Key tag
+     * @param value Value to format
+     * @param out Buffer receiving the text
+     * @return true if the value is valid for the key, false otherwise
+     */
+    template <typename K>
+    bool format(const typename K::value_type &value, FormattedValue &out)
+    {
+        constexpr const KeyInfo &info = K::info;
+        out.size = 0;
+        if constexpr (info.type == ValueType::Integer)
+        {
+            return internal::inRange(info, value) && internal::appendInteger(out, value);
+        }
+        else if constexpr (info.type == ValueType::Boolean)
+        {
+            return internal::append(out, value ? "true" : "false");
+        }
+        else if constexpr (info.type == ValueType::OnOff)
+        {
+            return internal::append(out, value ? "on" : "off");
+        }
+        else if constexpr (info.type == ValueType::VideoMode)
+        {
+            return internal::inRange(info, value.width) && internal::inRange(info, value.height) &&
+                   value.refreshRate >= 1 && value.refreshRate <= MAX_REFRESH_RATE &&
+                   internal::appendInteger(out, value.width) && internal::append(out, " x ") &&
+                   internal::appendInteger(out, value.height) && internal::append(out, " @ ") &&
+                   internal::appendInteger(out, value.refreshRate);
+        }
+        else
+        {
+            std::string_view name = value;
+            return !name.empty() && name.find_first_of(" \t=#") == std::string_view::npos &&
+                   internal::append(out, name);
+        }
+    }
+
+    /**
+     * @brief Parse the text form of a value
+     * @tparam K Key tag
+     * @param text Value text as found in the configuration
+     * @return Typed value, or std::nullopt if the text is not a valid value for the key
+     */
+    template <typename K>
+    std::optional<typename K::value_type> parse(std::string_view text)
+    {
+        constexpr const KeyInfo &info = K::info;
+        if constexpr (info.type == ValueType::Integer)
+        {
+            long long value = 0;
+            if (!internal::consumeInteger(text, value) || !text.empty() || !internal::inRange(info, value))
+                return std::nullopt;
+            return static_cast<typename K::value_type>(value);
+        }
+        else if constexpr (info.type == ValueType::Boolean)
+        {
+            if (text == "true")
+                return true;
+            if (text == "false")
+                return false;
+            return std::nullopt;
+        }
+        else if constexpr (info.type == ValueType::OnOff)
+        {
+            if (text == "on")
+                return true;
+            if (text == "off")
+                return false;
+            return std::nullopt;
+        }
+        else if constexpr (info.type == ValueType::VideoMode)
+        {
+            long long width = 0, height = 0, refreshRate = 0;
+            if (!internal::consumeInteger(text, width) || !internal::consumeSeparator(text, 'x') ||
+                !internal::consumeInteger(text, height) || !internal::consumeSeparator(text, '@') ||
+                !internal::consumeInteger(text, refreshRate) || text.find_first_not_of(' ') != std::string_view::npos)
+            {
+                return std::nullopt;
+            }
+            // Check the full values, so ones that do not fit in an int cannot wrap into range
+            if (!internal::inRange(info, width) || !internal::inRange(info, height) || refreshRate < 1 ||
+                refreshRate > MAX_REFRESH_RATE)
+            {
+                return std::nullopt;
+            }
+            return VideoMode{static_cast<int>(width), static_cast<int>(height), static_cast<int>(refreshRate)};
+        }
+        else
+        {
+            if (text.empty() || text.find_first_of(" \t=#") != std::string_view::npos)
+                return std::nullopt;
+            return typename K::value_type(text);
+        }
+    }
+}
+
+#endif // CONFIG_SCHEMA_HPP
@@ -0,0 +1,311 @@
+#include "display-modes.hpp"
+#include "atomic-file.hpp"
+#include "file-buffer.hpp"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <sstream>
+#include <tuple>
+
+namespace
+{
+    const size_t BLOCK_SIZE = 128;
+    const uint8_t CTA_EXTENSION_TAG = 0x02;
+    const uint8_t CTA_VIDEO_DATA_BLOCK = 2;
+
+    std::string &edidPath()
+    {
+        static std::string path = "/sys/class/drm/card0-HDMI-A-1/edid";
+        return path;
+    }
+
+    std::string &cachePath()
+    {
+        static std::string path = "/data/home/root/.config/qnx-raspi-setup-modes";
+        return path;
+    }
+
+    /**
+     * @brief A timing from a fixed table, enabled by one bit or code
+     */
+    struct KnownTiming
+    {
+        uint16_t width;
+        uint16_t height;
+        uint8_t refreshRate;
+    };
+
+    // Established timings I and II (bytes 35 and 36, most significant bit first)
+    // and the manufacturer timing in bit 7 of byte 37; interlaced ones are zero
+    const KnownTiming ESTABLISHED_TIMINGS[17] = {
+        {720, 400, 70}, {720, 400, 88}, {640, 480, 60}, {640, 480, 67},
+        {640, 480, 72}, {640, 480, 75}, {800, 600, 56}, {800, 600, 60},
+        {800, 600, 72}, {800, 600, 75}, {832, 624, 75}, {0, 0, 0},
+        {1024, 768, 60}, {1024, 768, 70}, {1024, 768, 75}, {1280, 1024, 75},
+        {1152, 870, 75}};
+
+    /**
+     * @brief A CTA-861 video identification code and its progressive timing
+     */
+    struct VicTiming
+    {
+        uint8_t vic;
+        KnownTiming timing;
+    };
+
+    // The progressive CTA-861 formats a Raspberry Pi can drive, sorted by code
+    const VicTiming VIC_TIMINGS[] = {
+        {1, {640, 480, 60}}, {2, {720, 480, 60}}, {3, {720, 480, 60}}, {4, {1280, 720, 60}},
+        {16, {1920, 1080, 60}}, {17, {720, 576, 50}}, {18, {720, 576, 50}}, {19, {1280, 720, 50}},
+        {31, {1920, 1080, 50}}, {32, {1920, 1080, 24}}, {33, {1920, 1080, 25}}, {34, {1920, 1080, 30}},
+        {60, {1280, 720, 24}}, {61, {1280, 720, 25}}, {62, {1280, 720, 30}}, {63, {1920, 1080, 120}},
+        {64, {1920, 1080, 100}}, {93, {3840, 2160, 24}}, {94, {3840, 2160, 25}}, {95, {3840, 2160, 30}},
+        {96, {3840, 2160, 50}}, {97, {3840, 2160, 60}}, {98, {4096, 2160, 24}}, {99, {4096, 2160, 25}},
+        {100, {4096, 2160, 30}}, {101, {4096, 2160, 50}}, {102, {4096, 2160, 60}}};
+
+    uint8_t byteAt(std::string_view data, size_t offset)
+    {
+        return static_cast<uint8_t>(data[offset]);
+    }
+
+    bool checksumValid(std::string_view block)
+    {
+        uint8_t sum = 0;
+        for (char byte : block)
+            sum = static_cast<uint8_t>(sum + static_cast<uint8_t>(byte));
+        return sum == 0;
+    }
+
+    void addMode(std::vector<DisplayModes::Mode> &modes, int width, int height, int refreshRate, bool preferred = false)
+    {
+        if (width <= 0 || height <= 0 || refreshRate <= 0)
+            return;
+        DisplayModes::Mode mode;
+        mode.videoMode = {width, height, refreshRate};
+        mode.preferred = preferred;
+        modes.push_back(mode);
+    }
+
+    /**
+     * @brief Add the mode of an 18-byte detailed timing descriptor
+     * @return false if the descriptor holds something other than a timing
+     */
+    bool addDetailedTiming(std::vector<DisplayModes::Mode> &modes, std::string_view descriptor, bool preferred)
+    {
+        uint32_t pixelClock = (byteAt(descriptor, 0) | byteAt(descriptor, 1) << 8) * 10000u;
+        if (pixelClock == 0)
+            return false; // Display descriptor: monitor name, range limits and the like
+        if (byteAt(descriptor, 17) & 0x80)
+            return true; // Interlaced
+
+        int width = byteAt(descriptor, 2) | (byteAt(descriptor, 4) & 0xF0) << 4;
+        int horizontalBlank = byteAt(descriptor, 3) | (byteAt(descriptor, 4) & 0x0F) << 8;
+        int height = byteAt(descriptor, 5) | (byteAt(descriptor, 7) & 0xF0) << 4;
+        int verticalBlank = byteAt(descriptor, 6) | (byteAt(descriptor, 7) & 0x0F) << 8;
+        uint32_t total = static_cast<uint32_t>(width + horizontalBlank) * static_cast<uint32_t>(height + verticalBlank);
+        if (total == 0)
+            return true;
+        addMode(modes, width, height, static_cast<int>((pixelClock + total / 2) / total), preferred);
+        return true;
+    }
+
+    void addStandardTiming(std::vector<DisplayModes::Mode> &modes, uint8_t first, uint8_t second)
+    {
+        if ((first == 0x01 && second == 0x01) || first == 0x00)
+            return; // Unused slot
+        int width = (first + 31) * 8;
+        int height = 0;
+        switch (second >> 6)
+        {
+        case 0:
+            height = width * 10 / 16;
+            break;
+        case 1:
+            height = width * 3 / 4;
+            break;
+        case 2:
+            height = width * 4 / 5;
+            break;
+        default:
+            height = width * 9 / 16;
+            break;
+        }
+        addMode(modes, width, height, (second & 0x3F) + 60);
+    }
+
+    void addVideoIdentificationCode(std::vector<DisplayModes::Mode> &modes, uint8_t code)
+    {
+        // Codes 129-192 are codes 1-64 with the native flag set
+        bool native = code >= 129 && code <= 192;
+        uint8_t vic = native ? code & 0x7F : code;
+        auto it = std::lower_bound(std::begin(VIC_TIMINGS), std::end(VIC_TIMINGS), vic,
+                                   [](const VicTiming &entry, uint8_t value)
+                                   { return entry.vic < value; });
+        if (it != std::end(VIC_TIMINGS) && it->vic == vic)
+            addMode(modes, it->timing.width, it->timing.height, it->timing.refreshRate, native);
+    }
+
+    void parseCtaExtension(std::vector<DisplayModes::Mode> &modes, std::string_view block)
+    {
+        size_t detailedStart = byteAt(block, 2);
+        if (detailedStart < 4 || detailedStart > BLOCK_SIZE - 1)
+            detailedStart = BLOCK_SIZE - 1; // No detailed timings
+
+        // Data block collection: a header byte with the tag in bits 5-7 and the
+        // payload length in bits 0-4, then the payload
+        for (size_t offset = 4; offset < detailedStart;)
+        {
+            uint8_t header = byteAt(block, offset);
+            size_t length = header & 0x1F;
+            if (offset + 1 + length > detailedStart)
+                break;
+            if (header >> 5 == CTA_VIDEO_DATA_BLOCK)
+            {
+                for (size_t i = 0; i < length; ++i)
+                    addVideoIdentificationCode(modes, byteAt(block, offset + 1 + i));
+            }
+            offset += 1 + length;
+        }
+
+        for (size_t offset = detailedStart; offset + 18 <= BLOCK_SIZE - 1; offset += 18)
+        {
+            if (!addDetailedTiming(modes, block.substr(offset, 18), false))
+                break; // Padding follows the last descriptor
+        }
+    }
+
+    void sortModes(std::vector<DisplayModes::Mode> &modes)
+    {
+        auto key = [](const DisplayModes::Mode &mode)
+        {
+            const ConfigSchema::VideoMode &video = mode.videoMode;
+            return std::make_tuple(!mode.preferred, -static_cast<long>(video.width) * video.height,
+                                   -video.width, -video.refreshRate);
+        };
+        std::sort(modes.begin(), modes.end(), [&](const DisplayModes::Mode &a, const DisplayModes::Mode &b)
+                  { return key(a) < key(b); });
+        // The preferred entry of a mode sorts first, so dropping later entries keeps it
+        std::vector<DisplayModes::Mode> unique;
+        for (const DisplayModes::Mode &mode : modes)
+        {
+            bool seen = std::any_of(unique.begin(), unique.end(), [&](const DisplayModes::Mode &other)
+                                    { return other.videoMode == mode.videoMode; });
+            if (!seen)
+                unique.push_back(mode);
+        }
+        modes = std::move(unique);
+    }
+
+    std::string formatCache(uint64_t hash, const std::vector<DisplayModes::Mode> &modes)
+    {
+        char header[32];
+        snprintf(header, sizeof(header), "edid %016" PRIx64 "\n", hash);
+        std::string text = header;
+        for (const DisplayModes::Mode &mode : modes)
+        {
+            text += std::to_string(mode.videoMode.width) + ' ' + std::to_string(mode.videoMode.height) + ' ' +
+                    std::to_string(mode.videoMode.refreshRate) + ' ' + (mode.preferred ? '1' : '0') + '\n';
+        }
+        return text;
+    }
+
+    /**
+     * @brief Read the cached modes if the cache was written for this EDID hash
+     */
+    bool readCache(uint64_t hash, std::vector<DisplayModes::Mode> &modes)
+    {
+        std::shared_ptr<const FileBuffer> buffer = FileBuffer::read(cachePath());
+        if (!buffer)
+            return false;
+        std::istringstream in{std::string(buffer->view())};
+        std::string tag;
+        uint64_t cachedHash = 0;
+        if (!(in >> tag >> std::hex >> cachedHash >> std::dec) || tag != "edid" || cachedHash != hash)
+            return false;
+
+        modes.clear();
+        DisplayModes::Mode mode;
+        int preferred = 0;
+        while (in >> mode.videoMode.width >> mode.videoMode.height >> mode.videoMode.refreshRate >> preferred)
+        {
+            mode.preferred = preferred != 0;
+            modes.push_back(mode);
+        }
+        return in.eof();
+    }
+}
+
+bool DisplayModes::parseEdid(std::string_view blob, std::vector<Mode> &modes)
+{
+    static const char HEADER[8] = {'\x00', '\xFF', '\xFF', '\xFF', '\xFF', '\xFF', '\xFF', '\x00'};
+    modes.clear();
+    if (blob.size() < BLOCK_SIZE || blob.substr(0, 8) != std::string_view(HEADER, 8) ||
+        !checksumValid(blob.substr(0, BLOCK_SIZE)))
+    {
+        return false;
+    }
+
+    // Detailed timings come first; the first one is the preferred mode
+    for (size_t i = 0; i < 4; ++i)
+        addDetailedTiming(modes, blob.substr(54 + i * 18, 18), i == 0);
+    for (size_t bit = 0; bit < 17; ++bit)
+    {
+        if (byteAt(blob, 35 + bit / 8) & (0x80 >> (bit % 8)))
+        {
+            const KnownTiming &timing = ESTABLISHED_TIMINGS[bit];
+            addMode(modes, timing.width, timing.height, timing.refreshRate);
+        }
+    }
+    for (size_t i = 0; i < 8; ++i)
+        addStandardTiming(modes, byteAt(blob, 38 + i * 2), byteAt(blob, 39 + i * 2));
+
+    size_t extensions = byteAt(blob, 126);
+    for (size_t i = 1; i <= extensions && (i + 1) * BLOCK_SIZE <= blob.size(); ++i)
+    {
+        std::string_view block = blob.substr(i * BLOCK_SIZE, BLOCK_SIZE);
+        if (byteAt(block, 0) == CTA_EXTENSION_TAG && checksumValid(block))
+            parseCtaExtension(modes, block);
+    }
+
+    sortModes(modes);
+    return true;
+}
+
+std::vector<DisplayModes::Mode> DisplayModes::getSupportedModes()
+{
+    std::vector<Mode> modes;
+    std::shared_ptr<const FileBuffer> edid = FileBuffer::read(edidPath());
+    if (!edid)
+        return modes;
+
+    uint64_t hash = FileBuffer::hash(edid->view());
+    if (readCache(hash, modes))
+        return modes;
+    if (!parseEdid(edid->view(), modes))
+        return modes;
+    // A missing cache only costs a parse next time, so it is not flushed to disk
+    AtomicFile::replace(cachePath(), formatCache(hash, modes), false);
+    return modes;
+}
+
+void DisplayModes::setEdidPath(const std::string &path)
+{
+    edidPath() = path;
+}
+
+const std::string &DisplayModes::getEdidPath()
+{
+    return edidPath();
+}
+
+void DisplayModes::setCachePath(const std::string &path)
+{
+    cachePath() = path;
+}
+
+const std::string &DisplayModes::getCachePath()
+{
+    return cachePath();
+}
@@ -0,0 +1,84 @@
+#ifndef DISPLAY_MODES_HPP
+#define DISPLAY_MODES_HPP
+
+#include "config-schema.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Display modes supported by the connected monitor, read from its EDID
+ *
+ * The EDID base block lists established, standard and detailed timings; CTA-861
+ * extension blocks add detailed timings and short video descriptors (VICs) for
+ * TV modes such as 4K. Interlaced modes are skipped, as the display server only
+ * drives progressive ones.
+ *
+ * The parsed table is cached in a small file keyed by the hash of the EDID, so
+ * later runs only read the EDID and the cache instead of parsing again.
+ */
+namespace DisplayModes
+{
+    /**
+     * @brief A supported display mode
+     */
+    struct Mode
+    {
+        ConfigSchema::VideoMode videoMode;
+        bool preferred = false; // The monitor's native mode
+
+        bool operator==(const Mode &other) const
+        {
+            return videoMode == other.videoMode && preferred == other.preferred;
+        }
+        bool operator!=(const Mode &other) const { return !(*this == other); }
+    };
+
+    /**
+     * @brief Parse an EDID blob into a table of modes
+     *
+     * @param blob Raw EDID: a 128-byte base block followed by its extension blocks
+     * @param modes Receives the modes, preferred first, then largest and fastest first,
+     *        without duplicates
+     * @return true if the base block is valid; invalid extension blocks are skipped
+     */
+    bool parseEdid(std::string_view blob, std::vector<Mode> &modes);
+
+    /**
+     * @brief Get the modes of the connected monitor
+     *
+     * Reads the EDID from getEdidPath() and looks its hash up in the cache file at
+     * getCachePath(). On a miss the EDID is parsed and the cache is rewritten.
+     *
+     * @return The supported modes, sorted as by parseEdid(); empty if the EDID
+     *         cannot be read or is invalid
+     */
+    std::vector<Mode> getSupportedModes();
+
+    /**
+     * @brief Sets the file holding the raw EDID of the connected monitor
+     * @param path Path of the EDID blob
+     */
+    void setEdidPath(const std::string &path);
+
+    /**
+     * @brief Gets the file holding the raw EDID of the connected monitor
+     * @return Path of the EDID blob
+     */
+    const std::string &getEdidPath();
+
+    /**
+     * @brief Sets the file the parsed modes are cached in
+     * @param path Path of the cache file; its directory must exist
+     */
+    void setCachePath(const std::string &path);
+
+    /**
+     * @brief Gets the file the parsed modes are cached in
+     * @return Path of the cache file
+     */
+    const std::string &getCachePath();
+
+} // namespace DisplayModes
+
+#endif // DISPLAY_MODES_HPP
@@ -0,0 +1,570 @@
+#include "fat32-image.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    const size_t SECTOR_SIZE = 512; // Unit of the MBR and of partition offsets
+    const size_t ENTRY_SIZE = 32;   // One directory entry
+    const uint8_t ATTR_VOLUME_ID = 0x08;
+    const uint8_t ATTR_DIRECTORY = 0x10;
+    const uint8_t ATTR_LONG_NAME = 0x0F;
+    const uint8_t DELETED_ENTRY = 0xE5;
+    const uint32_t CLUSTER_MASK = 0x0FFFFFFF; // The top four bits of a FAT entry are reserved
+    const uint32_t FIRST_END_OF_CHAIN = 0x0FFFFFF8;
+    const uint32_t UNKNOWN_FREE_COUNT = 0xFFFFFFFF;
+
+    uint16_t le16(const unsigned char *bytes)
+    {
+        return static_cast<uint16_t>(bytes[0] | bytes[1] << 8);
+    }
+
+    uint32_t le32(const unsigned char *bytes)
+    {
+        return static_cast<uint32_t>(bytes[0]) | static_cast<uint32_t>(bytes[1]) << 8 |
+               static_cast<uint32_t>(bytes[2]) << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+    }
+
+    void putLe16(unsigned char *bytes, uint16_t value)
+    {
+        bytes[0] = static_cast<unsigned char>(value);
+        bytes[1] = static_cast<unsigned char>(value >> 8);
+    }
+
+    void putLe32(unsigned char *bytes, uint32_t value)
+    {
+        putLe16(bytes, static_cast<uint16_t>(value));
+        putLe16(bytes + 2, static_cast<uint16_t>(value >> 16));
+    }
+
+    bool readAt(int fd, uint64_t offset, void *data, size_t size)
+    {
+        char *bytes = static_cast<char *>(data);
+        while (size > 0)
+        {
+            ssize_t count = pread(fd, bytes, size, static_cast<off_t>(offset));
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false; // Error, or the image ends early
+            bytes += count;
+            offset += static_cast<uint64_t>(count);
+            size -= static_cast<size_t>(count);
+        }
+        return true;
+    }
+
+    bool writeAt(int fd, uint64_t offset, const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            ssize_t count = pwrite(fd, bytes, size, static_cast<off_t>(offset));
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+            bytes += count;
+            offset += static_cast<uint64_t>(count);
+            size -= static_cast<size_t>(count);
+        }
+        return true;
+    }
+
+    bool isFat32BootSector(const unsigned char *sector)
+    {
+        uint16_t bytesPerSector = le16(sector + 11);
+        uint8_t sectorsPerCluster = sector[13];
+        // FAT12 and FAT16 have a fixed root directory and a 16-bit FAT size
+        return le16(sector + 510) == 0xAA55 &&
+               (bytesPerSector == 512 || bytesPerSector == 1024 || bytesPerSector == 2048 || bytesPerSector == 4096) &&
+               sectorsPerCluster != 0 && (sectorsPerCluster & (sectorsPerCluster - 1)) == 0 &&
+               le16(sector + 14) != 0 && sector[16] != 0 && le16(sector + 17) == 0 && le16(sector + 22) == 0 &&
+               le32(sector + 36) != 0;
+    }
+
+    bool sameName(std::string_view a, std::string_view b)
+    {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y)
+                                                  { return (x >= 'a' && x <= 'z' ? x - 'a' + 'A' : x) ==
+                                                           (y >= 'a' && y <= 'z' ? y - 'a' + 'A' : y); });
+    }
+
+    /**
+     * @brief Get the 8.3 name of a directory entry as NAME.EXT
+     */
+    std::string shortName(const unsigned char *entry)
+    {
+        std::string name(reinterpret_cast<const char *>(entry), 8);
+        if (entry[0] == 0x05)
+            name[0] = static_cast<char>(DELETED_ENTRY); // A real 0xE5 first byte is stored as 0x05
+        name.erase(name.find_last_not_of(' ') + 1);
+        std::string extension(reinterpret_cast<const char *>(entry + 8), 3);
+        extension.erase(extension.find_last_not_of(' ') + 1);
+        return extension.empty() ? name : name + '.' + extension;
+    }
+
+    uint8_t shortNameChecksum(const unsigned char *entry)
+    {
+        uint8_t sum = 0;
+        for (size_t i = 0; i < 11; ++i)
+            sum = static_cast<uint8_t>(((sum & 1) << 7) + (sum >> 1) + entry[i]);
+        return sum;
+    }
+
+    /**
+     * @brief A long file name, gathered from the entries stored before its short entry
+     *
+     * The pieces come last piece first, 13 UCS-2 characters each, and carry the
+     * checksum of the short entry they belong to.
+     */
+    class LongName
+    {
+    private:
+        std::vector<uint16_t> characters;
+        uint8_t checksum = 0;
+        bool valid = false;
+
+    public:
+        void reset() { valid = false; }
+
+        void add(const unsigned char *entry)
+        {
+            static const size_t OFFSETS[13] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+            size_t index = entry[0] & 0x1F;
+            if (entry[0] & 0x40)
+            {
+                valid = index != 0;
+                checksum = entry[13];
+                characters.assign(index * 13, 0xFFFF);
+            }
+            if (!valid || index == 0 || index * 13 > characters.size() || entry[13] != checksum)
+            {
+                valid = false;
+                return;
+            }
+            for (size_t i = 0; i < 13; ++i)
+                characters[(index - 1) * 13 + i] = le16(entry + OFFSETS[i]);
+        }
+
+        /**
+         * @brief Get the name as UTF-8 if it belongs to a short entry
+         * @return The name, empty if there is none or it belongs to another entry
+         */
+        std::string nameOf(const unsigned char *entry) const
+        {
+            std::string name;
+            if (!valid || shortNameChecksum(entry) != checksum)
+                return name;
+            for (uint16_t character : characters)
+            {
+                if (character == 0x0000 || character == 0xFFFF)
+                    break; // Terminator, then padding
+                if (character < 0x80)
+                {
+                    name += static_cast<char>(character);
+                }
+                else if (character < 0x800)
+                {
+                    name += static_cast<char>(0xC0 | character >> 6);
+                    name += static_cast<char>(0x80 | (character & 0x3F));
+                }
+                else
+                {
+                    name += static_cast<char>(0xE0 | character >> 12);
+                    name += static_cast<char>(0x80 | (character >> 6 & 0x3F));
+                    name += static_cast<char>(0x80 | (character & 0x3F));
+                }
+            }
+            return name;
+        }
+    };
+
+    /**
+     * @brief Set the modification and access dates of a directory entry to now
+     */
+    void stampModified(unsigned char *entry)
+    {
+        time_t now = time(nullptr);
+        struct tm local;
+        if (localtime_r(&now, &local) == nullptr || local.tm_year < 80)
+            return; // FAT dates start in 1980
+        uint16_t date = static_cast<uint16_t>((local.tm_year - 80) << 9 | (local.tm_mon + 1) << 5 | local.tm_mday);
+        uint16_t clock = static_cast<uint16_t>(local.tm_hour << 11 | local.tm_min << 5 | local.tm_sec / 2);
+        putLe16(entry + 18, date);
+        putLe16(entry + 22, clock);
+        putLe16(entry + 24, date);
+    }
+}
+
+std::shared_ptr<Fat32Image> Fat32Image::open(const std::string &imagePath)
+{
+    std::shared_ptr<Fat32Image> image(new Fat32Image());
+    image->imagePath = imagePath;
+    image->fd = ::open(imagePath.c_str(), O_RDWR | O_CLOEXEC);
+    if (image->fd < 0)
+        return nullptr;
+    if (image->mount(0))
+        return image; // A bare volume, e.g. a copy of just the boot partition
+
+    // A whole card: use the first FAT32 partition of the MBR
+    unsigned char mbr[SECTOR_SIZE];
+    if (!readAt(image->fd, 0, mbr, SECTOR_SIZE) || le16(mbr + 510) != 0xAA55)
+        return nullptr;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        const unsigned char *partition = mbr + 446 + i * 16;
+        bool fat32 = partition[4] == 0x0B || partition[4] == 0x0C; // CHS and LBA addressed
+        if (fat32 && image->mount(static_cast<uint64_t>(le32(partition + 8)) * SECTOR_SIZE))
+            return image;
+    }
+    return nullptr;
+}
+
+Fat32Image::~Fat32Image()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+bool Fat32Image::mount(uint64_t volumeOffset)
+{
+    fsInfoOffset = 0;
+    nextFree = 2;
+    unsigned char sector[SECTOR_SIZE];
+    if (!readAt(fd, volumeOffset, sector, SECTOR_SIZE) || !isFat32BootSector(sector))
+        return false;
+
+    uint64_t bytesPerSector = le16(sector + 11);
+    uint64_t reservedSectors = le16(sector + 14);
+    uint64_t totalSectors = le16(sector + 19) != 0 ? le16(sector + 19) : le32(sector + 32);
+    uint64_t sectorsPerFat = le32(sector + 36);
+    uint64_t dataSector = reservedSectors + sector[16] * sectorsPerFat;
+    if (totalSectors <= dataSector)
+        return false;
+
+    clusterSize = static_cast<uint32_t>(bytesPerSector * sector[13]);
+    fatSize = sectorsPerFat * bytesPerSector;
+    fatOffset = volumeOffset + reservedSectors * bytesPerSector;
+    fatCount = sector[16];
+    uint16_t extendedFlags = le16(sector + 40);
+    if (extendedFlags & 0x80)
+    {
+        // Mirroring is off: only the active FAT is used and kept up to date
+        if ((extendedFlags & 0x0F) >= fatCount)
+            return false;
+        fatOffset += (extendedFlags & 0x0F) * fatSize;
+        fatCount = 1;
+    }
+    dataOffset = volumeOffset + dataSector * bytesPerSector;
+
+    // Sectors the FAT has no entries for cannot be used
+    uint64_t clusters = std::min((totalSectors - dataSector) / sector[13], fatSize / 4 - 2);
+    if (clusters == 0 || clusters > 0x0FFFFFF5)
+        return false;
+    clusterCount = static_cast<uint32_t>(clusters);
+    rootCluster = le32(sector + 44) & CLUSTER_MASK;
+    if (rootCluster < 2 || rootCluster >= clusterCount + 2)
+        return false;
+
+    uint16_t fsInfoSector = le16(sector + 48);
+    if (fsInfoSector != 0 && fsInfoSector < reservedSectors)
+    {
+        unsigned char info[SECTOR_SIZE];
+        uint64_t offset = volumeOffset + fsInfoSector * bytesPerSector;
+        if (readAt(fd, offset, info, SECTOR_SIZE) && le32(info) == 0x41615252 && le32(info + 484) == 0x61417272 &&
+            le32(info + 508) == 0xAA550000)
+        {
+            fsInfoOffset = offset;
+            uint32_t hint = le32(info + 492);
+            if (hint >= 2 && hint < clusterCount + 2)
+                nextFree = hint;
+        }
+    }
+
+    std::vector<unsigned char> entries((static_cast<size_t>(clusterCount) + 2) * 4);
+    if (!readAt(fd, fatOffset, entries.data(), entries.size()))
+        return false;
+    fat.resize(static_cast<size_t>(clusterCount) + 2);
+    for (size_t i = 0; i < fat.size(); ++i)
+        fat[i] = le32(&entries[i * 4]);
+    return true;
+}
+
+uint64_t Fat32Image::clusterOffset(uint32_t cluster) const
+{
+    return dataOffset + static_cast<uint64_t>(cluster - 2) * clusterSize;
+}
+
+bool Fat32Image::chain(uint32_t first, std::vector<uint32_t> &clusters) const
+{
+    clusters.clear();
+    if (first == 0)
+        return true;
+    for (uint32_t cluster = first;;)
+    {
+        // Free, reserved and bad clusters are out of range too; a chain longer
+        // than the volume loops
+        if (cluster < 2 || cluster >= clusterCount + 2 || clusters.size() == clusterCount)
+            return false;
+        clusters.push_back(cluster);
+        uint32_t next = fat[cluster] & CLUSTER_MASK;
+        if (next >= FIRST_END_OF_CHAIN)
+            return true;
+        cluster = next;
+    }
+}
+
+bool Fat32Image::findInDirectory(uint32_t directory, std::string_view name, Entry &entry) const
+{
+    std::vector<uint32_t> clusters;
+    if (!chain(directory, clusters))
+        return false;
+
+    std::vector<unsigned char> data(clusterSize);
+    LongName longName;
+    for (uint32_t cluster : clusters)
+    {
+        uint64_t offset = clusterOffset(cluster);
+        if (!readAt(fd, offset, data.data(), data.size()))
+            return false;
+        for (size_t position = 0; position < data.size(); position += ENTRY_SIZE)
+        {
+            const unsigned char *raw = &data[position];
+            if (raw[0] == 0x00)
+                return false; // No entries follow
+            if (raw[0] == DELETED_ENTRY)
+            {
+                longName.reset();
+                continue;
+            }
+            if ((raw[11] & 0x3F) == ATTR_LONG_NAME)
+            {
+                longName.add(raw);
+                continue;
+            }
+            bool named = sameName(longName.nameOf(raw), name) || sameName(shortName(raw), name);
+            longName.reset();
+            if (!named || (raw[11] & ATTR_VOLUME_ID))
+                continue;
+
+            entry.firstCluster = (static_cast<uint32_t>(le16(raw + 20)) << 16 | le16(raw + 26)) & CLUSTER_MASK;
+            entry.size = le32(raw + 28);
+            entry.offset = offset + position;
+            entry.directory = raw[11] & ATTR_DIRECTORY;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Fat32Image::lookup(std::string_view path, Entry &entry) const
+{
+    Entry current;
+    current.firstCluster = rootCluster;
+    current.directory = true;
+    while (!path.empty())
+    {
+        size_t slash = std::min(path.find('/'), path.size());
+        std::string_view name = path.substr(0, slash);
+        path.remove_prefix(std::min(slash + 1, path.size()));
+        if (name.empty())
+            continue;
+        if (!current.directory || name == "." || name == ".." || !findInDirectory(current.firstCluster, name, current))
+            return false;
+    }
+    entry = current;
+    return true;
+}
+
+bool Fat32Image::setFatEntry(uint32_t cluster, uint32_t value)
+{
+    fat[cluster] = (fat[cluster] & ~CLUSTER_MASK) | (value & CLUSTER_MASK);
+    unsigned char bytes[4];
+    putLe32(bytes, fat[cluster]);
+    for (uint32_t copy = 0; copy < fatCount; ++copy)
+    {
+        if (!writeAt(fd, fatOffset + copy * fatSize + static_cast<uint64_t>(cluster) * 4, bytes, sizeof(bytes)))
+            return false;
+    }
+    return true;
+}
+
+bool Fat32Image::findFree(size_t count, std::vector<uint32_t> &clusters) const
+{
+    clusters.clear();
+    uint32_t cluster = nextFree;
+    for (uint32_t scanned = 0; scanned < clusterCount && clusters.size() < count; ++scanned)
+    {
+        if ((fat[cluster] & CLUSTER_MASK) == 0)
+            clusters.push_back(cluster);
+        cluster = cluster + 1 < clusterCount + 2 ? cluster + 1 : 2;
+    }
+    return clusters.size() == count;
+}
+
+bool Fat32Image::updateFsInfo(int64_t change)
+{
+    if (fsInfoOffset == 0)
+        return true;
+    unsigned char fields[8];
+    if (!readAt(fd, fsInfoOffset + 488, fields, sizeof(fields)))
+        return false;
+    uint32_t freeCount = le32(fields);
+    if (freeCount != UNKNOWN_FREE_COUNT)
+        putLe32(fields, static_cast<uint32_t>(std::clamp<int64_t>(freeCount + change, 0, clusterCount)));
+    putLe32(fields + 4, nextFree);
+    return writeAt(fd, fsInfoOffset + 488, fields, sizeof(fields));
+}
+
+std::shared_ptr<const FileBuffer> Fat32Image::read(const std::string &path) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry entry;
+    std::vector<uint32_t> clusters;
+    if (!lookup(path, entry) || entry.directory || !chain(entry.firstCluster, clusters) ||
+        static_cast<uint64_t>(clusters.size()) * clusterSize < entry.size)
+    {
+        return nullptr;
+    }
+
+    // One read per run of consecutive clusters, which is usually the whole file
+    std::string contents(entry.size, '\0');
+    size_t done = 0;
+    for (size_t i = 0; done < contents.size();)
+    {
+        size_t run = 1;
+        while (i + run < clusters.size() && clusters[i + run] == clusters[i] + run)
+            ++run;
+        size_t length = static_cast<size_t>(std::min<uint64_t>(static_cast<uint64_t>(run) * clusterSize,
+                                                               contents.size() - done));
+        if (!readAt(fd, clusterOffset(clusters[i]), &contents[done], length))
+            return nullptr;
+        done += length;
+        i += run;
+    }
+    return FileBuffer::copyOf(contents);
+}
+
+bool Fat32Image::write(const std::string &path, const std::vector<std::string_view> &segments)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry entry;
+    std::vector<uint32_t> clusters;
+    if (!lookup(path, entry) || entry.directory || !chain(entry.firstCluster, clusters))
+        return false;
+
+    uint64_t size = 0;
+    for (std::string_view segment : segments)
+        size += segment.size();
+    if (size > UINT32_MAX)
+        return false;
+
+    // Keep the clusters the file still needs and add or drop them at the end
+    size_t needed = static_cast<size_t>((size + clusterSize - 1) / clusterSize);
+    size_t kept = std::min(needed, clusters.size());
+    std::vector<uint32_t> added;
+    if (needed > clusters.size() && !findFree(needed - clusters.size(), added))
+        return false; // Volume full; nothing was written
+    std::vector<uint32_t> freed(clusters.begin() + static_cast<std::ptrdiff_t>(kept), clusters.end());
+    clusters.resize(kept);
+    clusters.insert(clusters.end(), added.begin(), added.end());
+
+    // Write the data, skipping the clusters that already hold it
+    size_t written = clustersWritten;
+    std::string block(clusterSize, '\0');
+    std::string current(clusterSize, '\0');
+    size_t segment = 0;
+    size_t segmentOffset = 0;
+    uint64_t remaining = size;
+    for (size_t i = 0; i < clusters.size(); ++i)
+    {
+        size_t length = static_cast<size_t>(std::min<uint64_t>(clusterSize, remaining));
+        remaining -= length;
+        for (size_t filled = 0; filled < length;)
+        {
+            size_t count = std::min(segments[segment].size() - segmentOffset, length - filled);
+            std::memcpy(&block[filled], segments[segment].data() + segmentOffset, count);
+            filled += count;
+            segmentOffset += count;
+            if (segmentOffset == segments[segment].size())
+            {
+                ++segment;
+                segmentOffset = 0;
+            }
+        }
+
+        uint64_t offset = clusterOffset(clusters[i]);
+        if (i < kept)
+        {
+            if (!readAt(fd, offset, &current[0], length))
+                return false;
+            if (std::memcmp(current.data(), block.data(), length) == 0)
+                continue;
+        }
+        if (!writeAt(fd, offset, block.data(), length))
+            return false;
+        ++clustersWritten;
+    }
+    if (clustersWritten == written && added.empty() && freed.empty() && size == entry.size)
+        return true; // The file already held the contents
+
+    // Link the new clusters last to first, so the file never reaches an unfinished chain
+    for (size_t i = added.size(); i-- > 0;)
+    {
+        if (!setFatEntry(added[i], i + 1 < added.size() ? added[i + 1] : END_OF_CHAIN))
+            return false;
+    }
+    if (!added.empty() && kept > 0 && !setFatEntry(clusters[kept - 1], added.front()))
+        return false;
+
+    unsigned char raw[ENTRY_SIZE];
+    if (!readAt(fd, entry.offset, raw, sizeof(raw)))
+        return false;
+    uint32_t first = clusters.empty() ? 0 : clusters.front();
+    putLe16(raw + 20, static_cast<uint16_t>(first >> 16));
+    putLe16(raw + 26, static_cast<uint16_t>(first));
+    putLe32(raw + 28, static_cast<uint32_t>(size));
+    stampModified(raw);
+    if (!writeAt(fd, entry.offset, raw, sizeof(raw)))
+        return false;
+
+    // Only now that the file no longer reaches them, cut off and free the old tail
+    if (!freed.empty())
+    {
+        if (kept > 0 && !setFatEntry(clusters[kept - 1], END_OF_CHAIN))
+            return false;
+        for (uint32_t cluster : freed)
+        {
+            if (!setFatEntry(cluster, 0))
+                return false;
+        }
+    }
+    if (!added.empty())
+        nextFree = added.back() + 1 < clusterCount + 2 ? added.back() + 1 : 2;
+    if (!updateFsInfo(static_cast<int64_t>(freed.size()) - static_cast<int64_t>(added.size())))
+        return false;
+
+    return !syncOnSave || fsync(fd) == 0;
+}
+
+bool Fat32Image::write(const std::string &path, std::string_view contents)
+{
+    return write(path, std::vector<std::string_view>{contents});
+}
+
+void Fat32Image::setSyncOnSave(bool sync)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    syncOnSave = sync;
+}
+
+size_t Fat32Image::getClustersWritten() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return clustersWritten;
+}
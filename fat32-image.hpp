@@ -0,0 +1,192 @@
+#ifndef FAT32_IMAGE_HPP
+#define FAT32_IMAGE_HPP
+
+#include "file-buffer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Files on the FAT32 boot partition of a raw SD card image, without mounting it
+ *
+ * The image is either a whole card, where the first FAT32 partition of the MBR
+ * is used, or a bare FAT32 volume. Files are found by path, with long file names
+ * matched without regard to ASCII case, and rewritten in place: only clusters
+ * whose bytes change are written, the cluster chain grows or shrinks as needed,
+ * and both copies of the FAT and the directory entry are kept up to date.
+ *
+ * Everything runs in user space on the image file, so no root privileges or
+ * loop devices are needed, and images can be edited in parallel. One object may
+ * be used from several threads; two objects or programs must not write the same
+ * image at the same time.
+ *
+ * Writes are not atomic. An interrupted write can leave the file damaged, as with
+ * ConfigEditor::SaveStrategy::PatchInPlace. New files and directories cannot be
+ * created.
+ */
+class Fat32Image
+{
+private:
+    /**
+     * @brief A file or directory found by lookup()
+     */
+    struct Entry
+    {
+        uint32_t firstCluster = 0; // 0 for an empty file
+        uint32_t size = 0;
+        uint64_t offset = 0; // Byte offset of the 32-byte directory entry in the image
+        bool directory = false;
+    };
+
+    int fd = -1;
+    std::string imagePath;
+    uint64_t fatOffset = 0;  // Byte offset of the first FAT
+    uint64_t fatSize = 0;    // Bytes per FAT
+    uint32_t fatCount = 0;   // Copies of the FAT, all kept identical
+    uint64_t dataOffset = 0; // Byte offset of cluster 2
+    uint32_t clusterSize = 0;
+    uint32_t clusterCount = 0; // Data clusters, numbered from 2
+    uint32_t rootCluster = 0;
+    uint64_t fsInfoOffset = 0; // Byte offset of the FSInfo sector, 0 if there is none
+    std::vector<uint32_t> fat; // The first FAT, read once on open
+    uint32_t nextFree = 2;     // Where the search for free clusters starts
+    bool syncOnSave = true;
+    size_t clustersWritten = 0;
+    mutable std::mutex mutex;
+
+    Fat32Image() = default;
+
+    /**
+     * @brief Read the boot sector of the volume at an offset and the FAT
+     * @return false if there is no usable FAT32 volume at the offset
+     */
+    bool mount(uint64_t volumeOffset);
+
+    /**
+     * @brief Get the byte offset of a data cluster in the image
+     */
+    uint64_t clusterOffset(uint32_t cluster) const;
+
+    /**
+     * @brief Follow a cluster chain
+     * @param first First cluster, 0 for none
+     * @param clusters Receives the clusters in file order
+     * @return false if the chain is broken or loops
+     */
+    bool chain(uint32_t first, std::vector<uint32_t> &clusters) const;
+
+    /**
+     * @brief Find a file or directory
+     * @param path Absolute path within the volume, e.g. /network
+     * @param entry Receives the entry; the root directory has offset 0
+     * @return false if it does not exist or the image is damaged
+     */
+    bool lookup(std::string_view path, Entry &entry) const;
+
+    /**
+     * @brief Find a name in a directory
+     * @param directory First cluster of the directory
+     * @param name Long or short name, matched without regard to ASCII case
+     * @param entry Receives the entry
+     * @return false if the name is not in the directory
+     */
+    bool findInDirectory(uint32_t directory, std::string_view name, Entry &entry) const;
+
+    /**
+     * @brief Set a FAT entry in memory and in every FAT copy on disk
+     * @param cluster Cluster whose entry to set
+     * @param value Next cluster, END_OF_CHAIN or 0 for free
+     * @return false if the FAT could not be written
+     */
+    bool setFatEntry(uint32_t cluster, uint32_t value);
+
+    /**
+     * @brief Pick free clusters without claiming them
+     * @param count Number of clusters needed
+     * @param clusters Receives the clusters
+     * @return false if the volume has fewer free clusters
+     */
+    bool findFree(size_t count, std::vector<uint32_t> &clusters) const;
+
+    /**
+     * @brief Update the free cluster count and hint in the FSInfo sector
+     * @param change Clusters freed minus clusters allocated
+     */
+    bool updateFsInfo(int64_t change);
+
+public:
+    static const uint32_t END_OF_CHAIN = 0x0FFFFFFF;
+
+    /**
+     * @brief Open an image for reading and writing
+     * @param imagePath Path of the raw image file
+     * @return Shared image, nullptr if the file could not be opened or has no FAT32 volume
+     */
+    static std::shared_ptr<Fat32Image> open(const std::string &imagePath);
+
+    /**
+     * @brief Destructor, closes the image
+     */
+    ~Fat32Image();
+
+    Fat32Image(const Fat32Image &other) = delete;
+    Fat32Image &operator=(const Fat32Image &other) = delete;
+
+    /**
+     * @brief Read a whole file
+     * @param path Absolute path within the volume, e.g. /wpa_supplicant.conf
+     * @return Shared buffer, nullptr if the file does not exist or could not be read
+     */
+    std::shared_ptr<const FileBuffer> read(const std::string &path) const;
+
+    /**
+     * @brief Replace the contents of an existing file in place
+     * @param path Absolute path within the volume
+     * @param segments New contents, in pieces that are written without joining them
+     * @return true if successful, false if the file does not exist, the volume is
+     *         full, or writing failed
+     *
+     * Clusters whose bytes are unchanged are not written. New clusters are written
+     * before they are linked into the file, and clusters are only freed after the
+     * directory entry stops pointing at them.
+     */
+    bool write(const std::string &path, const std::vector<std::string_view> &segments);
+
+    /**
+     * @brief Replace the contents of an existing file in place
+     * @param path Absolute path within the volume
+     * @param contents New contents
+     * @return true if successful
+     */
+    bool write(const std::string &path, std::string_view contents);
+
+    /**
+     * @brief Choose whether write() flushes the image to disk
+     * @param sync If true (the default), fsync the image after every write
+     */
+    void setSyncOnSave(bool sync);
+
+    /**
+     * @brief Get the path of the image file
+     * @return Path given to open()
+     */
+    const std::string &getPath() const { return imagePath; }
+
+    /**
+     * @brief Get the allocation unit of the volume
+     * @return Bytes per cluster
+     */
+    size_t getClusterSize() const { return clusterSize; }
+
+    /**
+     * @brief Get the number of data clusters written since the image was opened
+     * @return Cluster count
+     */
+    size_t getClustersWritten() const;
+};
+
+#endif // FAT32_IMAGE_HPP
@@ -0,0 +1,130 @@
+#include "file-buffer.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FileStamp FileStamp::of(const std::string &filename)
+{
+    FileStamp stamp;
+    struct stat statbuf;
+    if (stat(filename.c_str(), &statbuf) == 0)
+    {
+        stamp.exists = true;
+        stamp.device = static_cast<uint64_t>(statbuf.st_dev);
+        stamp.inode = static_cast<uint64_t>(statbuf.st_ino);
+        stamp.size = static_cast<uint64_t>(statbuf.st_size);
+#ifdef st_mtime
+        // st_mtime is an alias for st_mtim.tv_sec where the timestamp has nanoseconds,
+        // so a rewrite of the same size within the same second still changes the stamp
+        stamp.modified = static_cast<int64_t>(statbuf.st_mtim.tv_sec);
+        stamp.modifiedNanos = static_cast<int64_t>(statbuf.st_mtim.tv_nsec);
+#else
+        stamp.modified = static_cast<int64_t>(statbuf.st_mtime);
+#endif
+    }
+    return stamp;
+}
+
+std::shared_ptr<const FileBuffer> FileBuffer::map(const std::string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0 || !S_ISREG(statbuf.st_mode))
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    std::shared_ptr<FileBuffer> buffer(new FileBuffer());
+    buffer->length = static_cast<size_t>(statbuf.st_size);
+
+    // mmap() rejects zero-length mappings; an empty file needs no storage at all
+    if (buffer->length > 0)
+    {
+        void *address = mmap(nullptr, buffer->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            close(fd);
+            return nullptr;
+        }
+        buffer->bytes = static_cast<const char *>(address);
+        buffer->mapped = true;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    return buffer;
+}
+
+std::shared_ptr<const FileBuffer> FileBuffer::read(const std::string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0 || !S_ISREG(statbuf.st_mode))
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    std::shared_ptr<FileBuffer> buffer(new FileBuffer());
+    buffer->length = static_cast<size_t>(statbuf.st_size);
+    buffer->heap.reset(new char[buffer->length > 0 ? buffer->length : 1]);
+
+    size_t done = 0;
+    while (done < buffer->length)
+    {
+        ssize_t count = ::read(fd, buffer->heap.get() + done, buffer->length - done);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            close(fd);
+            return nullptr;
+        }
+        if (count == 0)
+            break; // File shrank while reading
+        done += static_cast<size_t>(count);
+    }
+    close(fd);
+
+    buffer->length = done;
+    buffer->bytes = buffer->heap.get();
+    return buffer;
+}
+
+std::shared_ptr<const FileBuffer> FileBuffer::copyOf(std::string_view contents)
+{
+    std::shared_ptr<FileBuffer> buffer(new FileBuffer());
+    buffer->length = contents.size();
+    buffer->heap.reset(new char[buffer->length > 0 ? buffer->length : 1]);
+    contents.copy(buffer->heap.get(), buffer->length);
+    buffer->bytes = buffer->heap.get();
+    return buffer;
+}
+
+uint64_t FileBuffer::hash(std::string_view contents, uint64_t seed)
+{
+    uint64_t value = seed;
+    for (char c : contents)
+    {
+        value ^= static_cast<unsigned char>(c);
+        value *= 1099511628211ULL;
+    }
+    return value;
+}
+
+FileBuffer::~FileBuffer()
+{
+    if (mapped)
+    {
+        munmap(const_cast<char *>(bytes), length);
+    }
+}
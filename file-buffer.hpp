@@ -0,0 +1,108 @@
+#ifndef FILE_BUFFER_HPP
+#define FILE_BUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Identity and version of a file on disk, used to tell whether it changed since it was read
+ */
+struct FileStamp
+{
+    bool exists = false;
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    int64_t modified = 0;      // Modification time, seconds since the epoch
+    int64_t modifiedNanos = 0; // Sub-second part of the modification time, 0 if unknown
+
+    /**
+     * @brief Stat a file
+     * @param filename Path to the file
+     * @return Stamp of the file, with exists set to false if it could not be stat'ed
+     */
+    static FileStamp of(const std::string &filename);
+
+    bool operator==(const FileStamp &other) const
+    {
+        return exists == other.exists && device == other.device && inode == other.inode &&
+               size == other.size && modified == other.modified &&
+               modifiedNanos == other.modifiedNanos;
+    }
+    bool operator!=(const FileStamp &other) const { return !(*this == other); }
+};
+
+/**
+ * @brief Read-only contents of a whole file, either memory-mapped or read into one heap block
+ *
+ * Buffers are immutable once created and are shared through std::shared_ptr, so views
+ * into a buffer stay valid for as long as any owner holds on to it.
+ */
+class FileBuffer
+{
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    std::unique_ptr<char[]> heap;
+
+    FileBuffer() = default;
+
+public:
+    /**
+     * @brief Memory-map a file read-only
+     * @param filename Path to the file
+     * @return Shared buffer, nullptr if the file could not be opened or mapped
+     */
+    static std::shared_ptr<const FileBuffer> map(const std::string &filename);
+
+    /**
+     * @brief Read a file into a single heap allocation
+     * @param filename Path to the file
+     * @return Shared buffer, nullptr if the file could not be opened or read
+     */
+    static std::shared_ptr<const FileBuffer> read(const std::string &filename);
+
+    /**
+     * @brief Create a heap buffer holding a copy of in-memory contents
+     * @param contents Contents to copy
+     * @return Shared buffer
+     */
+    static std::shared_ptr<const FileBuffer> copyOf(std::string_view contents);
+
+    static const uint64_t HASH_SEED = 14695981039346656037ULL;
+
+    /**
+     * @brief Compute a 64-bit FNV-1a hash of file contents
+     * @param contents Contents to hash
+     * @param seed HASH_SEED, or the hash of the contents before these ones to
+     *        hash pieces of a file one after another
+     * @return Hash value
+     */
+    static uint64_t hash(std::string_view contents, uint64_t seed = HASH_SEED);
+
+    /**
+     * @brief Destructor, unmaps or frees the contents
+     */
+    ~FileBuffer();
+
+    FileBuffer(const FileBuffer &other) = delete;
+    FileBuffer &operator=(const FileBuffer &other) = delete;
+
+    /**
+     * @brief Get the file contents
+     * @return View of the whole buffer
+     */
+    std::string_view view() const { return std::string_view(bytes, length); }
+
+    /**
+     * @brief Check whether the contents are memory-mapped
+     * @return true if mapped, false if read into heap memory
+     */
+    bool isMapped() const { return mapped; }
+};
+
+#endif // FILE_BUFFER_HPP
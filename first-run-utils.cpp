@@ -1,60 +1,226 @@
 #include "first-run-utils.hpp"
+#include "config-parser.hpp"
+#include "display-modes.hpp"
+#include "file-buffer.hpp"
+#include "keyboard-layouts.hpp"
+#include "system-ops.hpp"
 #include "timezone-helper.hpp"
+#include <cctype>
+#include <chrono>
 #include <iostream>
 
-bool FirstRunUtils::isFirstRun()
+namespace
 {
-    std::string config_path = "/data/home/root/.config/qnx-raspi-setup";
-    FILE *file = fopen(config_path.c_str(), "r");
-    if (file)
+    using Clock = std::chrono::steady_clock;
+
+    std::string &markerPath()
     {
-        // Configuration file exists, not the first run.
-        fclose(file);
-        return false;
+        static std::string path = "/data/home/root/.config/qnx-raspi-setup";
+        return path;
     }
-    else
+
+    /**
+     * @brief Print how long a provisioning step took.
+     * @param step Name of the step.
+     * @param start When the step started.
+     * @return The current time, where the next step starts.
+     */
+    Clock::time_point reportStep(const char *step, Clock::time_point start)
     {
-        // Configuration file does not exist, first run.
+        Clock::time_point now = Clock::now();
+        std::cout << "  " << step << ": " << std::chrono::duration<double, std::milli>(now - start).count()
+                  << " ms" << std::endl;
+        return now;
+    }
 
-        // Ensure the .config directory exists.
-        std::string config_dir = "/data/home/root/.config";
-        std::string mkdir_command = "mkdir -p " + config_dir;
-        if (system(mkdir_command.c_str()) != 0)
+    /**
+     * @brief Check a hostname against RFC 1123: one label of letters, digits and inner hyphens.
+     */
+    bool isValidHostname(std::string_view name)
+    {
+        if (name.empty() || name.size() > 63 || name.front() == '-' || name.back() == '-')
+            return false;
+        for (char c : name)
         {
-            std::cerr << "Error: Unable to create directory " << config_dir << std::endl;
-            exit(1);
+            if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-')
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Visitor that reads manifest keys and reports every invalid one.
+     */
+    class ManifestReader : public ConfigVisitor
+    {
+    private:
+        const std::string &path;
+        FirstRunUtils::Manifest &manifest;
+        bool seenKeyMgmt = false;
+        bool seenPsk = false;
+
+        void report(size_t lineNumber, const std::string &message)
+        {
+            std::cerr << "Error: " << path << ":" << lineNumber + 1 << ": " << message << std::endl;
+            valid = false;
+        }
+
+        template <typename T>
+        bool setOnce(std::optional<T> &field, T value, std::string_view key, size_t lineNumber)
+        {
+            if (field)
+            {
+                report(lineNumber, std::string(key) + " is set more than once");
+                return false;
+            }
+            field = std::move(value);
+            return true;
         }
 
-        // Create the configuration file to mark that the program has been run.
-        file = fopen(config_path.c_str(), "w");
-        if (file)
+    public:
+        bool valid = true;
+
+        ManifestReader(const std::string &manifestPath, FirstRunUtils::Manifest &settings)
+            : path(manifestPath), manifest(settings) {}
+
+        bool keyValue(const SectionScope &, std::string_view key, std::string_view value, size_t lineNumber) override
         {
-            fclose(file);
+            if (key == "hostname")
+            {
+                if (!isValidHostname(value))
+                    report(lineNumber, "invalid hostname: " + std::string(value));
+                setOnce(manifest.hostname, std::string(value), key, lineNumber);
+            }
+            else if (key == "keymap")
+            {
+                if (!KeyboardLayouts::isAvailable(value))
+                    report(lineNumber, "unknown keyboard layout: " + std::string(value));
+                setOnce(manifest.keymap, std::string(value), key, lineNumber);
+            }
+            else if (key == "display")
+            {
+                std::optional<ConfigSchema::VideoMode> mode = ConfigSchema::parse<ConfigSchema::DisplayVideoMode>(value);
+                if (!mode)
+                    report(lineNumber, "invalid display mode, expected <width> x <height> @ <refresh>: " + std::string(value));
+                setOnce(manifest.display, mode.value_or(ConfigSchema::VideoMode()), key, lineNumber);
+            }
+            else if (key == "timezone")
+            {
+                if (!TimezoneHelper::isValidTimezone(std::string(value)))
+                    report(lineNumber, "invalid timezone: " + std::string(value));
+                setOnce(manifest.timezone, std::string(value), key, lineNumber);
+            }
+            else if (key == "wifi-ssid")
+            {
+                if (value.empty() || value.size() > 32)
+                    report(lineNumber, "Wi-Fi SSID must be 1 to 32 characters");
+                if (value.find('"') != std::string_view::npos)
+                    report(lineNumber, "Wi-Fi SSID must not contain quotes");
+                setOnce(manifest.wifiSsid, std::string(value), key, lineNumber);
+            }
+            else if (key == "wifi-key-mgmt")
+            {
+                if (seenKeyMgmt)
+                    report(lineNumber, "wifi-key-mgmt is set more than once");
+                if (value.empty() || value.find_first_of(" \t\"") != std::string_view::npos)
+                    report(lineNumber, "invalid Wi-Fi key management: " + std::string(value));
+                manifest.wifiKeyMgmt = std::string(value);
+                seenKeyMgmt = true;
+            }
+            else if (key == "wifi-psk")
+            {
+                if (seenPsk)
+                    report(lineNumber, "wifi-psk is set more than once");
+                if (value.find('"') != std::string_view::npos)
+                    report(lineNumber, "Wi-Fi pre-shared key must not contain quotes");
+                manifest.wifiPsk = std::string(value);
+                seenPsk = true;
+            }
+            else
+            {
+                report(lineNumber, "unknown setting: " + std::string(key));
+            }
+            return true;
         }
-        else
+
+        /**
+         * @brief Check the settings that depend on each other, once every line was read.
+         */
+        void finish()
         {
-            std::cerr << "Error: Unable to create configuration file at " << config_path << std::endl;
-            exit(1);
+            if ((seenKeyMgmt || seenPsk) && !manifest.wifiSsid)
+            {
+                std::cerr << "Error: " << path << ": wifi-key-mgmt and wifi-psk need a wifi-ssid" << std::endl;
+                valid = false;
+            }
+            // WPA passphrases are 8 to 63 characters
+            if (manifest.wifiSsid && manifest.wifiKeyMgmt == "WPA-PSK" &&
+                (manifest.wifiPsk.size() < 8 || manifest.wifiPsk.size() > 63))
+            {
+                std::cerr << "Error: " << path << ": WPA-PSK needs a wifi-psk of 8 to 63 characters" << std::endl;
+                valid = false;
+            }
         }
+    };
+}
 
-        return true;
+bool FirstRunUtils::isFirstRun()
+{
+    // The marker is only written once setup was applied, see markFirstRunDone().
+    return !FileStamp::of(markerPath()).exists;
+}
+
+bool FirstRunUtils::markFirstRunDone()
+{
+    const std::string &config_path = markerPath();
+
+    // Ensure the .config directory exists.
+    std::string config_dir = config_path.substr(0, config_path.rfind('/'));
+    if (!SystemOps::native().makeDirectories(config_dir))
+    {
+        std::cerr << "Error: Unable to create directory " << config_dir << std::endl;
+        return false;
+    }
+
+    // Create the configuration file to mark that the program has been run.
+    FILE *file = fopen(config_path.c_str(), "w");
+    if (!file)
+    {
+        std::cerr << "Error: Unable to create configuration file at " << config_path << std::endl;
+        return false;
     }
+    fclose(file);
+    return true;
 }
 
-std::string FirstRunUtils::firstTimeSetupHostname()
+void FirstRunUtils::setMarkerPath(const std::string &path)
+{
+    markerPath() = path;
+}
+
+const std::string &FirstRunUtils::getMarkerPath()
+{
+    return markerPath();
+}
+
+std::string FirstRunUtils::firstTimeSetupHostname(SetupUtils::Transaction &transaction)
 {
     std::string hostname;
     std::cout << "Enter your preferred hostname (e.g., qnxpi): ";
     std::cin >> hostname;
-    SetupUtils::setHostname(hostname);
+    if (!transaction.setHostname(hostname))
+    {
+        std::cerr << "Error: Unable to set hostname." << std::endl;
+        exit(1);
+    }
     std::cout << "Hostname set to: " << hostname << std::endl;
     return hostname;
 }
 
-std::string FirstRunUtils::firstTimeSetupKeyboardLayout(SetupUtils &setupUtils)
+std::string FirstRunUtils::firstTimeSetupKeyboardLayout(SetupUtils::Transaction &transaction)
 {
     // Display available keyboard layouts.
-    std::vector<std::string> layouts = setupUtils.getAvailableKeyboardLayouts();
+    const std::vector<std::string_view> &layouts = SetupUtils::getAvailableKeyboardLayouts();
     std::cout << "Available Keyboard Layouts:" << std::endl;
     for (size_t i = 0; i < layouts.size(); ++i)
     {
@@ -69,29 +235,71 @@ std::string FirstRunUtils::firstTimeSetupKeyboardLayout(SetupUtils &setupUtils)
         std::cerr << "Exiting..." << std::endl;
         exit(1);
     }
-    std::string selectedLayout = layouts[choice - 1];
-    setupUtils.setKeyboardLayout(selectedLayout);
+    std::string selectedLayout(layouts[choice - 1]);
+    if (!transaction.setKeyboardLayout(selectedLayout))
+    {
+        std::cerr << "Error: Unable to set keyboard layout in configuration." << std::endl;
+        exit(1);
+    }
     std::cout << "Keyboard layout set to: " << selectedLayout << std::endl;
     return selectedLayout;
 }
 
-std::string FirstRunUtils::firstTimeSetupDisplay(SetupUtils &setupUtils)
+std::string FirstRunUtils::firstTimeSetupDisplay(SetupUtils::Transaction &transaction)
 {
-    int width, height, refreshRate;
-    std::cout << "Enter display width (e.g., 1920): ";
-    std::cin >> width;
-    std::cout << "Enter display height (e.g., 1080): ";
-    std::cin >> height;
-    std::cout << "Enter display refresh rate (e.g., 60): ";
-    std::cin >> refreshRate;
-    
-    setupUtils.setDisplay(width, height, refreshRate);
+    int width = 0, height = 0, refreshRate = 0;
+
+    // Offer the modes the monitor reports, so only valid ones can be picked.
+    std::vector<DisplayModes::Mode> modes = DisplayModes::getSupportedModes();
+    size_t choice = 0;
+    if (!modes.empty())
+    {
+        std::cout << "Display Modes Supported by the Monitor:" << std::endl;
+        for (size_t i = 0; i < modes.size(); ++i)
+        {
+            const ConfigSchema::VideoMode &mode = modes[i].videoMode;
+            std::cout << i + 1 << ". " << mode.width << "x" << mode.height << " @ " << mode.refreshRate << "Hz"
+                      << (modes[i].preferred ? " (recommended)" : "") << std::endl;
+        }
+        std::cout << modes.size() + 1 << ". Other" << std::endl;
+        std::cout << "Select your display mode (1-" << modes.size() + 1 << "): ";
+        std::cin >> choice;
+        if (choice < 1 || choice > modes.size() + 1)
+        {
+            std::cerr << "Invalid choice. Please run the setup again." << std::endl;
+            std::cerr << "Exiting..." << std::endl;
+            exit(1);
+        }
+    }
+
+    if (choice >= 1 && choice <= modes.size())
+    {
+        const ConfigSchema::VideoMode &mode = modes[choice - 1].videoMode;
+        width = mode.width;
+        height = mode.height;
+        refreshRate = mode.refreshRate;
+    }
+    else
+    {
+        std::cout << "Enter display width (e.g., 1920): ";
+        std::cin >> width;
+        std::cout << "Enter display height (e.g., 1080): ";
+        std::cin >> height;
+        std::cout << "Enter display refresh rate (e.g., 60): ";
+        std::cin >> refreshRate;
+    }
+
+    if (!transaction.setDisplay(width, height, refreshRate))
+    {
+        std::cerr << "Error: Unable to set display configuration." << std::endl;
+        exit(1);
+    }
     std::cout << "Display configuration set to: " 
               << width << "x" << height << " @ " << refreshRate << "Hz" << std::endl;
     return std::to_string(width) + "x" + std::to_string(height) + "@" + std::to_string(refreshRate) + "Hz";
 }
 
-std::string FirstRunUtils::firstTimeSetupTimezone()
+std::string FirstRunUtils::firstTimeSetupTimezone(SetupUtils::Transaction &transaction)
 {
     std::string timezone;
     bool valid = false;
@@ -109,12 +317,12 @@ std::string FirstRunUtils::firstTimeSetupTimezone()
         valid = true; // Mark as valid to exit the loop
     }
 
-    std::string result = SetupUtils::setTimezone(timezone);
+    transaction.setTimezone(timezone);
     std::cout << "Timezone set to: " << timezone << std::endl;
-    return result;
+    return timezone;
 }
 
-std::string FirstRunUtils::firstTimeSetupWifi()
+std::string FirstRunUtils::firstTimeSetupWifi(SetupUtils::Transaction &transaction)
 {
     std::string ssid, keyMgmt, psk;
     std::cout << "Enter Wi-Fi SSID: ";
@@ -124,8 +332,7 @@ std::string FirstRunUtils::firstTimeSetupWifi()
     std::cout << "Enter Pre-Shared Key (Password): ";
     std::cin >> psk;
 
-    const std::string wifiConfigPath = "/boot/wpa_supplicant.conf";
-    if (SetupUtils::updateWifiConfig(wifiConfigPath, ssid, keyMgmt, psk))
+    if (transaction.setWifi(ssid, keyMgmt, psk))
     {
         std::cout << "Wi-Fi configuration updated successfully." << std::endl;
         return ssid;
@@ -136,3 +343,70 @@ std::string FirstRunUtils::firstTimeSetupWifi()
         throw std::runtime_error("Wi-Fi configuration update failed.");
     }
 }
+
+bool FirstRunUtils::loadManifest(const std::string &path, Manifest &manifest)
+{
+    manifest = Manifest();
+    ManifestReader reader(path, manifest);
+    if (!ConfigParser::parseFile(path, reader, ConfigDialect::FlatKeyValue))
+    {
+        std::cerr << "Error: Unable to read manifest: " << path << std::endl;
+        return false;
+    }
+    reader.finish();
+    return reader.valid;
+}
+
+bool FirstRunUtils::stageManifest(const Manifest &manifest, SetupUtils::Transaction &transaction)
+{
+    bool staged = (!manifest.hostname || transaction.setHostname(*manifest.hostname)) &&
+                  (!manifest.keymap || transaction.setKeyboardLayout(*manifest.keymap)) &&
+                  (!manifest.display || transaction.setDisplay(manifest.display->width, manifest.display->height,
+                                                               manifest.display->refreshRate)) &&
+                  (!manifest.wifiSsid || transaction.setWifi(*manifest.wifiSsid, manifest.wifiKeyMgmt, manifest.wifiPsk));
+    if (staged && manifest.timezone)
+        transaction.setTimezone(*manifest.timezone);
+    return staged;
+}
+
+bool FirstRunUtils::provisionFromManifest(const std::string &path, Workspace &workspace, SystemOps &ops, bool dryRun)
+{
+    std::cout << "Provisioning from " << path << std::endl;
+    Clock::time_point start = Clock::now();
+    Clock::time_point step = start;
+
+    // Validate everything before touching any file.
+    Manifest manifest;
+    if (!loadManifest(path, manifest))
+        return false;
+    step = reportStep("Read and validate manifest", step);
+
+    // Files a manifest does not need may be missing; staging reports the ones it does.
+    workspace.loadAll();
+    step = reportStep("Load configuration files", step);
+
+    SetupUtils::Transaction transaction(workspace, ops);
+    if (!stageManifest(manifest, transaction))
+    {
+        std::cerr << "Error: Unable to stage the settings from " << path << std::endl;
+        return false;
+    }
+    step = reportStep("Stage settings", step);
+
+    std::vector<SetupUtils::Change> plan = transaction.plan();
+    step = reportStep("Plan changes", step);
+    SetupUtils::printPlan(plan);
+    if (dryRun)
+    {
+        std::cout << "Dry run: nothing was changed." << std::endl;
+        return true;
+    }
+
+    if (!transaction.commit())
+        return false;
+    reportStep("Apply settings", step);
+
+    std::cout << "Provisioned in " << std::chrono::duration<double, std::milli>(Clock::now() - start).count()
+              << " ms" << std::endl;
+    return true;
+}
@@ -2,6 +2,8 @@
 #define FIRST_RUN_UTILS_HPP
 
 #include "setup-utils.hpp"
+#include "workspace.hpp"
+#include <optional>
 #include <string>
 
 namespace FirstRunUtils
@@ -10,21 +12,48 @@ namespace FirstRunUtils
      * @brief Check if this is the first run of the program.
      *
      * This function checks for the existence of a configuration file
-     * at ~/.config/qnx-raspi-setup. If the file does not exist,
-     * it creates the file and returns true, indicating that this
-     * is the first run. If the file exists, it returns false.
+     * at getMarkerPath(). It returns true if the file does not exist,
+     * indicating that the first-run setup has not been completed yet.
+     * Nothing is written; see markFirstRunDone().
      */
     bool isFirstRun();
 
+    /**
+     * @brief Mark the first-run setup as done.
+     *
+     * Creates the configuration file at getMarkerPath(), so isFirstRun()
+     * returns false from now on. Call this only after the setup was applied,
+     * so an aborted or failed setup is offered again on the next run.
+     *
+     * @return true if successful, false if the file could not be created.
+     */
+    bool markFirstRunDone();
+
+    /**
+     * @brief Set the file that marks the first run as done.
+     *
+     * @param path Path of the marker, /data/home/root/.config/qnx-raspi-setup by default.
+     */
+    void setMarkerPath(const std::string &path);
+
+    /**
+     * @brief Get the file that marks the first run as done.
+     *
+     * @return Path of the marker.
+     */
+    const std::string &getMarkerPath();
+
     /**
      * @brief Perform first-time setup for hostname.
      * 
      * This function allows user to set up their preferred hostname
      * through interactive prompts.
      * 
+     * @param transaction The first-run transaction the hostname is staged in.
+     *
      * @return std::string The set up hostname.
      */
-    std::string firstTimeSetupHostname();
+    std::string firstTimeSetupHostname(SetupUtils::Transaction &transaction);
 
     /**
      * @brief Perform first-time setup for keyboard layout.
@@ -32,11 +61,11 @@ namespace FirstRunUtils
      * This function allows user to set up their preferred keyboard layout
      * through interactive prompts.
      * 
-     * @param setupUtils Reference to SetupUtils instance for configuration management.
+     * @param transaction The first-run transaction the keyboard layout is staged in.
      *
      * @return std::string The set up keyboard layout.
      */
-    std::string firstTimeSetupKeyboardLayout(SetupUtils &setupUtils);
+    std::string firstTimeSetupKeyboardLayout(SetupUtils::Transaction &transaction);
 
     /**
      * @brief Perform first-time setup for display configuration.
@@ -44,11 +73,11 @@ namespace FirstRunUtils
      * This function allows user to set up their preferred display settings
      * through interactive prompts.
      * 
-     * @param setupUtils Reference to SetupUtils instance for configuration management.
+     * @param transaction The first-run transaction the display configuration is staged in.
      *
      * @return std::string The set up display configuration.
      */
-    std::string firstTimeSetupDisplay(SetupUtils &setupUtils);
+    std::string firstTimeSetupDisplay(SetupUtils::Transaction &transaction);
 
     /**
      * @brief Perform first-time setup for timezone.
@@ -56,9 +85,11 @@ namespace FirstRunUtils
      * This function allows user to set up their preferred timezone
      * through interactive prompts.
      * 
+     * @param transaction The first-run transaction the timezone is staged in.
+     *
      * @return std::string The set up timezone.
      */
-    std::string firstTimeSetupTimezone();
+    std::string firstTimeSetupTimezone(SetupUtils::Transaction &transaction);
 
     /**
      * @brief Perform first-time setup for Wi-Fi configuration.
@@ -66,9 +97,80 @@ namespace FirstRunUtils
      * This function allows user to set up their Wi-Fi settings
      * through interactive prompts.
      * 
+     * @param transaction The first-run transaction the Wi-Fi settings are staged in.
+     *
      * @return std::string The set up Wi-Fi SSID.
      */
-    std::string firstTimeSetupWifi();
+    std::string firstTimeSetupWifi(SetupUtils::Transaction &transaction);
+
+    /**
+     * @brief Settings for one device, read from a manifest for headless setup.
+     *
+     * A manifest is a plain KEY=VALUE file with # comments. Every key is optional;
+     * settings that are left out are not changed.
+     *
+     * @code
+     * hostname=qnxpi
+     * keymap=en_US_101
+     * display=1920 x 1080 @ 60
+     * timezone=America/Toronto
+     * wifi-ssid=HomeNetwork
+     * wifi-key-mgmt=WPA-PSK
+     * wifi-psk=correct horse battery staple
+     * @endcode
+     */
+    struct Manifest
+    {
+        std::optional<std::string> hostname;
+        std::optional<std::string> keymap;
+        std::optional<ConfigSchema::VideoMode> display;
+        std::optional<std::string> timezone;
+        std::optional<std::string> wifiSsid;
+        std::string wifiKeyMgmt = "WPA-PSK";
+        std::string wifiPsk;
+    };
+
+    /**
+     * @brief Read and validate a manifest.
+     *
+     * Every problem is reported, with its line number, before returning, so a
+     * manifest can be fixed in one go.
+     *
+     * @param path Path to the manifest file.
+     * @param manifest Receives the settings.
+     *
+     * @return true if the manifest was read and every setting is valid, false otherwise.
+     */
+    bool loadManifest(const std::string &path, Manifest &manifest);
+
+    /**
+     * @brief Stage every setting of a manifest in a transaction.
+     *
+     * @param manifest Settings from loadManifest().
+     * @param transaction The transaction to stage them in; nothing is applied yet.
+     *
+     * @return true if every setting was staged, false if a document it needs is not loaded.
+     */
+    bool stageManifest(const Manifest &manifest, SetupUtils::Transaction &transaction);
+
+    /**
+     * @brief Set up the device from a manifest without any prompts.
+     *
+     * The manifest is validated before anything is loaded. All settings are then
+     * staged in one transaction, compared with the current state, and the plan of
+     * what differs is printed. Only those changes are applied, in a single pass,
+     * all or nothing; a device that is already set up is not written to at all.
+     * The time taken by each step is printed.
+     *
+     * @param path Path to the manifest file.
+     * @param workspace The configuration files to set up; loaded by this function.
+     * @param ops Backend the timezone is read and set through.
+     * @param dryRun If true, stop after printing the plan and change nothing.
+     *
+     * @return true if every setting was applied (or planned, in a dry run), false if nothing was changed.
+     */
+    bool provisionFromManifest(const std::string &path, Workspace &workspace,
+                               SystemOps &ops = SystemOps::native(), bool dryRun = false);
 }
 
 #endif // FIRST_RUN_UTILS_HPP
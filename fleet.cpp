@@ -0,0 +1,305 @@
+#include "fleet.hpp"
+#include "atomic-file.hpp"
+#include "config-parser.hpp"
+#include "fat32-image.hpp"
+#include "file-buffer.hpp"
+#include "first-run-utils.hpp"
+#include "keyboard-layouts.hpp"
+#include "system-ops.hpp"
+#include "timezone-helper.hpp"
+#include "work-stealing-pool.hpp"
+#include "workspace.hpp"
+#include <algorithm>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double milliseconds(std::chrono::nanoseconds duration)
+    {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    /**
+     * @brief Split off the next whitespace-separated word of a line
+     */
+    std::string_view nextWord(std::string_view &line)
+    {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos)
+        {
+            line = std::string_view();
+            return line;
+        }
+        line.remove_prefix(start);
+        size_t end = std::min(line.find_first_of(" \t\r"), line.size());
+        std::string_view word = line.substr(0, end);
+        line.remove_prefix(end);
+        return word;
+    }
+
+    /**
+     * @brief Check whether a device is a raw SD card image rather than a mounted root
+     */
+    bool isImageFile(const std::string &root)
+    {
+        struct stat info;
+        return stat(root.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+    }
+
+    /**
+     * @brief Write the first-run marker into an image, so the device boots straight to the dashboard
+     */
+    bool markSetUp(const std::string &root, SystemOps &ops)
+    {
+        std::string marker = root + FirstRunUtils::getMarkerPath();
+        if (FileStamp::of(marker).exists)
+            return true; // Set up before; nothing to write
+        return ops.makeDirectories(marker.substr(0, marker.rfind('/'))) && AtomicFile::replace(marker, "", false);
+    }
+
+    /**
+     * @brief Find a document that a manifest changes but that could not be loaded
+     * @return Path of the document, empty if every document the manifest needs is loaded
+     */
+    std::string missingDocument(const FirstRunUtils::Manifest &manifest, const Workspace &workspace)
+    {
+        std::vector<Workspace::Document> needed;
+        if (manifest.hostname)
+            needed.push_back(Workspace::Document::NetworkConfig);
+        if (manifest.keymap || manifest.display)
+            needed.push_back(Workspace::Document::GraphicsConfig);
+        if (manifest.wifiSsid)
+            needed.push_back(Workspace::Document::WifiConfig);
+        for (Workspace::Document document : needed)
+        {
+            if (!workspace.isLoaded(document))
+                return workspace.getPath(document);
+        }
+        return std::string();
+    }
+
+    /**
+     * @brief Provision one device from its validated manifest
+     *
+     * Runs on a pool worker. Everything it writes belongs to this device; the base
+     * workspace is shared by all workers and only read.
+     */
+    Fleet::Result provisionDevice(const Fleet::Device &device, const FirstRunUtils::Manifest &manifest,
+                                  const Workspace &base, bool dryRun)
+    {
+        Fleet::Result result;
+        result.root = device.root;
+        Clock::time_point start = Clock::now();
+
+        // A raw image is edited through its boot partition, with no mount and no privileges
+        bool image = isImageFile(device.root);
+        std::shared_ptr<Fat32Image> bootImage = image ? Fat32Image::open(device.root) : nullptr;
+        if (image && !bootImage)
+        {
+            result.error = "no FAT32 boot partition in the image";
+            result.elapsed = Clock::now() - start;
+            return result;
+        }
+
+        // The workers already keep every core busy, so the workspace does its own files inline
+        Workspace workspace(image ? Workspace::Paths() : Workspace::Paths().under(device.root), bootImage, 0);
+        workspace.setSyncOnCommit(false);
+        // Files the manifest leaves alone may be missing, like the graphics configuration of a raw image
+        if (!workspace.loadAll(base))
+        {
+            std::string missing = missingDocument(manifest, workspace);
+            if (!missing.empty())
+            {
+                result.error = "could not read " + missing;
+                result.elapsed = Clock::now() - start;
+                return result;
+            }
+        }
+        OfflineSystemOps ops(device.root);
+        ops.setSyncOnSave(false);
+
+        // The first-run marker lives on the system partition, out of reach in a raw image
+        SetupUtils::Transaction transaction(workspace, ops);
+        if (!FirstRunUtils::stageManifest(manifest, transaction))
+        {
+            result.error = "could not stage the settings";
+        }
+        else
+        {
+            result.plan = transaction.plan();
+            if (dryRun)
+                result.success = true;
+            else if (!transaction.commit())
+                result.error = "could not apply the settings";
+            else if (!image && !markSetUp(device.root, ops))
+                result.error = "could not mark the first run as done";
+            else
+                result.success = true;
+        }
+
+        result.elapsed = Clock::now() - start;
+        return result;
+    }
+}
+
+bool Fleet::loadDeviceList(const std::string &path, std::vector<Device> &devices)
+{
+    devices.clear();
+    bool valid = true;
+    size_t lineNumber = 0;
+    // Line each root was first listed on, by file identity so that other spellings
+    // of a path match too; by path for roots that do not exist
+    std::map<std::pair<uint64_t, uint64_t>, size_t> rootFiles;
+    std::map<std::string, size_t> rootPaths;
+    bool read = ConfigParser::readLines(path, [&](std::string_view line)
+                                        {
+                                            ++lineNumber;
+                                            std::string_view root = nextWord(line);
+                                            if (root.empty() || root.front() == '#')
+                                                return true;
+                                            std::string_view manifest = nextWord(line);
+                                            if (manifest.empty() || !nextWord(line).empty())
+                                            {
+                                                std::cerr << "Error: " << path << ":" << lineNumber
+                                                          << ": expected <image root> <manifest>" << std::endl;
+                                                valid = false;
+                                                return true;
+                                            }
+                                            while (root.size() > 1 && root.back() == '/')
+                                                root.remove_suffix(1);
+
+                                            // Two workers on one image would both write its file allocation table
+                                            std::string rootPath(root);
+                                            FileStamp stamp = FileStamp::of(rootPath);
+                                            size_t listed =
+                                                stamp.exists ? rootFiles.emplace(std::make_pair(stamp.device, stamp.inode), lineNumber).first->second
+                                                             : rootPaths.emplace(rootPath, lineNumber).first->second;
+                                            if (listed != lineNumber)
+                                            {
+                                                std::cerr << "Error: " << path << ":" << lineNumber << ": " << rootPath
+                                                          << " is already listed on line " << listed << std::endl;
+                                                valid = false;
+                                                return true;
+                                            }
+                                            devices.push_back({std::move(rootPath), std::string(manifest)});
+                                            return true; });
+    if (!read)
+    {
+        std::cerr << "Error: Unable to read device list: " << path << std::endl;
+        return false;
+    }
+    return valid;
+}
+
+std::vector<Fleet::Result> Fleet::provision(const std::vector<Device> &devices, size_t threads, bool dryRun)
+{
+    std::vector<Result> results(devices.size());
+    std::vector<FirstRunUtils::Manifest> manifests(devices.size());
+
+    // Validate every manifest up front, in list order, so all errors of a batch
+    // are reported together before any image is written
+    const Device *first = nullptr;
+    for (size_t i = 0; i < devices.size(); ++i)
+    {
+        results[i].root = devices[i].root;
+        if (!FirstRunUtils::loadManifest(devices[i].manifest, manifests[i]))
+        {
+            results[i].error = "invalid manifest " + devices[i].manifest;
+            continue;
+        }
+        const FirstRunUtils::Manifest &manifest = manifests[i];
+        if ((manifest.keymap || manifest.display || manifest.timezone) && isImageFile(devices[i].root))
+        {
+            results[i].error = "only the hostname and Wi-Fi can be set in a raw image; mount it for the rest";
+            continue;
+        }
+        if (!first)
+            first = &devices[i];
+    }
+    if (!first)
+        return results;
+
+    // Parse the configuration files once; devices with identical files share them
+    std::shared_ptr<Fat32Image> baseImage = isImageFile(first->root) ? Fat32Image::open(first->root) : nullptr;
+    Workspace base(baseImage ? Workspace::Paths() : Workspace::Paths().under(first->root), baseImage);
+    base.loadAll();
+
+    {
+        WorkStealingPool pool(threads);
+        std::vector<std::future<Result>> pending(devices.size());
+        for (size_t i = 0; i < devices.size(); ++i)
+        {
+            if (!results[i].error.empty())
+                continue;
+            pending[i] = pool.submit([&devices, &manifests, &base, dryRun, i]
+                                     { return provisionDevice(devices[i], manifests[i], base, dryRun); });
+        }
+        for (size_t i = 0; i < devices.size(); ++i)
+        {
+            if (pending[i].valid())
+                results[i] = pending[i].get();
+        }
+    }
+
+    // One flush for the whole batch instead of an fsync per file
+    if (!dryRun)
+        sync();
+    return results;
+}
+
+bool Fleet::run(const std::string &listPath, size_t threads, bool dryRun)
+{
+    std::vector<Device> devices;
+    if (!loadDeviceList(listPath, devices))
+        return false;
+    if (devices.empty())
+    {
+        std::cerr << "Error: No devices in " << listPath << std::endl;
+        return false;
+    }
+
+    // A batch is stamped from one base image, so its keymaps and zone files stand
+    // for all of them; raw images have neither, as they only get boot partition settings
+    auto mounted = std::find_if(devices.begin(), devices.end(), [](const Device &device)
+                                { return !isImageFile(device.root); });
+    if (mounted != devices.end())
+    {
+        TimezoneHelper::setZoneinfoPath(mounted->root + TimezoneHelper::getZoneinfoPath());
+        KeyboardLayouts::setKeymapPath(mounted->root + KeyboardLayouts::getKeymapPath());
+    }
+
+    std::cout << (dryRun ? "Planning " : "Provisioning ") << devices.size() << " images on " << threads
+              << " threads" << std::endl;
+    Clock::time_point start = Clock::now();
+    std::vector<Result> results = provision(devices, threads, dryRun);
+    std::chrono::nanoseconds elapsed = Clock::now() - start;
+
+    size_t failed = 0;
+    std::cout << std::fixed << std::setprecision(1);
+    for (const Result &result : results)
+    {
+        std::cout << (result.success ? "  OK   " : "  FAIL ") << std::setw(8) << milliseconds(result.elapsed)
+                  << " ms  " << result.root;
+        if (!result.success)
+        {
+            std::cout << ": " << result.error << std::endl;
+            ++failed;
+            continue;
+        }
+        std::cout << ": " << result.plan.size() << (result.plan.size() == 1 ? " change" : " changes") << std::endl;
+        if (dryRun && !result.plan.empty())
+            SetupUtils::printPlan(result.plan);
+    }
+    double seconds = milliseconds(elapsed) / 1000.0;
+    std::cout << results.size() - failed << (dryRun ? " planned, " : " provisioned, ") << failed << " failed in "
+              << milliseconds(elapsed) << " ms (" << (seconds > 0 ? results.size() / seconds : 0.0)
+              << " images/s)" << std::endl;
+    return failed == 0;
+}
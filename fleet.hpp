@@ -0,0 +1,96 @@
+#ifndef FLEET_HPP
+#define FLEET_HPP
+
+#include "setup-utils.hpp"
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Provisioning of many mounted system images in one batch
+ *
+ * Each device is an image root with its own manifest, as used by --root and
+ * --manifest. Every manifest is validated before any image is touched. The
+ * devices are then provisioned in parallel on a WorkStealingPool, so a slow
+ * image does not hold up the workers that are done with theirs.
+ *
+ * Images in a batch are normally copies of one base image. The configuration
+ * files of the first image are parsed once, and every device whose files hold
+ * the same contents shares that parse instead of splitting and indexing its
+ * own copy.
+ *
+ * A device may also be a raw SD card image file. Its boot partition is edited in
+ * place through Fat32Image, so no mount or root privileges are needed. Only the
+ * hostname and Wi-Fi live there; the other settings are on the QNX system
+ * partition, and manifests that set them are rejected for raw images.
+ */
+namespace Fleet
+{
+    /**
+     * @brief One device of a batch
+     */
+    struct Device
+    {
+        std::string root;     // Directory the image's root file system is mounted at, or a raw image file
+        std::string manifest; // Settings for this device, see FirstRunUtils::Manifest
+    };
+
+    /**
+     * @brief Outcome of provisioning one device
+     */
+    struct Result
+    {
+        std::string root;
+        bool success = false;
+        std::string error; // What failed, empty on success
+        std::vector<SetupUtils::Change> plan; // What differed and was changed, or would be in a dry run
+        std::chrono::nanoseconds elapsed{0};
+    };
+
+    /**
+     * @brief Read a device list
+     *
+     * Each line holds an image root and the path of its manifest, separated by
+     * whitespace. Empty lines and lines starting with # are skipped. A root may
+     * only be listed once, however its path is spelled, since two workers must not
+     * write one image.
+     *
+     * @param path Path of the list
+     * @param devices Receives the devices, in file order
+     * @return true if the list was read, every line is well-formed and no root repeats
+     */
+    bool loadDeviceList(const std::string &path, std::vector<Device> &devices);
+
+    /**
+     * @brief Provision every device
+     *
+     * Files are not flushed one by one; the whole batch is flushed to disk once
+     * at the end. Settings a device already has are left alone, so provisioning
+     * a batch again writes only what changed since.
+     *
+     * @param devices The devices; keymaps and timezones are validated against the
+     *        current KeyboardLayouts and TimezoneHelper paths
+     * @param threads Number of worker threads
+     * @param dryRun If true, only work out each device's plan and write nothing
+     * @return One result per device, in the order of devices
+     */
+    std::vector<Result> provision(const std::vector<Device> &devices, size_t threads, bool dryRun = false);
+
+    /**
+     * @brief Provision the devices of a list and print a report
+     *
+     * Keymaps and timezones are looked up in the first image of the list. The
+     * report has the time taken by every device, its number of changes or what
+     * failed, and the throughput of the batch. A dry run also prints every plan.
+     *
+     * @param listPath Path of the device list, see loadDeviceList()
+     * @param threads Number of worker threads
+     * @param dryRun If true, print what would change and write nothing
+     * @return true if every device was provisioned
+     */
+    bool run(const std::string &listPath, size_t threads, bool dryRun = false);
+
+} // namespace Fleet
+
+#endif // FLEET_HPP
@@ -0,0 +1,144 @@
+#include "keyboard-layouts.hpp"
+#include "file-buffer.hpp"
+#include <algorithm>
+#include <array>
+#include <dirent.h>
+#include <mutex>
+
+namespace
+{
+    // Layouts shipped with QNX for the Raspberry Pi, used when the keymap directory is missing
+    constexpr std::array<std::string_view, 23> BUILT_IN_LAYOUTS = {
+        "cs_CZ_102",
+        "da_DK_102",
+        "de_CH_102",
+        "de_DE_102",
+        "en_CA_101",
+        "en_CA_101_dvorak",
+        "en_GB_102",
+        "en_US_101",
+        "en_US_101_dvorak",
+        "es_ES_102",
+        "fr_BE_102",
+        "fr_CA_102",
+        "fr_CH_102",
+        "fr_FR_102",
+        "hr_HR_102",
+        "it_IT_102",
+        "ja_JP_106",
+        "nl_NL_102",
+        "no_NO_102",
+        "pl_PL_102",
+        "pt_PT_102",
+        "se_SE_102",
+        "sk_SK_102"};
+
+    template <size_t N>
+    constexpr bool isSorted(const std::array<std::string_view, N> &names)
+    {
+        for (size_t i = 1; i < N; ++i)
+        {
+            if (!(names[i - 1] < names[i]))
+                return false;
+        }
+        return true;
+    }
+
+    static_assert(isSorted(BUILT_IN_LAYOUTS), "The built-in layouts must stay sorted for binary search");
+
+    const std::string_view KEYMAP_EXTENSION = ".kbd";
+
+    /**
+     * @brief Result of the last keymap directory scan
+     */
+    struct Cache
+    {
+        std::mutex mutex; // Guards the scan, so lookups may come from several threads
+        std::string path;
+        FileStamp stamp;
+        bool valid = false;
+        std::vector<std::string> names;       // Owns the discovered names
+        std::vector<std::string_view> layouts; // Sorted views of names, or of the built-in table
+    };
+
+    Cache &cache()
+    {
+        static Cache instance;
+        return instance;
+    }
+
+    std::string &keymapPath()
+    {
+        static std::string path = "/usr/share/keyboard";
+        return path;
+    }
+
+    void scan(Cache &entry)
+    {
+        entry.names.clear();
+        entry.layouts.clear();
+        DIR *dir = opendir(entry.path.c_str());
+        if (dir)
+        {
+            while (struct dirent *file = readdir(dir))
+            {
+                std::string_view name = file->d_name;
+                if (name.size() > KEYMAP_EXTENSION.size() &&
+                    name.substr(name.size() - KEYMAP_EXTENSION.size()) == KEYMAP_EXTENSION)
+                {
+                    entry.names.emplace_back(name.substr(0, name.size() - KEYMAP_EXTENSION.size()));
+                }
+            }
+            closedir(dir);
+        }
+
+        if (entry.names.empty())
+        {
+            entry.layouts.assign(BUILT_IN_LAYOUTS.begin(), BUILT_IN_LAYOUTS.end());
+            return;
+        }
+        std::sort(entry.names.begin(), entry.names.end());
+        entry.layouts.assign(entry.names.begin(), entry.names.end());
+    }
+
+    /**
+     * @brief Scan the keymap directory again if it changed; the caller holds the cache mutex
+     */
+    void refresh(Cache &entry)
+    {
+        FileStamp stamp = FileStamp::of(keymapPath());
+        if (!entry.valid || entry.path != keymapPath() || entry.stamp != stamp)
+        {
+            entry.path = keymapPath();
+            entry.stamp = stamp;
+            entry.valid = true;
+            scan(entry);
+        }
+    }
+}
+
+const std::vector<std::string_view> &KeyboardLayouts::getAvailable()
+{
+    Cache &entry = cache();
+    std::lock_guard<std::mutex> lock(entry.mutex);
+    refresh(entry);
+    return entry.layouts;
+}
+
+bool KeyboardLayouts::isAvailable(std::string_view layout)
+{
+    Cache &entry = cache();
+    std::lock_guard<std::mutex> lock(entry.mutex);
+    refresh(entry);
+    return std::binary_search(entry.layouts.begin(), entry.layouts.end(), layout);
+}
+
+void KeyboardLayouts::setKeymapPath(const std::string &path)
+{
+    keymapPath() = path;
+}
+
+const std::string &KeyboardLayouts::getKeymapPath()
+{
+    return keymapPath();
+}
@@ -0,0 +1,55 @@
+#ifndef KEYBOARD_LAYOUTS_HPP
+#define KEYBOARD_LAYOUTS_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Keyboard layouts that can be written to the keymap key of winmgr/globals
+ *
+ * The layouts are the keymap files installed in the keymap directory, one
+ * `<layout>.kbd` file each. The scan is cached and only repeated when the
+ * directory's modification time changes. Without the directory, a built-in table
+ * of the layouts shipped with QNX for the Raspberry Pi is used.
+ */
+namespace KeyboardLayouts
+{
+    /**
+     * @brief Gets the available keyboard layouts
+     *
+     * No allocation happens unless the keymap directory changed since the last call.
+     *
+     * @return The layout names, sorted; valid until the next call that finds the
+     *         keymap directory changed
+     */
+    const std::vector<std::string_view> &getAvailable();
+
+    /**
+     * @brief Checks if a keyboard layout is available, with a binary search
+     * @param layout The layout name (e.g., `en_CA_101`)
+     * @return true if the layout is available, false otherwise
+     *
+     * Safe to call from several threads at once.
+     */
+    bool isAvailable(std::string_view layout);
+
+    /**
+     * @brief Sets the directory holding the installed keymap files
+     *
+     * Defaults to /usr/share/keyboard. Useful to point the lookup at a fixture
+     * directory or at the keymaps of a mounted system image.
+     *
+     * @param path The keymap directory, without trailing slash
+     */
+    void setKeymapPath(const std::string &path);
+
+    /**
+     * @brief Gets the directory holding the installed keymap files
+     * @return The keymap directory, without trailing slash
+     */
+    const std::string &getKeymapPath();
+
+} // namespace KeyboardLayouts
+
+#endif // KEYBOARD_LAYOUTS_HPP
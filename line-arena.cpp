@@ -0,0 +1,63 @@
+#include "line-arena.hpp"
+
+// Room for a typical batch of edits before the arena asks the heap for more
+static const size_t INITIAL_ARENA_SIZE = 4096;
+
+std::shared_ptr<LineArena::Resource> LineArena::makeResource()
+{
+    return std::make_shared<Resource>(INITIAL_ARENA_SIZE);
+}
+
+LineArena::LineArena() : current(makeResource())
+{
+}
+
+LineArena::LineArena(const LineArena &other) : current(makeResource()), retained(other.retained)
+{
+    retained.push_back(other.current);
+}
+
+LineArena &LineArena::operator=(const LineArena &other)
+{
+    if (this != &other)
+    {
+        std::vector<std::shared_ptr<const Resource>> shared = other.retained;
+        shared.push_back(other.current);
+        retained.swap(shared);
+        current = makeResource();
+    }
+    return *this;
+}
+
+std::string_view LineArena::store(std::string_view text)
+{
+    return store({text});
+}
+
+std::string_view LineArena::store(std::initializer_list<std::string_view> parts)
+{
+    size_t total = 0;
+    for (std::string_view part : parts)
+    {
+        total += part.size();
+    }
+    if (total == 0)
+        return std::string_view();
+
+    if (!current)
+        current = makeResource();
+    char *data = static_cast<char *>(current->allocate(total, 1));
+    size_t offset = 0;
+    for (std::string_view part : parts)
+    {
+        part.copy(data + offset, part.size());
+        offset += part.size();
+    }
+    return std::string_view(data, total);
+}
+
+void LineArena::release()
+{
+    retained.clear();
+    current = makeResource();
+}
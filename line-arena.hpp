@@ -0,0 +1,61 @@
+#ifndef LINE_ARENA_HPP
+#define LINE_ARENA_HPP
+
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Append-only storage for the text of edited and inserted lines
+ *
+ * Text is bump-allocated from a std::pmr::monotonic_buffer_resource, so storing
+ * a line costs no heap allocation of its own and nothing is freed until the whole
+ * arena is released. Stored text never moves, so views into it stay valid until then.
+ *
+ * A copy shares the arenas of the original read-only, since the copied lines still
+ * point into them, and gets a fresh arena of its own for new text. Two copies never
+ * allocate from the same arena, so copies can be edited on different threads.
+ */
+class LineArena
+{
+private:
+    using Resource = std::pmr::monotonic_buffer_resource;
+
+    std::shared_ptr<Resource> current;                    // Arena new text is stored in
+    std::vector<std::shared_ptr<const Resource>> retained; // Arenas of the editor this one was copied from
+
+    static std::shared_ptr<Resource> makeResource();
+
+public:
+    LineArena();
+    LineArena(const LineArena &other);
+    LineArena &operator=(const LineArena &other);
+    LineArena(LineArena &&other) noexcept = default;
+    LineArena &operator=(LineArena &&other) noexcept = default;
+
+    /**
+     * @brief Copy text into the arena
+     * @param text Text to store
+     * @return View of the stored copy
+     */
+    std::string_view store(std::string_view text);
+
+    /**
+     * @brief Store the concatenation of several pieces, without building a temporary string
+     * @param parts Pieces to concatenate, in order
+     * @return View of the stored text
+     */
+    std::string_view store(std::initializer_list<std::string_view> parts);
+
+    /**
+     * @brief Free all stored text, including text shared from copied editors
+     *
+     * Any view previously returned by store() is invalid afterwards.
+     */
+    void release();
+};
+
+#endif // LINE_ARENA_HPP
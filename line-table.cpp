@@ -0,0 +1,369 @@
+#include "line-table.hpp"
+#include <algorithm>
+#include <tuple>
+
+// Gap between the ids of neighbouring lines after assign() or a relabel
+static const LineId ID_SPACING = LineId(1) << 32;
+// Largest gap an insert takes, so repeated inserts at one spot keep finding room
+static const LineId MAX_INSERT_STEP = LineId(1) << 16;
+
+void LineTable::rebuildTree()
+{
+    tree.assign(chunks.size() + 1, 0);
+    byteTree.assign(chunks.size() + 1, 0);
+    totalBytes = 0;
+    for (size_t i = 1; i <= chunks.size(); ++i)
+    {
+        tree[i] += chunks[i - 1]->texts.size();
+        byteTree[i] += chunks[i - 1]->bytes;
+        totalBytes += chunks[i - 1]->bytes;
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= chunks.size())
+        {
+            tree[parent] += tree[i];
+            byteTree[parent] += byteTree[i];
+        }
+    }
+}
+
+void LineTable::resizeChunk(size_t chunkIndex, std::ptrdiff_t delta)
+{
+    for (size_t i = chunkIndex + 1; i < tree.size(); i += i & (~i + 1))
+    {
+        tree[i] += static_cast<size_t>(delta);
+    }
+    count += static_cast<size_t>(delta);
+}
+
+void LineTable::resizeChunkBytes(size_t chunkIndex, std::ptrdiff_t delta)
+{
+    chunks[chunkIndex]->bytes += static_cast<size_t>(delta);
+    for (size_t i = chunkIndex + 1; i < byteTree.size(); i += i & (~i + 1))
+    {
+        byteTree[i] += static_cast<size_t>(delta);
+    }
+    totalBytes += static_cast<size_t>(delta);
+}
+
+size_t LineTable::chunkStart(size_t chunkIndex) const
+{
+    size_t start = 0;
+    for (size_t i = chunkIndex; i > 0; i -= i & (~i + 1))
+    {
+        start += tree[i];
+    }
+    return start;
+}
+
+std::pair<size_t, size_t> LineTable::locate(size_t position) const
+{
+    // Descend the Fenwick tree to the last chunk starting at or before the position
+    size_t chunkIndex = 0;
+    size_t remaining = position;
+    size_t step = 1;
+    while (step * 2 < tree.size())
+        step *= 2;
+    for (; step > 0; step /= 2)
+    {
+        size_t next = chunkIndex + step;
+        if (next < tree.size() && tree[next] <= remaining)
+        {
+            chunkIndex = next;
+            remaining -= tree[next];
+        }
+    }
+    return {chunkIndex, remaining};
+}
+
+size_t LineTable::chunkOf(LineId id) const
+{
+    // Chunks are ordered by id, so take the last one whose first id is not past it
+    auto it = std::upper_bound(chunks.begin(), chunks.end(), id,
+                               [](LineId value, const std::shared_ptr<Chunk> &chunk)
+                               { return value < chunk->ids.front(); });
+    return it == chunks.begin() ? 0 : static_cast<size_t>(it - chunks.begin()) - 1;
+}
+
+LineTable::Chunk &LineTable::mutableChunk(size_t chunkIndex)
+{
+    std::shared_ptr<Chunk> &chunk = chunks[chunkIndex];
+    if (chunk.use_count() > 1)
+        chunk = std::make_shared<Chunk>(*chunk);
+    return *chunk;
+}
+
+void LineTable::splitChunk(size_t chunkIndex)
+{
+    Chunk &full = mutableChunk(chunkIndex);
+    size_t half = full.texts.size() / 2;
+
+    auto second = std::make_shared<Chunk>();
+    second->texts.assign(full.texts.begin() + half, full.texts.end());
+    second->ids.assign(full.ids.begin() + half, full.ids.end());
+    full.texts.resize(half);
+    full.ids.resize(half);
+    for (std::string_view text : second->texts)
+        second->bytes += text.size() + 1;
+    full.bytes -= second->bytes;
+
+    chunks.insert(chunks.begin() + chunkIndex + 1, std::move(second));
+    rebuildTree();
+}
+
+void LineTable::relabel()
+{
+    LineId next = ID_SPACING;
+    for (size_t chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex)
+    {
+        for (LineId &id : mutableChunk(chunkIndex).ids)
+        {
+            id = next;
+            next += ID_SPACING;
+        }
+    }
+    ++relabels;
+}
+
+bool LineTable::pickIds(LineId before, LineId after, size_t needed, std::vector<LineId> &ids)
+{
+    LineId step = std::min((after - before) / (needed + 1), MAX_INSERT_STEP);
+    if (step == 0)
+        return false;
+    for (size_t i = 1; i <= needed; ++i)
+    {
+        ids.push_back(before + step * i);
+    }
+    return true;
+}
+
+void LineTable::assign(const std::vector<std::string_view> &lines)
+{
+    chunks.clear();
+    // Fill chunks to half so the first inserts do not split them right away
+    const size_t fill = MAX_CHUNK_LINES / 2;
+    LineId next = ID_SPACING;
+    for (size_t start = 0; start < lines.size(); start += fill)
+    {
+        size_t end = std::min(start + fill, lines.size());
+        auto chunk = std::make_shared<Chunk>();
+        chunk->texts.assign(lines.begin() + start, lines.begin() + end);
+        chunk->ids.reserve(end - start);
+        for (size_t i = start; i < end; ++i)
+        {
+            chunk->ids.push_back(next);
+            next += ID_SPACING;
+            chunk->bytes += lines[i].size() + 1;
+        }
+        chunks.push_back(std::move(chunk));
+    }
+    count = lines.size();
+    rebuildTree();
+}
+
+std::string_view LineTable::operator[](size_t position) const
+{
+    auto found = locate(position);
+    return chunks[found.first]->texts[found.second];
+}
+
+size_t LineTable::bytesBefore(size_t position) const
+{
+    if (position >= count)
+        return totalBytes;
+    auto found = locate(position);
+    size_t bytes = 0;
+    for (size_t i = found.first; i > 0; i -= i & (~i + 1))
+    {
+        bytes += byteTree[i];
+    }
+    const std::vector<std::string_view> &texts = chunks[found.first]->texts;
+    for (size_t i = 0; i < found.second; ++i)
+    {
+        bytes += texts[i].size() + 1;
+    }
+    return bytes;
+}
+
+LineTable::const_iterator LineTable::iteratorAt(size_t position) const
+{
+    if (position >= count)
+        return end();
+    auto found = locate(position);
+    return const_iterator(this, found.first, found.second);
+}
+
+LineId LineTable::idAt(size_t position) const
+{
+    if (position >= count)
+        return END;
+    auto found = locate(position);
+    return chunks[found.first]->ids[found.second];
+}
+
+size_t LineTable::positionOf(LineId id) const
+{
+    if (id == END)
+        return count;
+    size_t chunkIndex = chunkOf(id);
+    const std::vector<LineId> &ids = chunks[chunkIndex]->ids;
+    return chunkStart(chunkIndex) + static_cast<size_t>(std::lower_bound(ids.begin(), ids.end(), id) - ids.begin());
+}
+
+std::string_view LineTable::text(LineId id) const
+{
+    const Chunk &chunk = *chunks[chunkOf(id)];
+    return chunk.texts[static_cast<size_t>(std::lower_bound(chunk.ids.begin(), chunk.ids.end(), id) - chunk.ids.begin())];
+}
+
+void LineTable::set(size_t position, std::string_view text)
+{
+    auto found = locate(position);
+    std::string_view &line = mutableChunk(found.first).texts[found.second];
+    resizeChunkBytes(found.first, static_cast<std::ptrdiff_t>(text.size()) - static_cast<std::ptrdiff_t>(line.size()));
+    line = text;
+}
+
+std::vector<LineId> LineTable::insert(const std::vector<size_t> &insertedAt, const std::vector<std::string_view> &texts)
+{
+    std::vector<LineId> ids;
+    ids.reserve(texts.size());
+    if (texts.empty())
+        return ids;
+
+    bool room = true;
+    if (texts.size() * MAX_CHUNK_LINES < count || chunks.empty())
+    {
+        // Few lines: insert each into its chunk
+        for (size_t k = 0; k < texts.size(); ++k)
+        {
+            size_t position = insertedAt[k] + k;
+            LineId before = position > 0 ? idAt(position - 1) : 0;
+            if (!room || !pickIds(before, idAt(position), 1, ids))
+            {
+                room = false;
+                ids.push_back(before); // Placeholder until the relabel below
+            }
+
+            size_t chunkIndex = 0, offset = 0;
+            if (chunks.empty())
+            {
+                chunks.push_back(std::make_shared<Chunk>());
+                rebuildTree();
+            }
+            else if (position == count)
+            {
+                chunkIndex = chunks.size() - 1;
+                offset = chunks[chunkIndex]->texts.size();
+            }
+            else
+            {
+                std::tie(chunkIndex, offset) = locate(position);
+            }
+
+            Chunk &chunk = mutableChunk(chunkIndex);
+            chunk.texts.insert(chunk.texts.begin() + offset, texts[k]);
+            chunk.ids.insert(chunk.ids.begin() + offset, ids.back());
+            resizeChunk(chunkIndex, 1);
+            resizeChunkBytes(chunkIndex, static_cast<std::ptrdiff_t>(texts[k].size() + 1));
+            if (chunk.texts.size() > MAX_CHUNK_LINES)
+                splitChunk(chunkIndex);
+        }
+    }
+    else
+    {
+        // Many lines: merge them into freshly built chunks in one pass
+        std::vector<std::string_view> mergedTexts;
+        std::vector<LineId> mergedIds;
+        mergedTexts.reserve(count + texts.size());
+        mergedIds.reserve(count + texts.size());
+
+        size_t next = 0;
+        size_t position = 0;
+        LineId previous = 0;
+        auto insertRun = [&](LineId following)
+        {
+            size_t runStart = next;
+            while (next < texts.size() && insertedAt[next] == position)
+                ++next;
+            if (next == runStart)
+                return;
+            std::vector<LineId> runIds;
+            if (!pickIds(previous, following, next - runStart, runIds))
+            {
+                room = false;
+                runIds.assign(next - runStart, previous);
+            }
+            for (size_t k = runStart; k < next; ++k)
+            {
+                mergedTexts.push_back(texts[k]);
+                mergedIds.push_back(runIds[k - runStart]);
+                ids.push_back(runIds[k - runStart]);
+            }
+        };
+
+        for (const auto &chunk : chunks)
+        {
+            for (size_t i = 0; i < chunk->texts.size(); ++i, ++position)
+            {
+                insertRun(chunk->ids[i]);
+                mergedTexts.push_back(chunk->texts[i]);
+                mergedIds.push_back(chunk->ids[i]);
+                previous = chunk->ids[i];
+            }
+        }
+        insertRun(END);
+
+        assign(mergedTexts);
+        if (room)
+        {
+            // assign() gave out fresh ids; put the kept and picked ones back
+            size_t i = 0;
+            for (size_t chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex)
+            {
+                for (LineId &id : chunks[chunkIndex]->ids)
+                    id = mergedIds[i++];
+            }
+            return ids;
+        }
+        ++relabels;
+        for (size_t k = 0; k < texts.size(); ++k)
+            ids[k] = idAt(insertedAt[k] + k);
+        return ids;
+    }
+
+    if (!room)
+    {
+        relabel();
+        for (size_t k = 0; k < texts.size(); ++k)
+            ids[k] = idAt(insertedAt[k] + k);
+    }
+    return ids;
+}
+
+void LineTable::erase(size_t position)
+{
+    auto found = locate(position);
+    Chunk &chunk = mutableChunk(found.first);
+    resizeChunkBytes(found.first, -static_cast<std::ptrdiff_t>(chunk.texts[found.second].size() + 1));
+    chunk.texts.erase(chunk.texts.begin() + found.second);
+    chunk.ids.erase(chunk.ids.begin() + found.second);
+    if (chunk.texts.empty())
+    {
+        chunks.erase(chunks.begin() + found.first);
+        --count;
+        rebuildTree();
+    }
+    else
+    {
+        resizeChunk(found.first, -1);
+    }
+}
+
+void LineTable::clear()
+{
+    chunks.clear();
+    tree.assign(1, 0);
+    byteTree.assign(1, 0);
+    count = 0;
+    totalBytes = 0;
+}
@@ -0,0 +1,299 @@
+#ifndef LINE_TABLE_HPP
+#define LINE_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Stable identifier of a line in a LineTable
+ *
+ * Ids increase from the first line to the last, so comparing ids compares line
+ * positions, and they do not change when lines are inserted or removed elsewhere.
+ */
+using LineId = uint64_t;
+
+/**
+ * @brief Ordered sequence of line views, stored as a chunked rope
+ *
+ * Lines are kept in chunks of at most MAX_CHUNK_LINES lines, with Fenwick trees
+ * over the chunk sizes in lines and in bytes. Finding a line by position, inserting
+ * and removing a line cost O(log n) plus moving the lines of one chunk, instead of
+ * shifting the whole table, and so does finding the file offset of a line.
+ *
+ * Every line carries a LineId, so indexes can refer to lines without being
+ * renumbered on every insert. An insert that finds no free id between its
+ * neighbours reassigns all ids and bumps generation().
+ *
+ * Chunks are shared copy-on-write, so copying a table costs O(n / MAX_CHUNK_LINES)
+ * and editing a copy only clones the chunks it touches.
+ */
+class LineTable
+{
+public:
+    static const LineId END = UINT64_MAX;       // Id of the position past the last line
+    static const size_t MAX_CHUNK_LINES = 512;
+
+private:
+    struct Chunk
+    {
+        std::vector<std::string_view> texts;
+        std::vector<LineId> ids;
+        size_t bytes = 0; // Size of the texts, each with its newline
+    };
+
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    std::vector<size_t> tree;     // Fenwick tree over chunk sizes, 1-based
+    std::vector<size_t> byteTree; // Fenwick tree over chunk bytes, 1-based
+    size_t count = 0;
+    size_t totalBytes = 0;
+    size_t relabels = 0;
+
+    /**
+     * @brief Rebuild the Fenwick tree after chunks were added or removed
+     */
+    void rebuildTree();
+
+    /**
+     * @brief Record a change in the size of a chunk
+     * @param chunkIndex Index of the chunk
+     * @param delta Number of lines added, negative for removed lines
+     */
+    void resizeChunk(size_t chunkIndex, std::ptrdiff_t delta);
+
+    /**
+     * @brief Record a change in the bytes of a chunk
+     * @param chunkIndex Index of the chunk, already owned by this table alone
+     * @param delta Number of bytes added, negative for removed bytes
+     */
+    void resizeChunkBytes(size_t chunkIndex, std::ptrdiff_t delta);
+
+    /**
+     * @brief Get the position of the first line of a chunk
+     * @param chunkIndex Index of the chunk
+     * @return Number of lines in all chunks before it
+     */
+    size_t chunkStart(size_t chunkIndex) const;
+
+    /**
+     * @brief Find the chunk holding a position
+     * @param position Line position, less than size()
+     * @return Chunk index and offset of the line within the chunk
+     */
+    std::pair<size_t, size_t> locate(size_t position) const;
+
+    /**
+     * @brief Find the chunk holding an id
+     * @param id Id of an existing line
+     * @return Chunk index
+     */
+    size_t chunkOf(LineId id) const;
+
+    /**
+     * @brief Get a chunk for writing, cloning it first if a copy shares it
+     * @param chunkIndex Index of the chunk
+     * @return Chunk owned by this table alone
+     */
+    Chunk &mutableChunk(size_t chunkIndex);
+
+    /**
+     * @brief Split a chunk that grew past MAX_CHUNK_LINES in two
+     * @param chunkIndex Index of the chunk
+     */
+    void splitChunk(size_t chunkIndex);
+
+    /**
+     * @brief Spread all ids evenly again
+     */
+    void relabel();
+
+    /**
+     * @brief Pick ids for lines inserted between two neighbours
+     * @param before Id of the line before, 0 if none
+     * @param after Id of the line after, END if none
+     * @param needed Number of ids to pick
+     * @param ids Receives the ids, ascending
+     * @return true if there was room, false if the table has to be relabeled
+     */
+    static bool pickIds(LineId before, LineId after, size_t needed, std::vector<LineId> &ids);
+
+public:
+    /**
+     * @brief Forward iterator over the line texts in order
+     */
+    class const_iterator
+    {
+    private:
+        const LineTable *table = nullptr;
+        size_t chunk = 0;
+        size_t offset = 0;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string_view *;
+        using reference = const std::string_view &;
+
+        const_iterator() = default;
+        const_iterator(const LineTable *owner, size_t chunkIndex, size_t lineOffset)
+            : table(owner), chunk(chunkIndex), offset(lineOffset) {}
+
+        reference operator*() const { return table->chunks[chunk]->texts[offset]; }
+        pointer operator->() const { return &**this; }
+
+        /**
+         * @brief Get the id of the current line
+         * @return Line id
+         */
+        LineId id() const { return table->chunks[chunk]->ids[offset]; }
+
+        const_iterator &operator++()
+        {
+            if (++offset == table->chunks[chunk]->texts.size())
+            {
+                ++chunk;
+                offset = 0;
+            }
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const const_iterator &other) const { return chunk == other.chunk && offset == other.offset; }
+        bool operator!=(const const_iterator &other) const { return !(*this == other); }
+    };
+
+    /**
+     * @brief Replace the contents with the given lines, assigning fresh ids
+     * @param lines Line views in order
+     */
+    void assign(const std::vector<std::string_view> &lines);
+
+    /**
+     * @brief Get the number of lines
+     * @return Number of lines
+     */
+    size_t size() const { return count; }
+
+    /**
+     * @brief Check whether the table holds no lines
+     * @return true if empty
+     */
+    bool empty() const { return count == 0; }
+
+    /**
+     * @brief Get the size of all lines as written to a file
+     * @return Bytes of all lines, each followed by a newline
+     */
+    size_t byteSize() const { return totalBytes; }
+
+    /**
+     * @brief Get the file offset of a line
+     * @param position Line position; size() gives byteSize()
+     * @return Bytes of the lines before it, each followed by a newline
+     */
+    size_t bytesBefore(size_t position) const;
+
+    /**
+     * @brief Get the text of a line by position
+     * @param position Line position, less than size()
+     * @return Line text
+     */
+    std::string_view operator[](size_t position) const;
+
+    /**
+     * @brief Get the id of a line by position
+     * @param position Line position; size() gives END
+     * @return Line id
+     */
+    LineId idAt(size_t position) const;
+
+    /**
+     * @brief Get the position of a line by id
+     * @param id Id of an existing line, or END
+     * @return Line position; size() for END
+     */
+    size_t positionOf(LineId id) const;
+
+    /**
+     * @brief Get the text of a line by id
+     * @param id Id of an existing line
+     * @return Line text
+     */
+    std::string_view text(LineId id) const;
+
+    /**
+     * @brief Replace the text of a line
+     * @param position Line position, less than size()
+     * @param text New line text
+     */
+    void set(size_t position, std::string_view text);
+
+    /**
+     * @brief Insert lines at several positions at once
+     * @param insertedAt Sorted positions, before any insertion, each line is inserted before
+     * @param texts Text of each new line
+     * @return Ids of the new lines
+     *
+     * Large batches are merged into the table in a single pass; small ones are
+     * inserted one by one.
+     */
+    std::vector<LineId> insert(const std::vector<size_t> &insertedAt, const std::vector<std::string_view> &texts);
+
+    /**
+     * @brief Remove a line
+     * @param position Line position, less than size()
+     */
+    void erase(size_t position);
+
+    /**
+     * @brief Remove all lines
+     */
+    void clear();
+
+    /**
+     * @brief Count how often ids were reassigned; any stored ids are stale once it changes
+     * @return Relabel count
+     */
+    size_t generation() const { return relabels; }
+
+    /**
+     * @brief Replace the text of every line
+     * @param update Function called with each line's text in order, returning the new text
+     */
+    template <typename Function>
+    void transform(Function update)
+    {
+        for (size_t chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex)
+        {
+            Chunk &chunk = mutableChunk(chunkIndex);
+            chunk.bytes = 0;
+            for (std::string_view &line : chunk.texts)
+            {
+                line = update(line);
+                chunk.bytes += line.size() + 1;
+            }
+        }
+        rebuildTree();
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0, 0); }
+    const_iterator end() const { return const_iterator(this, chunks.size(), 0); }
+
+    /**
+     * @brief Get an iterator to a line by position
+     * @param position Line position; size() gives end()
+     * @return Iterator to the line
+     */
+    const_iterator iteratorAt(size_t position) const;
+};
+
+#endif // LINE_TABLE_HPP
@@ -0,0 +1,62 @@
+#include "network-config.hpp"
+
+NetworkConfig::NetworkConfig(const std::string &filename) : path(filename)
+{
+    editor.setDialect(ConfigDialect::FlatKeyValue);
+    // The store lives as long as the program; undo steps would only hold on to old text
+    editor.setHistoryLimit(0);
+}
+
+bool NetworkConfig::refresh()
+{
+    FileStamp current = FileStamp::of(path);
+    if (loaded && current == stamp)
+        return current.exists;
+
+    loaded = false;
+    if (!current.exists)
+    {
+        // Start from an empty file so set() can create it, and remember that it
+        // is missing so the next lookup does not retry the read
+        editor.loadBuffer(path, FileBuffer::copyOf(std::string_view()));
+        stamp = current;
+        loaded = true;
+        return false;
+    }
+
+    if (!editor.loadFile(path))
+        return false;
+    stamp = current;
+    loaded = true;
+    return true;
+}
+
+std::string NetworkConfig::get(std::string_view key)
+{
+    if (!refresh())
+        return std::string();
+    return editor.getValue(SectionPath(), key);
+}
+
+bool NetworkConfig::exists()
+{
+    return refresh();
+}
+
+bool NetworkConfig::set(const std::string &key, const std::string &value)
+{
+    if (!refresh() && !loaded)
+        return false; // The file exists but could not be read
+    if (!editor.setValue(SectionPath(), key, value) || !editor.saveFile(path))
+    {
+        loaded = false; // The editor no longer matches the file; read it again next time
+        return false;
+    }
+    stamp = FileStamp::of(path);
+    return true;
+}
+
+void NetworkConfig::setSyncOnSave(bool sync)
+{
+    editor.setSyncOnSave(sync);
+}
@@ -0,0 +1,72 @@
+#ifndef NETWORK_CONFIG_HPP
+#define NETWORK_CONFIG_HPP
+
+#include "config-editor.hpp"
+#include "file-buffer.hpp"
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Keyed KEY=VALUE store for /boot/network
+ *
+ * The file is loaded once into a ConfigEditor in the FlatKeyValue dialect and only
+ * read again when its stamp changes, so repeated lookups cost a single stat(). As
+ * in the shell scripts that source the file, the last assignment of a key is the
+ * one in effect.
+ *
+ * set() rewrites that assignment in place, exactly like an edit staged through
+ * Workspace, instead of appending a line on every change as older versions of this
+ * utility did. The file is replaced atomically.
+ */
+class NetworkConfig
+{
+private:
+    std::string path;
+    FileStamp stamp; // Of the file the editor was loaded from
+    bool loaded = false;
+    ConfigEditor editor;
+
+    /**
+     * @brief Read the file again if it changed since it was last read or written
+     * @return true if the editor is current, false if the file is missing or could not be read
+     */
+    bool refresh();
+
+public:
+    /**
+     * @brief Constructor; the file is read on first use
+     * @param filename Path to the network configuration
+     */
+    explicit NetworkConfig(const std::string &filename = "/boot/network");
+
+    /**
+     * @brief Get the value of a key
+     * @param key The key, e.g. HOSTNAME
+     * @return The value of its last assignment, or an empty string if the key or the file is missing
+     */
+    std::string get(std::string_view key);
+
+    /**
+     * @brief Check whether the file could be read
+     * @return true if the file exists and was read
+     */
+    bool exists();
+
+    /**
+     * @brief Set a key, replacing its assignment in place or appending one, and save the file
+     * @param key The key, e.g. HOSTNAME
+     * @param value The new value
+     * @return true if the file was written, false otherwise
+     *
+     * A missing file is created with just this assignment.
+     */
+    bool set(const std::string &key, const std::string &value);
+
+    /**
+     * @brief Choose whether set() flushes the file to disk
+     * @param sync If true (the default), fsync the file and its directory
+     */
+    void setSyncOnSave(bool sync);
+};
+
+#endif // NETWORK_CONFIG_HPP
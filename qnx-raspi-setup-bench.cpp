@@ -0,0 +1,830 @@
+#include "config-editor.hpp"
+#include "display-modes.hpp"
+#include "fat32-image.hpp"
+#include "fleet.hpp"
+#include "keyboard-layouts.hpp"
+#include "network-config.hpp"
+#include "setup-utils.hpp"
+#include "system-ops.hpp"
+#include "timezone-helper.hpp"
+#include "work-stealing-pool.hpp"
+#include "workspace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Benchmarks for the parts of the setup utility that are called at scale.
+ *
+ * Synthetic graphics configurations from a few KB to tens of MB are generated
+ * into a temporary directory, together with a fixture zoneinfo tree, and each
+ * operation is timed over repeated runs. Heap allocations made by each run are
+ * counted through a replaced global operator new. Results are written as JSON so
+ * runs can be compared.
+ *
+ * Usage: qnx-raspi-setup-bench [--quick] [--output results.json]
+ */
+
+namespace
+{
+    std::atomic<size_t> allocationCount{0};
+}
+
+void *operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace
+{
+    struct Result
+    {
+        std::string name;
+        std::string variant;
+        size_t bytes;
+        size_t iterations;
+        double minNs;
+        double medianNs;
+        double meanNs;
+        double allocations; // Heap allocations per run
+    };
+
+    std::vector<Result> results;
+    bool checksFailed = false;
+
+    /**
+     * @brief Report a wrong result of an operation the benchmark relies on
+     * @param ok Whether the result was as expected
+     * @param what Description of the check
+     *
+     * A failed check makes the benchmark exit with an error once it is done.
+     */
+    void check(bool ok, const std::string &what)
+    {
+        if (!ok)
+        {
+            std::cerr << "Error: Check failed: " << what << std::endl;
+            checksFailed = true;
+        }
+    }
+
+    /**
+     * @brief Time an operation until it ran for long enough to give a stable figure
+     * @param name Operation name, e.g. "ConfigEditor::loadFile"
+     * @param variant Variant of the operation, e.g. "mapped"
+     * @param bytes Size of the input the operation works on
+     * @param operation Operation to time
+     * @param setup Optional untimed preparation run before every iteration
+     */
+    void measure(const std::string &name, const std::string &variant, size_t bytes,
+                 const std::function<void()> &operation, const std::function<void()> &setup = nullptr)
+    {
+        using Clock = std::chrono::steady_clock;
+        const auto budget = std::chrono::milliseconds(300);
+        const size_t minIterations = 3;
+        const size_t maxIterations = 100000;
+
+        std::vector<double> samples;
+        samples.reserve(maxIterations);
+        size_t allocations = 0;
+        Clock::duration spent{};
+        while (samples.size() < minIterations || (spent < budget && samples.size() < maxIterations))
+        {
+            if (setup)
+                setup();
+            size_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+            auto start = Clock::now();
+            operation();
+            auto elapsed = Clock::now() - start;
+            allocations += allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+            spent += elapsed;
+            samples.push_back(std::chrono::duration<double, std::nano>(elapsed).count());
+        }
+
+        std::sort(samples.begin(), samples.end());
+        double total = 0;
+        for (double sample : samples)
+            total += sample;
+
+        results.push_back({name, variant, bytes, samples.size(), samples.front(),
+                           samples[samples.size() / 2], total / samples.size(),
+                           static_cast<double>(allocations) / samples.size()});
+        std::cerr << name << " [" << variant << ", " << bytes << " bytes]: "
+                  << samples[samples.size() / 2] / 1000.0 << " us median over "
+                  << samples.size() << " runs, " << results.back().allocations
+                  << " allocations per run" << std::endl;
+    }
+
+    /**
+     * @brief Write a synthetic graphics configuration of roughly the given size
+     *
+     * The file has deeply nested filler sections full of keys and comments, and ends
+     * with the winmgr/globals and winmgr/display 1 sections SetupUtils edits, so
+     * lookups have to get past all of the filler.
+     *
+     * @param filename Path of the file to write
+     * @param targetBytes Approximate size of the file
+     * @param depth Nesting depth of the filler sections
+     */
+    void generateConfig(const std::string &filename, size_t targetBytes, int depth)
+    {
+        std::ostringstream out;
+        out << "# Synthetic graphics configuration for benchmarking\n";
+        size_t block = 0;
+        while (static_cast<size_t>(out.tellp()) < targetBytes)
+        {
+            std::string indent;
+            for (int level = 0; level < depth; ++level)
+            {
+                out << indent << "begin block " << block << "." << level << "\n";
+                indent += "    ";
+            }
+            for (int key = 0; key < 8; ++key)
+            {
+                out << indent << "# Setting " << key << " of block " << block << "\n";
+                out << indent << "setting-" << key << " = value " << block << " " << key << "\n";
+            }
+            for (int level = depth - 1; level >= 0; --level)
+            {
+                indent.resize(indent.size() - 4);
+                out << indent << "end block " << block << "." << level << "\n";
+            }
+            ++block;
+        }
+        out << "begin winmgr\n"
+            << "    begin globals\n"
+            << "        blit-config = rpi4\n"
+            << "        keymap = en_US_101\n"
+            << "    end globals\n"
+            << "    begin display 1\n"
+            << "        formats = rgba8888\n"
+            << "        video-mode = 1280 x 720 @ 60\n"
+            << "    end display\n"
+            << "end winmgr\n";
+
+        std::ofstream file(filename);
+        file << out.str();
+    }
+
+    /**
+     * @brief Write an EDID like a 4K TV's: a base block with a 1080p detailed timing
+     *        and a CTA-861 extension listing every video code the parser knows
+     * @param filename File to write
+     */
+    void generateEdid(const std::string &filename)
+    {
+        std::string blob(256, '\0');
+        const unsigned char header[8] = {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+        std::copy(header, header + 8, blob.begin());
+        blob[35] = '\x21'; // 640x480@60, 800x600@60
+        blob[36] = '\x08'; // 1024x768@60
+        for (size_t i = 38; i < 54; ++i)
+            blob[i] = '\x01'; // No standard timings
+        const unsigned char detailed[18] = {0x02, 0x3A, 0x80, 0x18, 0x71, 0x38, 0x2D, 0x40}; // 1920x1080@60
+        std::copy(detailed, detailed + 18, blob.begin() + 54);
+        blob[126] = 1;
+
+        const unsigned char codes[] = {144, 97, 96, 95, 4, 19, 31, 32, 33, 34, 1, 2, 3, 17, 18, 63, 64, 102};
+        blob[128] = '\x02';
+        blob[129] = '\x03';
+        blob[130] = static_cast<char>(5 + sizeof(codes));
+        blob[132] = static_cast<char>(2 << 5 | sizeof(codes)); // Video data block
+        std::copy(codes, codes + sizeof(codes), blob.begin() + 133);
+
+        for (size_t block = 0; block < blob.size(); block += 128)
+        {
+            unsigned sum = 0;
+            for (size_t i = block; i < block + 127; ++i)
+                sum += static_cast<unsigned char>(blob[i]);
+            blob[block + 127] = static_cast<char>(-sum & 0xFF);
+        }
+        std::ofstream(filename, std::ios::binary) << blob;
+    }
+
+    // Geometry of the FAT32 volume written by generateFat32Image()
+    const size_t FAT_SECTOR_SIZE = 512;
+    const size_t FAT_RESERVED_SECTORS = 32;
+    const size_t FAT_COPIES = 2;
+    const size_t FAT_SECTORS = 64;
+    const size_t FAT_TOTAL_SECTORS = 8192;
+    const size_t FAT_CLUSTERS = FAT_TOTAL_SECTORS - FAT_RESERVED_SECTORS - FAT_COPIES * FAT_SECTORS;
+
+    void putLe(std::string &bytes, size_t offset, uint32_t value, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+            bytes[offset + i] = static_cast<char>(value >> (8 * i) & 0xFF);
+    }
+
+    uint32_t getLe32(const std::string &bytes, size_t offset)
+    {
+        uint32_t value = 0;
+        for (size_t i = 4; i-- > 0;)
+            value = value << 8 | static_cast<unsigned char>(bytes[offset + i]);
+        return value;
+    }
+
+    /**
+     * @brief Write a bare 4 MiB FAT32 volume with one-sector clusters, holding
+     *        CONFIG.TXT and NETWORK in the root directory
+     * @param filename File to write
+     * @param config Contents of CONFIG.TXT, at most one cluster
+     * @param network Contents of NETWORK, at most one cluster
+     */
+    void generateFat32Image(const std::string &filename, const std::string &config, const std::string &network)
+    {
+        std::string volume(FAT_TOTAL_SECTORS * FAT_SECTOR_SIZE, '\0');
+        volume.replace(0, 11, "\xEB\x58\x90MSWIN4.1");
+        putLe(volume, 11, FAT_SECTOR_SIZE, 2);
+        volume[13] = 1; // Sectors per cluster
+        putLe(volume, 14, FAT_RESERVED_SECTORS, 2);
+        volume[16] = static_cast<char>(FAT_COPIES);
+        volume[21] = '\xF8';
+        putLe(volume, 32, FAT_TOTAL_SECTORS, 4);
+        putLe(volume, 36, FAT_SECTORS, 4);
+        putLe(volume, 44, 2, 4); // Root directory cluster
+        putLe(volume, 48, 1, 2); // FSInfo sector
+        volume.replace(82, 8, "FAT32   ");
+        putLe(volume, 510, 0xAA55, 2);
+
+        size_t fsInfo = FAT_SECTOR_SIZE;
+        putLe(volume, fsInfo, 0x41615252, 4);
+        putLe(volume, fsInfo + 484, 0x61417272, 4);
+        putLe(volume, fsInfo + 488, static_cast<uint32_t>(FAT_CLUSTERS - 3), 4);
+        putLe(volume, fsInfo + 492, 5, 4);
+        putLe(volume, fsInfo + 508, 0xAA550000, 4);
+
+        // Clusters 2, 3 and 4 hold the root directory and the two files
+        const uint32_t fat[] = {0x0FFFFFF8, 0x0FFFFFFF, 0x0FFFFFFF, 0x0FFFFFFF, 0x0FFFFFFF};
+        for (size_t copy = 0; copy < FAT_COPIES; ++copy)
+        {
+            size_t offset = (FAT_RESERVED_SECTORS + copy * FAT_SECTORS) * FAT_SECTOR_SIZE;
+            for (size_t i = 0; i < 5; ++i)
+                putLe(volume, offset + 4 * i, fat[i], 4);
+        }
+        auto cluster = [](uint32_t number)
+        { return (FAT_RESERVED_SECTORS + FAT_COPIES * FAT_SECTORS + number - 2) * FAT_SECTOR_SIZE; };
+        const struct
+        {
+            const char *name;
+            uint32_t firstCluster;
+            const std::string &contents;
+        } files[] = {{"CONFIG  TXT", 3, config}, {"NETWORK    ", 4, network}};
+        for (size_t i = 0; i < 2; ++i)
+        {
+            size_t entry = cluster(2) + 32 * i;
+            volume.replace(entry, 11, files[i].name);
+            volume[entry + 11] = 0x20; // Archive
+            putLe(volume, entry + 26, files[i].firstCluster, 2);
+            putLe(volume, entry + 28, static_cast<uint32_t>(files[i].contents.size()), 4);
+            volume.replace(cluster(files[i].firstCluster), files[i].contents.size(), files[i].contents);
+        }
+        std::ofstream(filename, std::ios::binary) << volume;
+    }
+
+    /**
+     * @brief Check that the FAT copies of a generateFat32Image() volume agree
+     *        and that the free count in FSInfo matches the FAT
+     */
+    bool isFat32Consistent(const std::string &filename)
+    {
+        std::ifstream in(filename, std::ios::binary);
+        std::string volume((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (volume.size() != FAT_TOTAL_SECTORS * FAT_SECTOR_SIZE)
+            return false;
+        size_t fatBytes = FAT_SECTORS * FAT_SECTOR_SIZE;
+        size_t firstFat = FAT_RESERVED_SECTORS * FAT_SECTOR_SIZE;
+        for (size_t copy = 1; copy < FAT_COPIES; ++copy)
+        {
+            if (volume.compare(firstFat + copy * fatBytes, fatBytes, volume, firstFat, fatBytes) != 0)
+                return false;
+        }
+        uint32_t free = 0;
+        for (size_t cluster = 2; cluster < FAT_CLUSTERS + 2; ++cluster)
+        {
+            if ((getLe32(volume, firstFat + 4 * cluster) & 0x0FFFFFFF) == 0)
+                ++free;
+        }
+        return getLe32(volume, FAT_SECTOR_SIZE + 488) == free;
+    }
+
+    /**
+     * @brief Create a fixture zoneinfo tree of regions full of TZif files
+     * @param root Directory to create the tree in
+     * @param regions Number of region directories
+     * @param zonesPerRegion Number of zone files per region
+     */
+    void generateZoneinfo(const std::string &root, int regions, int zonesPerRegion)
+    {
+        mkdir(root.c_str(), 0755);
+        for (int region = 0; region < regions; ++region)
+        {
+            std::string regionDir = root + "/Region" + std::to_string(region);
+            mkdir(regionDir.c_str(), 0755);
+            for (int zone = 0; zone < zonesPerRegion; ++zone)
+            {
+                std::ofstream file(regionDir + "/Zone" + std::to_string(zone), std::ios::binary);
+                file << "TZif2" << std::string(43, '\0');
+            }
+        }
+        std::ofstream(root + "/UTC", std::ios::binary) << "TZif2" << std::string(43, '\0');
+        std::ofstream(root + "/zone.tab") << "# not a zone file\n";
+    }
+
+    void removeTree(const std::string &path)
+    {
+        DIR *dir = opendir(path.c_str());
+        if (dir)
+        {
+            struct dirent *entry;
+            while ((entry = readdir(dir)) != NULL)
+            {
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                    continue;
+                removeTree(path + "/" + entry->d_name);
+            }
+            closedir(dir);
+            rmdir(path.c_str());
+        }
+        else
+        {
+            unlink(path.c_str());
+        }
+    }
+
+    std::string jsonEscape(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    void writeJson(std::ostream &out)
+    {
+        out << "{\n  \"benchmark\": \"qnx-raspi-setup-bench\",\n  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const Result &result = results[i];
+            out << "    {\"name\": \"" << jsonEscape(result.name) << "\", \"variant\": \"" << jsonEscape(result.variant)
+                << "\", \"bytes\": " << result.bytes << ", \"iterations\": " << result.iterations
+                << ", \"min_ns\": " << static_cast<long long>(result.minNs)
+                << ", \"median_ns\": " << static_cast<long long>(result.medianNs)
+                << ", \"mean_ns\": " << static_cast<long long>(result.meanNs)
+                << ", \"allocations\": " << result.allocations << "}"
+                << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+    void benchConfigEditor(const std::string &filename, size_t bytes)
+    {
+        const SectionPath display{"winmgr", "display 1"};
+
+        measure("ConfigEditor::loadFile", "buffered", bytes, [&]
+                { ConfigEditor editor(filename, ConfigEditor::LoadMode::Buffered); });
+        measure("ConfigEditor::loadFile", "mapped", bytes, [&]
+                { ConfigEditor editor(filename, ConfigEditor::LoadMode::Mapped); });
+
+        ConfigEditor editor(filename);
+        measure("ConfigEditor::getValue", "indexed", bytes, [&]
+                { editor.getValue(display, "video-mode"); });
+        measure("ConfigEditor::keyExists", "indexed", bytes, [&]
+                { editor.keyExists(display, "video-mode"); });
+        measure("ConfigEditor::get<DisplayVideoMode>", "indexed", bytes, [&]
+                { editor.get<ConfigSchema::DisplayVideoMode>(display); });
+        measure("ConfigEditor::getKeysInSection", "indexed", bytes, [&]
+                { editor.getKeysInSection(display); });
+
+        ConfigEditor streamed(filename, ConfigEditor::LoadMode::Streaming);
+        measure("ConfigEditor::getValue", "streaming", bytes, [&]
+                { streamed.getValue(display, "video-mode"); });
+        measure("ConfigEditor::getKeysInSection", "streaming", bytes, [&]
+                { streamed.getKeysInSection(display); });
+
+        // Values are formatted up front so only the editor's own allocations are counted
+        std::vector<std::string> modes;
+        for (int rate = 1; rate <= 240; ++rate)
+            modes.push_back("1920 x 1080 @ " + std::to_string(rate));
+        int counter = 0;
+        measure("ConfigEditor::setValue", "existing key", bytes, [&]
+                { editor.setValue(display, "video-mode", modes[counter++ % modes.size()]); });
+
+        // Every iteration adds a new key, so this also shows how inserts scale
+        measure("ConfigEditor::setValue", "new key", bytes, [&]
+                { editor.setValue(display, "new-key-" + std::to_string(counter++), "on"); });
+
+        measure("ConfigEditor::snapshot", "", bytes, [&]
+                { editor.snapshot(); });
+        measure("ConfigEditor::undo+redo", "new key", bytes, [&]
+                { editor.undo(); editor.redo(); });
+        ConfigEditor::Snapshot checkpoint = editor.snapshot();
+        measure("ConfigEditor::setValue", "after snapshot", bytes, [&]
+                { editor.setValue(display, "video-mode", modes[counter++ % modes.size()]); }, [&]
+                { checkpoint = editor.snapshot(); });
+        measure("ConfigEditor::restore", "", bytes, [&]
+                { editor.restore(checkpoint); });
+
+        // A batch of new keys landing in one section, as a generator would emit them
+        std::vector<ConfigEditor::Edit> batch;
+        for (int i = 0; i < 500; ++i)
+            batch.push_back({ConfigEditor::Edit::Action::Set, display, "generated-" + std::to_string(i), "on"});
+        ConfigEditor batchEditor;
+        measure("ConfigEditor::applyEdits", "500 new keys", bytes, [&]
+                { batchEditor.applyEdits(batch); }, [&]
+                { batchEditor.loadFile(filename); });
+
+        // Reload before each save so every run writes the same amount
+        std::string copy = filename + ".save";
+        ConfigEditor saver;
+        auto prepare = [&]
+        {
+            saver.loadFile(filename);
+            saver.setValue(display, "video-mode", "1920 x 1080 @ " + std::to_string(counter++ % 240));
+        };
+        saver.setSyncOnSave(false);
+        measure("ConfigEditor::saveFile", "atomic", bytes, [&]
+                { saver.saveFile(copy); }, prepare);
+        saver.setSyncOnSave(true);
+        measure("ConfigEditor::saveFile", "atomic+fsync", bytes, [&]
+                { saver.saveFile(copy); }, prepare);
+
+        ConfigEditor patcher(copy);
+        patcher.setSaveStrategy(ConfigEditor::SaveStrategy::PatchInPlace);
+        patcher.setSyncOnSave(false);
+        measure("ConfigEditor::saveFile", "patch", bytes, [&]
+                { patcher.saveFile(copy); }, [&]
+                { patcher.setValue(display, "video-mode", "1920 x 1080 @ " + std::to_string(counter++ % 240)); });
+        measure("ConfigEditor::saveFile", "unchanged", bytes, [&]
+                { patcher.saveFile(copy); });
+
+        // A patched save must not change what snapshots and undo bring back
+        ConfigEditor loaded(copy);
+        std::string original = loaded.getContents();
+        for (ConfigEditor::LoadMode mode : {ConfigEditor::LoadMode::Buffered, ConfigEditor::LoadMode::Mapped})
+        {
+            ConfigEditor restorer(copy, mode);
+            restorer.setSaveStrategy(ConfigEditor::SaveStrategy::PatchInPlace);
+            restorer.setSyncOnSave(false);
+            ConfigEditor::Snapshot before = restorer.snapshot();
+            restorer.setValue(display, "video-mode", "1 x 1 @ 1");
+            restorer.setValue(display, "video-mode", "1920 x 1080 @ 60");
+            check(restorer.saveFile(copy), "patched save");
+            restorer.restore(before);
+            check(restorer.getContents() == original, "restore after a patched save");
+            restorer.undo();
+            restorer.undo();
+            restorer.undo();
+            check(restorer.getContents() == original, "undo after a patched save");
+            check(restorer.saveFile(copy) && ConfigEditor(copy).getContents() == original,
+                  "save after restoring");
+        }
+        unlink(copy.c_str());
+    }
+
+    void benchSetupUtils(const std::string &filename, size_t bytes)
+    {
+        SetupUtils setupUtils(filename);
+        int counter = 0;
+        measure("SetupUtils::setDisplay+setKeyboardLayout+saveConfig", "", bytes, [&]
+                {
+                    setupUtils.setKeyboardLayout(counter % 2 ? "en_US_101" : "de_DE_102");
+                    setupUtils.setDisplay(1920, 1080, 30 + counter++ % 60);
+                    setupUtils.saveConfig(); });
+    }
+
+    void benchWorkspace(const std::string &filename, size_t bytes)
+    {
+        // Stand in for the three managed files with copies of the same config
+        Workspace::Paths paths;
+        paths.graphicsConfig = filename;
+        paths.wifiConfig = filename + ".wifi";
+        paths.networkConfig = filename + ".network";
+        for (const std::string *copy : {&paths.wifiConfig, &paths.networkConfig})
+        {
+            std::ifstream in(filename, std::ios::binary);
+            std::ofstream out(*copy, std::ios::binary);
+            out << in.rdbuf();
+        }
+
+        measure("ConfigEditor::loadFile", "3 files, one after another", 3 * bytes, [&]
+                {
+                    ConfigEditor graphics(paths.graphicsConfig);
+                    ConfigEditor wifi(paths.wifiConfig);
+                    ConfigEditor network(paths.networkConfig); });
+        Workspace workspace(paths);
+        measure("Workspace::loadAll", "3 files", 3 * bytes, [&]
+                { workspace.loadAll(); });
+
+        unlink(paths.wifiConfig.c_str());
+        unlink(paths.networkConfig.c_str());
+    }
+
+    void benchNetworkConfig(const std::string &filename)
+    {
+        // A /boot/network grown by the old append-only setHostname(), one line per change
+        {
+            std::ofstream out(filename);
+            out << "DHCP=yes\n";
+            for (int i = 0; i < 200; ++i)
+                out << "HOSTNAME=host" << i << "\n";
+        }
+        struct stat statbuf;
+        stat(filename.c_str(), &statbuf);
+        size_t bytes = static_cast<size_t>(statbuf.st_size);
+
+        measure("NetworkConfig::get", "first read", bytes, [&]
+                { NetworkConfig(filename).get("HOSTNAME"); });
+        NetworkConfig config(filename);
+        config.get("HOSTNAME");
+        measure("NetworkConfig::get", "cached", bytes, [&]
+                { config.get("HOSTNAME"); });
+        // Every run rewrites the last assignment, the one in effect
+        config.setSyncOnSave(false);
+        measure("NetworkConfig::set", "in place", 0, [&]
+                { config.set("HOSTNAME", "qnxpi"); });
+        unlink(filename.c_str());
+    }
+
+    void benchWifiConfig(const std::string &filename)
+    {
+        // Two networks; the update goes to the first one, which has no key_mgmt yet,
+        // and must leave the open network after it as it is
+        const std::string header = "ctrl_interface=/var/run/wpa_supplicant\n"
+                                   "network={\n    ssid=\"A\"\n    psk=\"aaaaaaaa\"\n}\n";
+        const std::string openNetwork = "network={\n    ssid=\"B\"\n    key_mgmt=NONE\n}\n";
+        std::ofstream(filename) << header << openNetwork;
+        check(SetupUtils::updateWifiConfig(filename, "X", "WPA-PSK", "xxxxxxxx"), "update the first Wi-Fi network");
+        check(ConfigEditor(filename).getContents() ==
+                  "ctrl_interface=/var/run/wpa_supplicant\n"
+                  "network={\n    ssid=\"X\"\n    psk=\"xxxxxxxx\"\n    key_mgmt=WPA-PSK\n}\n" +
+                      openNetwork,
+              "update only the first of two Wi-Fi networks");
+
+        struct stat statbuf;
+        stat(filename.c_str(), &statbuf);
+        int run = 0;
+        measure("SetupUtils::updateWifiConfig", "two networks", static_cast<size_t>(statbuf.st_size), [&]
+                { SetupUtils::updateWifiConfig(filename, run++ % 2 ? "X" : "Y", "WPA-PSK", "xxxxxxxx"); });
+        unlink(filename.c_str());
+    }
+
+    void benchSystemOps(const std::string &workDir)
+    {
+        // What the utility did before: start a shell for every change
+        std::string nested = workDir + "/config/qnx-raspi-setup";
+        std::string command = "mkdir -p " + nested;
+        measure("mkdir -p", "shell", 0, [&]
+                { system(command.c_str()); });
+        LinuxSystemOps ops;
+        measure("SystemOps::makeDirectories", "existing", 0, [&]
+                { ops.makeDirectories(nested); });
+        measure("SystemOps::setTimezone", "stand-in", 0, [&]
+                { ops.setTimezone("UTC"); });
+    }
+
+    void benchDisplayModes(const std::string &workDir)
+    {
+        std::string edid = workDir + "/edid";
+        generateEdid(edid);
+        std::ifstream in(edid, std::ios::binary);
+        std::string blob((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::vector<DisplayModes::Mode> modes;
+        measure("DisplayModes::parseEdid", "base+CTA", blob.size(), [&]
+                { DisplayModes::parseEdid(blob, modes); });
+
+        DisplayModes::setEdidPath(edid);
+        DisplayModes::setCachePath(workDir + "/edid-modes");
+        DisplayModes::getSupportedModes();
+        measure("DisplayModes::getSupportedModes", "cached", blob.size(), []
+                { DisplayModes::getSupportedModes(); });
+    }
+
+    void benchKeyboardLayouts(const std::string &workDir)
+    {
+        // A keymap directory like the one on the image, one file per layout
+        std::string keymaps = workDir + "/keyboard";
+        mkdir(keymaps.c_str(), 0755);
+        for (std::string_view layout : SetupUtils::getAvailableKeyboardLayouts())
+        {
+            std::ofstream(keymaps + "/" + std::string(layout) + ".kbd");
+        }
+        KeyboardLayouts::setKeymapPath(keymaps);
+        measure("SetupUtils::getAvailableKeyboardLayouts", "cached", 0, []
+                { SetupUtils::getAvailableKeyboardLayouts(); });
+        measure("KeyboardLayouts::isAvailable", "cached", 0, []
+                { KeyboardLayouts::isAvailable("fr_CA_102"); });
+    }
+
+    void benchFleet(const std::string &workDir, size_t imageCount)
+    {
+        // Copies of one base image, each with a manifest; two manifest sets are
+        // used in turn so every run rewrites the files
+        std::string base = workDir + "/fleet-base.conf";
+        generateConfig(base, 64 * 1024, 6);
+        struct stat statbuf;
+        stat(base.c_str(), &statbuf);
+        size_t bytes = imageCount * static_cast<size_t>(statbuf.st_size);
+
+        std::vector<Fleet::Device> devices[2];
+        for (size_t i = 0; i < imageCount; ++i)
+        {
+            std::string root = workDir + "/image" + std::to_string(i);
+            Workspace::Paths paths = Workspace::Paths().under(root);
+            SystemOps::native().makeDirectories(root + "/system/lib/graphics/rpi4-drm");
+            SystemOps::native().makeDirectories(root + "/boot");
+            {
+                std::ifstream in(base, std::ios::binary);
+                std::ofstream out(paths.graphicsConfig, std::ios::binary);
+                out << in.rdbuf();
+            }
+            std::ofstream(paths.networkConfig) << "HOSTNAME=qnxpi\n";
+            std::ofstream(paths.wifiConfig) << "ctrl_interface=/var/run/wpa_supplicant\n";
+            for (int set = 0; set < 2; ++set)
+            {
+                std::string manifest = root + ".manifest" + std::to_string(set);
+                std::ofstream(manifest) << "hostname=pi" << i << "-" << set << "\nkeymap="
+                                        << (set ? "fr_CA_102" : "en_US_101") << "\ndisplay=1920 x 1080 @ "
+                                        << (set ? 30 : 60) << "\nwifi-ssid=fleet\nwifi-psk=password" << set << "\n";
+                devices[set].push_back({root, manifest});
+            }
+        }
+
+        int run = 0;
+        std::string images = std::to_string(imageCount) + " images, ";
+        measure("Fleet::provision", images + "1 thread", bytes, [&]
+                { Fleet::provision(devices[run++ % 2], 1); });
+        size_t threads = WorkStealingPool::defaultThreadCount();
+        measure("Fleet::provision", images + std::to_string(threads) + " threads", bytes, [&]
+                { Fleet::provision(devices[run++ % 2], threads); });
+
+        // Provisioning again with the same manifests finds nothing to change and writes nothing
+        Fleet::provision(devices[0], threads);
+        measure("Fleet::provision", images + "already set up", bytes, [&]
+                { Fleet::provision(devices[0], threads); });
+    }
+
+    void benchFat32Image(const std::string &workDir)
+    {
+        std::string path = workDir + "/boot.img";
+        const std::string network = "HOSTNAME=qnxpi\n";
+        generateFat32Image(path, "x=1\n", network);
+        std::shared_ptr<Fat32Image> image = Fat32Image::open(path);
+        check(image != nullptr, "open a FAT32 volume");
+        if (!image)
+            return;
+        image->setSyncOnSave(false);
+
+        // Grow the file over many clusters, shrink it, empty it and grow it again,
+        // reading it back through a fresh open every time
+        auto contentsOf = [](size_t size)
+        {
+            std::string contents;
+            for (size_t i = 0; contents.size() < size; ++i)
+                contents += "line " + std::to_string(i) + " of the boot configuration\n";
+            contents.resize(size);
+            return contents;
+        };
+        for (size_t size : {20000, 700, 0, 5000})
+        {
+            std::string contents = contentsOf(size);
+            std::string what = " with " + std::to_string(size) + " bytes";
+            check(image->write("/config.txt", contents), "write a file on a FAT32 volume" + what);
+            std::shared_ptr<Fat32Image> reopened = Fat32Image::open(path);
+            std::shared_ptr<const FileBuffer> buffer = reopened ? reopened->read("/config.txt") : nullptr;
+            check(buffer && buffer->view() == contents, "read back a file from a FAT32 volume" + what);
+            check(isFat32Consistent(path), "FAT copies and FSInfo free count" + what);
+        }
+        std::shared_ptr<const FileBuffer> untouched = image->read("/network");
+        check(untouched && untouched->view() == network, "other files on a FAT32 volume stay as they were");
+
+        // An edit in the middle of the file only rewrites the cluster it falls in
+        std::string edits[2] = {contentsOf(5000), contentsOf(5000)};
+        edits[1][2500] = '#';
+        int run = 0;
+        measure("Fat32Image::write", "one cluster changed", edits[0].size(), [&]
+                { image->write("/config.txt", edits[run++ % 2]); });
+        unlink(path.c_str());
+    }
+
+    void benchTimezoneHelper(const std::string &zoneinfo)
+    {
+        TimezoneHelper::setZoneinfoPath(zoneinfo);
+        measure("TimezoneHelper::getAvailableTimezones", "fixture", 0, []
+                { TimezoneHelper::getAvailableTimezones(); });
+        measure("TimezoneHelper::isValidTimezone", "zone file", 0, []
+                { TimezoneHelper::isValidTimezone("Region3/Zone7"); });
+        measure("TimezoneHelper::isValidTimezone", "offset", 0, []
+                { TimezoneHelper::isValidTimezone("GMT+05:30"); });
+        measure("TimezoneHelper::isValidTimezone", "invalid", 0, []
+                { TimezoneHelper::isValidTimezone("Nowhere/Zone1"); });
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool quick = false;
+    std::string outputPath;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--quick")
+        {
+            quick = true;
+        }
+        else if (arg == "--output" && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--quick] [--output results.json]" << std::endl;
+            return 1;
+        }
+    }
+
+    const char *tmp = getenv("TMPDIR");
+    std::string workDir = std::string(tmp ? tmp : "/tmp") + "/qnx-raspi-setup-bench.XXXXXX";
+    if (mkdtemp(&workDir[0]) == nullptr)
+    {
+        std::cerr << "Error: Unable to create working directory " << workDir << std::endl;
+        return 1;
+    }
+
+    std::vector<size_t> sizes = {4 * 1024, 256 * 1024, 4 * 1024 * 1024, 32 * 1024 * 1024};
+    if (quick)
+        sizes = {4 * 1024, 256 * 1024};
+
+    for (size_t size : sizes)
+    {
+        std::string filename = workDir + "/graphics-" + std::to_string(size) + ".conf";
+        generateConfig(filename, size, 6);
+        struct stat statbuf;
+        stat(filename.c_str(), &statbuf);
+        size_t bytes = static_cast<size_t>(statbuf.st_size);
+
+        benchConfigEditor(filename, bytes);
+        benchSetupUtils(filename, bytes);
+        benchWorkspace(filename, bytes);
+    }
+
+    std::string zoneinfo = workDir + "/zoneinfo";
+    generateZoneinfo(zoneinfo, quick ? 4 : 20, quick ? 10 : 30);
+    benchTimezoneHelper(zoneinfo);
+    benchNetworkConfig(workDir + "/network");
+    benchWifiConfig(workDir + "/wpa_supplicant.conf");
+    benchSystemOps(workDir);
+    benchDisplayModes(workDir);
+    benchKeyboardLayouts(workDir);
+    benchFat32Image(workDir);
+    benchFleet(workDir, quick ? 16 : 128);
+
+    removeTree(workDir);
+    if (checksFailed)
+        return 1;
+
+    if (outputPath.empty())
+    {
+        writeJson(std::cout);
+    }
+    else
+    {
+        std::ofstream out(outputPath);
+        writeJson(out);
+        if (!out)
+        {
+            std::cerr << "Error: Unable to write results to " << outputPath << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
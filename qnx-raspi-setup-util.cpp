@@ -1,8 +1,18 @@
 #include "config-editor.hpp"
+#include "display-modes.hpp"
 #include "first-run-utils.hpp"
+#include "fleet.hpp"
+#include "keyboard-layouts.hpp"
 #include "setup-utils.hpp"
+#include "system-ops.hpp"
+#include "timezone-helper.hpp"
 #include "utf8-tui.hpp"
+#include "work-stealing-pool.hpp"
+#include "workspace.hpp"
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <unistd.h>
 
 const bool TESTING_MODE = false;
@@ -10,17 +20,119 @@ const bool TESTING_MODE = false;
 const std::string GRAPHICS_CONFIG_PATH = "/system/lib/graphics/rpi4-drm/graphics-rpi4.conf";
 const std::string TEST_GRAPHICS_CONFIG_PATH = "test-graphics-rpi4.conf";
 
-int main()
+/**
+ * @brief Redirect every file the utility reads or writes into a mounted system image.
+ * @param root Directory the image's root file system is mounted at, without trailing slash.
+ * @param paths The configuration files to redirect.
+ */
+static void useImageRoot(const std::string &root, Workspace::Paths &paths)
+{
+    paths = Workspace::Paths().under(root);
+    SetupUtils::setNetworkConfigPath(root + SetupUtils::getNetworkConfigPath());
+    FirstRunUtils::setMarkerPath(root + FirstRunUtils::getMarkerPath());
+    TimezoneHelper::setZoneinfoPath(root + TimezoneHelper::getZoneinfoPath());
+    KeyboardLayouts::setKeymapPath(root + KeyboardLayouts::getKeymapPath());
+    // An image has no monitor attached, so display setup falls back to manual entry.
+    DisplayModes::setEdidPath(root + DisplayModes::getEdidPath());
+    DisplayModes::setCachePath(root + DisplayModes::getCachePath());
+}
+
+int main(int argc, char *argv[])
 {
     bool isUTF8 = false;
+    const char *manifestPath = nullptr;
+    const char *imageRoot = nullptr;
+    const char *fleetList = nullptr;
+    bool dryRun = false;
+    size_t jobs = WorkStealingPool::defaultThreadCount();
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--manifest") == 0 && i + 1 < argc)
+        {
+            manifestPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--root") == 0 && i + 1 < argc)
+        {
+            imageRoot = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--fleet") == 0 && i + 1 < argc)
+        {
+            fleetList = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--dry-run") == 0)
+        {
+            dryRun = true;
+        }
+        else if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+        {
+            jobs = static_cast<size_t>(std::atoi(argv[++i]));
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--root <image root>] [--manifest <path> [--dry-run]]" << std::endl;
+            std::cerr << "       " << argv[0] << " --fleet <device list> [--jobs <threads>] [--dry-run]" << std::endl;
+            return 1;
+        }
+    }
 
-    // This program can only be run as root.
-    if (!TESTING_MODE && geteuid() != 0)
+    // A dry run prints the plan of a headless setup; the interactive setup has none to print.
+    if (dryRun && manifestPath == nullptr && fleetList == nullptr)
+    {
+        std::cerr << "Error: --dry-run needs --manifest or --fleet." << std::endl;
+        return 1;
+    }
+
+    // Batch setup of mounted images; each line of the list names its own root and manifest.
+    if (fleetList != nullptr)
+    {
+        if (imageRoot != nullptr || manifestPath != nullptr)
+        {
+            std::cerr << "Error: --fleet takes the image roots and manifests from the device list." << std::endl;
+            return 1;
+        }
+        return Fleet::run(fleetList, jobs, dryRun) ? 0 : 1;
+    }
+
+    // This program can only be run as root, unless it only edits a mounted image or changes nothing.
+    if (!TESTING_MODE && imageRoot == nullptr && !dryRun && geteuid() != 0)
     {
         std::cerr << "This program must be run as root. Please use su to switch to root user." << std::endl;
         return 1;
     }
 
+    Workspace::Paths paths;
+    paths.graphicsConfig = TESTING_MODE ? TEST_GRAPHICS_CONFIG_PATH : GRAPHICS_CONFIG_PATH;
+    // Offline mode: files live under the image root, and live system changes
+    // are written to the image instead.
+    std::unique_ptr<OfflineSystemOps> offlineOps;
+    if (imageRoot != nullptr)
+    {
+        std::string root = imageRoot;
+        while (!root.empty() && root.back() == '/')
+            root.pop_back();
+        useImageRoot(root, paths);
+        offlineOps = std::make_unique<OfflineSystemOps>(root);
+        std::cout << "Provisioning the image mounted at " << imageRoot << std::endl;
+    }
+    SystemOps &ops = offlineOps ? *offlineOps : SystemOps::native();
+
+    // Headless setup: apply the manifest without any prompts and exit.
+    if (manifestPath != nullptr)
+    {
+        Workspace workspace(paths);
+        if (!FirstRunUtils::provisionFromManifest(manifestPath, workspace, ops, dryRun))
+            return 1;
+        if (dryRun)
+            return 0;
+        // The device is set up now, so the interactive first-run setup is not offered again.
+        if (!TESTING_MODE && !FirstRunUtils::markFirstRunDone())
+            return 1;
+        if (!offlineOps)
+            std::cout << "You need to reboot the system for changes to take effect." << std::endl;
+        return 0;
+    }
+
     // Use special characters to test UTF-8 support in terminal. Charset{"╭", "╮", "╰", "╯", "─", "│"}.
     std::cout << "╭──────────────────────────────────╮" << std::endl;
     std::cout << "│  QNX Raspberry Pi Setup Utility  │" << std::endl;
@@ -40,40 +152,59 @@ int main()
         std::cout << "Running in TESTING MODE" << std::endl;
     }
 
+    // Load every managed configuration file at once for the first-run setup and the dashboard.
+    Workspace workspace(paths);
+    workspace.loadAll();
+    // The dashboard greets with the hostname; the other files are only needed by their menus.
+    if (!workspace.isLoaded(Workspace::Document::NetworkConfig))
+    {
+        std::cerr << "Error: Unable to open network configuration file: "
+                  << workspace.getPath(Workspace::Document::NetworkConfig) << std::endl;
+        exit(1);
+    }
+
     if (TESTING_MODE || FirstRunUtils::isFirstRun())
     {
         std::cout << "First time run detected. Performing initial setup..." << std::endl;
 
+        // Every answer is only staged; the system is changed in one step at the end.
+        SetupUtils::Transaction setup(workspace, ops);
+
         // Set up hostname.
-        std::string hostname = FirstRunUtils::firstTimeSetupHostname();
+        std::string hostname = FirstRunUtils::firstTimeSetupHostname(setup);
         std::cout << "Hostname set to: " << hostname << std::endl;
 
-        // Initialize SetupUtils for configuring graphics config.
-        SetupUtils setupUtils(TESTING_MODE ? TEST_GRAPHICS_CONFIG_PATH : GRAPHICS_CONFIG_PATH);
-
         // Set up keyboard layout.
-        std::string keyboardLayout = FirstRunUtils::firstTimeSetupKeyboardLayout(setupUtils);
+        std::string keyboardLayout = FirstRunUtils::firstTimeSetupKeyboardLayout(setup);
         // Set up display configuration.
-        std::string displayConfig = FirstRunUtils::firstTimeSetupDisplay(setupUtils);
+        std::string displayConfig = FirstRunUtils::firstTimeSetupDisplay(setup);
 
-        // Save configuration changes.
-        if (!setupUtils.saveConfig())
+        // Set up timezone.
+        std::string timezone = FirstRunUtils::firstTimeSetupTimezone(setup);
+
+        // Set up Wi-Fi configuration.
+        std::string wifiConfig = FirstRunUtils::firstTimeSetupWifi(setup);
+
+        // Apply everything at once; on failure nothing has been changed.
+        if (!setup.commit())
         {
             std::cerr << "Error: Failed to save configuration." << std::endl;
             exit(1);
         }
 
-        // Set up timezone.
-        std::string timezone = FirstRunUtils::firstTimeSetupTimezone();
-
-        // Set up Wi-Fi configuration.
-        std::string wifiConfig = FirstRunUtils::firstTimeSetupWifi();
+        // Only a completed setup counts; an aborted one is offered again on the next run.
+        if (!TESTING_MODE && !FirstRunUtils::markFirstRunDone())
+            exit(1);
 
         // TODO: Handle first-time setup tasks here.
 
         if (TESTING_MODE)
             exit(0); // Exit after first run setup in testing mode.
 
+        // A mounted image takes the changes when it boots; there is nothing to reboot.
+        if (offlineOps)
+            exit(0);
+
         // Reboot the RasPi to apply changes.
         std::cout << "You need to reboot the system for changes to take effect." << std::endl;
         std::cout << "Enter 'y' to reboot now, or any other key to exit without rebooting: ";
@@ -82,9 +213,12 @@ int main()
         if (choice == 'y' || choice == 'Y')
         {
             std::cout << "Rebooting..." << std::endl;
-            // QNX uses 'shutdown' to power off the system.
             // The Raspberry Pi reboots automatically after shutdown.
-            system("/system/bin/shutdown");
+            if (!ops.reboot())
+            {
+                std::cerr << "Error: Unable to reboot. Please reboot manually." << std::endl;
+                exit(1);
+            }
             exit(0);
         }
         else
@@ -95,11 +229,11 @@ int main()
 
     if (isUTF8)
     {
-        return UTF8TUI::run();
+        return UTF8TUI::run(workspace);
     }
     else
     {
-        std::string hostname = SetupUtils::getHostname();
+        std::string hostname = SetupUtils::getHostname(workspace.get(Workspace::Document::NetworkConfig));
         std::string username = getenv("USER");
         std::cout << "Welcome back to " << hostname << ", " << username << "!" << std::endl;
         std::cout << std::endl;
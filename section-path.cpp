@@ -0,0 +1,137 @@
+#include "section-path.hpp"
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+    struct PathNode
+    {
+        uint32_t parent;
+        uint32_t name; // Index into the string table
+        uint32_t depth;
+        size_t hash;
+    };
+
+    /**
+     * @brief Process-wide string table and path table behind SectionPath handles
+     */
+    struct PathTable
+    {
+        std::mutex mutex;
+        std::deque<std::string> strings; // deque keeps references stable as it grows
+        std::unordered_map<std::string_view, uint32_t> stringIds;
+        std::deque<PathNode> nodes;
+        std::unordered_map<uint64_t, uint32_t> children; // (parent << 32 | name) -> path
+
+        PathTable()
+        {
+            strings.emplace_back();
+            stringIds.emplace(strings.back(), 0);
+            nodes.push_back({0, 0, 0, 0}); // The root; hash 0 matches a default-constructed SectionPath
+        }
+
+        uint32_t internString(std::string_view text)
+        {
+            auto it = stringIds.find(text);
+            if (it != stringIds.end())
+                return it->second;
+            uint32_t id = static_cast<uint32_t>(strings.size());
+            strings.emplace_back(text);
+            stringIds.emplace(strings.back(), id);
+            return id;
+        }
+
+        uint32_t internChild(uint32_t parent, std::string_view name)
+        {
+            uint32_t nameId = internString(name);
+            uint64_t key = (static_cast<uint64_t>(parent) << 32) | nameId;
+            auto it = children.find(key);
+            if (it != children.end())
+                return it->second;
+
+            const PathNode &parentNode = nodes[parent];
+            size_t hash = SectionPath::childHash(parentNode.hash, name);
+            uint32_t id = static_cast<uint32_t>(nodes.size());
+            nodes.push_back({parent, nameId, parentNode.depth + 1, hash});
+            children.emplace(key, id);
+            return id;
+        }
+    };
+
+    PathTable &table()
+    {
+        static PathTable instance;
+        return instance;
+    }
+}
+
+SectionPath::SectionPath(std::initializer_list<std::string_view> names)
+{
+    PathTable &paths = table();
+    std::lock_guard<std::mutex> lock(paths.mutex);
+    for (std::string_view name : names)
+    {
+        pathId = paths.internChild(pathId, name);
+    }
+    pathHash = paths.nodes[pathId].hash;
+}
+
+SectionPath::SectionPath(const std::vector<std::string> &names)
+{
+    PathTable &paths = table();
+    std::lock_guard<std::mutex> lock(paths.mutex);
+    for (const std::string &name : names)
+    {
+        pathId = paths.internChild(pathId, name);
+    }
+    pathHash = paths.nodes[pathId].hash;
+}
+
+size_t SectionPath::childHash(size_t parentHash, std::string_view name)
+{
+    // Combine like boost::hash_combine so {"a", "b"} and {"b", "a"} differ
+    return parentHash ^ (std::hash<std::string_view>()(name) + 0x9e3779b9 + (parentHash << 6) + (parentHash >> 2));
+}
+
+SectionPath SectionPath::child(std::string_view name) const
+{
+    PathTable &paths = table();
+    std::lock_guard<std::mutex> lock(paths.mutex);
+    uint32_t id = paths.internChild(pathId, name);
+    return SectionPath(id, paths.nodes[id].hash);
+}
+
+SectionPath SectionPath::parent() const
+{
+    PathTable &paths = table();
+    std::lock_guard<std::mutex> lock(paths.mutex);
+    uint32_t id = paths.nodes[pathId].parent;
+    return SectionPath(id, paths.nodes[id].hash);
+}
+
+const std::string &SectionPath::name() const
+{
+    PathTable &paths = table();
+    std::lock_guard<std::mutex> lock(paths.mutex);
+    return paths.strings[paths.nodes[pathId].name];
+}
+
+std::vector<std::string> SectionPath::names() const
+{
+    PathTable &paths = table();
+    std::lock_guard<std::mutex> lock(paths.mutex);
+    std::vector<std::string> result(paths.nodes[pathId].depth);
+    for (uint32_t id = pathId; id != 0; id = paths.nodes[id].parent)
+    {
+        result[paths.nodes[id].depth - 1] = paths.strings[paths.nodes[id].name];
+    }
+    return result;
+}
+
+size_t SectionPath::depth() const
+{
+    PathTable &paths = table();
+    std::lock_guard<std::mutex> lock(paths.mutex);
+    return paths.nodes[pathId].depth;
+}
@@ -0,0 +1,113 @@
+#ifndef SECTION_PATH_HPP
+#define SECTION_PATH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Interned handle for a hierarchical section path such as {"winmgr", "display 1"}
+ *
+ * Every distinct path is registered once in a process-wide table and identified by
+ * a small integer, so comparing two paths is a single integer compare and hashing
+ * one returns a value computed when the path was first interned. Section names are
+ * stored once in a string table shared by all paths.
+ *
+ * Handles convert implicitly from a braced list or a vector of names, so existing
+ * call sites keep working; callers that look up the same path repeatedly should
+ * hold on to a handle instead.
+ *
+ * @example
+ * static const SectionPath display{"winmgr", "display 1"};
+ * SectionPath globals = display.parent().child("globals");
+ */
+class SectionPath
+{
+private:
+    uint32_t pathId = 0; // 0 is the root path
+    size_t pathHash = 0;
+
+    SectionPath(uint32_t id, size_t hash) : pathId(id), pathHash(hash) {}
+
+public:
+    /**
+     * @brief Construct the root path (no sections)
+     */
+    SectionPath() = default;
+
+    /**
+     * @brief Intern a path from a list of section names
+     * @param names Section names from the outermost to the innermost section
+     */
+    SectionPath(std::initializer_list<std::string_view> names);
+
+    /**
+     * @brief Intern a path from a vector of section names
+     * @param names Section names from the outermost to the innermost section
+     */
+    SectionPath(const std::vector<std::string> &names);
+
+    /**
+     * @brief Get the path of a direct subsection
+     * @param name Name of the subsection
+     * @return Interned child path
+     */
+    SectionPath child(std::string_view name) const;
+
+    /**
+     * @brief Get the path of the enclosing section
+     * @return Parent path; the root is its own parent
+     */
+    SectionPath parent() const;
+
+    /**
+     * @brief Get the innermost section name
+     * @return Name of the section, empty for the root
+     */
+    const std::string &name() const;
+
+    /**
+     * @brief Get all section names of the path
+     * @return Section names from the outermost to the innermost section
+     */
+    std::vector<std::string> names() const;
+
+    /**
+     * @brief Get the number of sections in the path
+     * @return Depth, 0 for the root
+     */
+    size_t depth() const;
+
+    /**
+     * @brief Compute the hash a path gets when it is interned, from its parent's hash
+     * @param parentHash Hash of the enclosing path, 0 for the root
+     * @param name Name of the innermost section
+     * @return Value hash() returns for the path once interned
+     *
+     * Lets a caller compare a path it has not interned against a handle.
+     */
+    static size_t childHash(size_t parentHash, std::string_view name);
+
+    bool isRoot() const { return pathId == 0; }
+    uint32_t id() const { return pathId; }
+    size_t hash() const { return pathHash; }
+
+    bool operator==(const SectionPath &other) const { return pathId == other.pathId; }
+    bool operator!=(const SectionPath &other) const { return pathId != other.pathId; }
+    bool operator<(const SectionPath &other) const { return pathId < other.pathId; }
+};
+
+namespace std
+{
+    template <>
+    struct hash<SectionPath>
+    {
+        size_t operator()(const SectionPath &path) const noexcept { return path.hash(); }
+    };
+}
+
+#endif // SECTION_PATH_HPP
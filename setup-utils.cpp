@@ -1,6 +1,18 @@
 #include "setup-utils.hpp"
+#include "network-config.hpp"
+#include <algorithm>
 #include <iostream>
-#include <fstream>
+
+// For QNX, the hostname is saved in /boot/network
+static std::string &networkConfigPath()
+{
+    static std::string path = "/boot/network";
+    return path;
+}
+
+const SectionPath SetupUtils::globalsSection{"winmgr", "globals"};
+const SectionPath SetupUtils::displaySection{"winmgr", "display 1"};
+const SectionPath SetupUtils::wifiNetworkSection{"network"};
 
 SetupUtils::SetupUtils(const std::string &configFilePath)
 {
@@ -12,8 +24,142 @@ SetupUtils::SetupUtils(const std::string &configFilePath)
     }
 }
 
+/**
+ * @brief The /boot/network store shared by getHostname() and setHostname(), so
+ * lookups reuse the parsed file until it changes on disk.
+ */
+static NetworkConfig &networkConfig()
+{
+    static NetworkConfig config(networkConfigPath());
+    return config;
+}
+
+std::string SetupUtils::getHostname()
+{
+    NetworkConfig &config = networkConfig();
+    if (!config.exists())
+    {
+        std::cerr << "Error: Unable to open network configuration file: " << networkConfigPath() << std::endl;
+        exit(1);
+    }
+    std::string hostname = config.get("HOSTNAME");
+    return hostname.empty() ? "unknown" : hostname;
+}
+
+void SetupUtils::setNetworkConfigPath(const std::string &path)
+{
+    networkConfigPath() = path;
+    networkConfig() = NetworkConfig(path);
+}
+
+const std::string &SetupUtils::getNetworkConfigPath()
+{
+    return networkConfigPath();
+}
+
+std::string SetupUtils::getHostname(ConfigEditor &networkConfig)
+{
+    // /boot/network holds plain HOSTNAME=name lines at the top level
+    std::string hostname = networkConfig.getValue(SectionPath(), "HOSTNAME");
+    return hostname.empty() ? "unknown" : hostname;
+}
+
+std::string SetupUtils::setHostname(const std::string &hostname)
+{
+    if (networkConfig().get("HOSTNAME") == hostname)
+        return hostname; // Already set; nothing to write
+
+    // Replace the existing HOSTNAME entry instead of appending another one,
+    // so the file does not grow with every change
+    if (!networkConfig().set("HOSTNAME", hostname))
+    {
+        std::cerr << "Error: Unable to write network configuration file: " << networkConfigPath() << std::endl;
+        exit(1);
+    }
+    return hostname;
+}
+
+bool SetupUtils::stageValue(const SectionPath &sectionPath, const std::string &key, const std::string &value)
+{
+    if (!configEditor.sectionExists(sectionPath))
+    {
+        return false;
+    }
+    pendingEdits.push_back({ConfigEditor::Edit::Action::Set, sectionPath, key, value});
+    return true;
+}
+
+void SetupUtils::dropUnchanged(ConfigEditor &editor, const std::string &target,
+                               std::vector<ConfigEditor::Edit> &edits, std::vector<Change> &plan)
+{
+    // The last value staged for a key is the one that ends up in the file, so
+    // walk the edits from the back and skip keys already seen
+    std::vector<ConfigEditor::Edit> kept;
+    std::vector<const ConfigEditor::Edit *> seen;
+    size_t planned = plan.size();
+    for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit)
+    {
+        if (edit->action == ConfigEditor::Edit::Action::Uncomment)
+        {
+            kept.push_back(*edit); // Uncommenting is kept as it is
+            continue;
+        }
+        bool overridden = std::any_of(seen.begin(), seen.end(), [&](const ConfigEditor::Edit *later)
+                                      { return later->sectionPath == edit->sectionPath && later->key == edit->key; });
+        if (overridden)
+            continue;
+        seen.push_back(&*edit);
+        bool exists = editor.keyExists(edit->sectionPath, edit->key);
+        std::string current = exists ? editor.getValue(edit->sectionPath, edit->key) : std::string();
+        if (edit->action == ConfigEditor::Edit::Action::Comment)
+        {
+            // Commenting out a key that is not set changes nothing; the key is not set afterwards
+            if (!exists)
+                continue;
+            kept.push_back(*edit);
+            plan.push_back({target, edit->key, current, std::string(), edit->key == "psk"});
+            continue;
+        }
+        if (exists && current == edit->value)
+            continue;
+        kept.push_back(*edit);
+        plan.push_back({target, edit->key, current, edit->value, edit->key == "psk"});
+    }
+    std::reverse(kept.begin(), kept.end());
+    std::reverse(plan.begin() + static_cast<std::ptrdiff_t>(planned), plan.end());
+    edits = std::move(kept);
+}
+
+void SetupUtils::printPlan(const std::vector<Change> &plan, std::ostream &out)
+{
+    if (plan.empty())
+    {
+        out << "No changes: everything is already set up as requested." << std::endl;
+        return;
+    }
+    for (const Change &change : plan)
+    {
+        std::string current = change.current.empty() ? "(not set)" : change.secret ? "(hidden)" : change.current;
+        std::string desired = change.desired.empty() ? "(not set)" : change.secret ? "(hidden)" : change.desired;
+        out << "  " << change.target << ": " << change.key << ": " << current << " -> " << desired << std::endl;
+    }
+}
+
 bool SetupUtils::saveConfig()
 {
+    std::vector<Change> plan;
+    dropUnchanged(configEditor, path, pendingEdits, plan);
+    if (pendingEdits.empty())
+        return true; // The file already holds every value
+
+    // Apply everything the setters staged in a single pass over the file
+    if (!configEditor.applyEdits(pendingEdits))
+    {
+        std::cerr << "Error: Unable to apply configuration changes to: " << path << std::endl;
+        return false;
+    }
+    pendingEdits.clear();
+
     if (!configEditor.saveFile(path))
     {
         std::cerr << "Error: Unable to save configuration file: " << path << std::endl;
@@ -22,8 +168,14 @@ bool SetupUtils::saveConfig()
     return true;
 }
 
+const std::vector<std::string_view> &SetupUtils::getAvailableKeyboardLayouts()
+{
+    return KeyboardLayouts::getAvailable();
+}
+
 std::string SetupUtils::setKeyboardLayout(const std::string &layout){
-    bool result = configEditor.setValue({"winmgr", "globals"}, "keymap", layout);
+    bool result = KeyboardLayouts::isAvailable(layout) &&
+                  stage<ConfigSchema::GlobalsKeymap>(globalsSection, layout);
     if (!result)
     {
         std::cerr << "Error: Unable to set keyboard layout in configuration." << std::endl;
@@ -37,39 +189,45 @@ std::string SetupUtils::setDisplay(
     const int stackSize, const bool forceComposition, const bool cursor
 )
 {
-    std::string videoMode = std::to_string(width) + " x " + std::to_string(height) + " @ " + std::to_string(refreshRate);
-    bool result = configEditor.setValue({"winmgr", "display 1"}, "video-mode", videoMode);
+    ConfigSchema::VideoMode videoMode{width, height, refreshRate};
+    bool result = stage<ConfigSchema::DisplayVideoMode>(displaySection, videoMode) &&
+                  stage<ConfigSchema::DisplayStackSize>(displaySection, stackSize) &&
+                  stage<ConfigSchema::DisplayForceComposition>(displaySection, forceComposition) &&
+                  // Note: The configuration uses 'on'/'off' for cursor setting.
+                  stage<ConfigSchema::DisplayCursor>(displaySection, cursor);
     if (!result)
     {
-        std::cerr << "Error: Unable to set video mode in configuration." << std::endl;
+        std::cerr << "Error: Unable to set display configuration." << std::endl;
         exit(1);
     }
 
-    result = configEditor.setValue({"winmgr", "display 1"}, "stack-size", std::to_string(stackSize));
-    if (!result)
-    {
-        std::cerr << "Error: Unable to set stack size in configuration." << std::endl;
-        exit(1);
-    }
-
-    result = configEditor.setValue({"winmgr", "display 1"}, "force-composition", forceComposition ? "true" : "false");
-    if (!result)
-    {
-        std::cerr << "Error: Unable to set force-composition in configuration." << std::endl;
-        exit(1);
-    }
+    return std::to_string(width) + " x " + std::to_string(height) + " @ " + std::to_string(refreshRate) +
+           ", stack-size=" + std::to_string(stackSize) +
+           ", force-composition=" + (forceComposition ? "true" : "false") +
+           ", cursor=" + (cursor ? "on" : "off");
+}
 
-    // Note: The configuration uses 'on'/'off' for cursor setting.
-    result = configEditor.setValue({"winmgr", "display 1"}, "cursor", cursor ? "on" : "off");
-    if (!result)
+std::string SetupUtils::setTimezone(const std::string &timezone)
+{
+    if (SystemOps::native().getTimezone() == timezone)
+        return timezone;
+    if (!SystemOps::native().setTimezone(timezone))
     {
-        std::cerr << "Error: Unable to set cursor in configuration." << std::endl;
+        std::cerr << "Error: Unable to set timezone to " << timezone << std::endl;
         exit(1);
     }
+    return timezone;
+}
 
-    return videoMode + ", stack-size=" + std::to_string(stackSize) +
-           ", force-composition=" + (forceComposition ? "true" : "false") +
-           ", cursor=" + (cursor ? "on" : "off");
+void SetupUtils::addWifiEdits(ConfigEditor &wifiConfig, const std::string &ssid, const std::string &keyMgmt,
+                              const std::string &psk, std::vector<ConfigEditor::Edit> &edits)
+{
+    edits.push_back({ConfigEditor::Edit::Action::Set, wifiNetworkSection, "ssid", "\"" + ssid + "\""});
+    edits.push_back({ConfigEditor::Edit::Action::Set, wifiNetworkSection, "key_mgmt", keyMgmt});
+    if (keyMgmt != "NONE" && !psk.empty())
+        edits.push_back({ConfigEditor::Edit::Action::Set, wifiNetworkSection, "psk", "\"" + psk + "\""});
+    else if (wifiConfig.keyExists(wifiNetworkSection, "psk"))
+        edits.push_back({ConfigEditor::Edit::Action::Comment, wifiNetworkSection, "psk", std::string()});
 }
 
 bool SetupUtils::updateWifiConfig(const std::string &configPath,
@@ -77,90 +235,192 @@ bool SetupUtils::updateWifiConfig(const std::string &configPath,
                       const std::string &newKeyMgmt,
                       const std::string &newPSK)
 {
-
-    std::ifstream inFile(configPath);
-    if (!inFile.is_open())
+    ConfigEditor wifiConfig;
+    wifiConfig.setDialect(ConfigDialect::BraceBlocks);
+    if (!wifiConfig.loadFile(configPath))
     {
         std::cerr << "Error: Cannot open config file: " << configPath << std::endl;
         return false;
     }
 
-    std::vector<std::string> lines;
-    std::string line;
-    bool inNetworkBlock = false;
-    bool foundNetwork = false;
+    // Lookups resolve to the first network={ block, which is the one to update
+    if (!wifiConfig.addSection(wifiNetworkSection))
+    {
+        std::cerr << "Error: Cannot add a network block to config file: " << configPath << std::endl;
+        return false;
+    }
+    std::vector<ConfigEditor::Edit> edits;
+    addWifiEdits(wifiConfig, newSSID, newKeyMgmt, newPSK, edits);
+    if (!wifiConfig.applyEdits(edits) || !wifiConfig.saveFile(configPath))
+    {
+        std::cerr << "Error: Cannot write to config file: " << configPath << std::endl;
+        return false;
+    }
+    return true;
+}
 
-    // Read all lines from the file
-    while (std::getline(inFile, line))
+SetupUtils::Transaction::Transaction(Workspace &configWorkspace, SystemOps &systemOps)
+    : workspace(configWorkspace), ops(systemOps)
+{
+}
+
+bool SetupUtils::Transaction::stageValue(Workspace::Document document, const SectionPath &sectionPath,
+                                         const std::string &key, const std::string &value)
+{
+    if (!workspace.isLoaded(document))
     {
-        lines.push_back(line);
+        std::cerr << "Error: Configuration file is not loaded: " << workspace.getPath(document) << std::endl;
+        return false;
     }
-    inFile.close();
+    if (!workspace.get(document).sectionExists(sectionPath))
+    {
+        return false;
+    }
+    pendingEdits[static_cast<size_t>(document)].push_back({ConfigEditor::Edit::Action::Set, sectionPath, key, value});
+    return true;
+}
+
+bool SetupUtils::Transaction::setHostname(const std::string &hostname)
+{
+    return stageValue(Workspace::Document::NetworkConfig, SectionPath(), "HOSTNAME", hostname);
+}
+
+bool SetupUtils::Transaction::setKeyboardLayout(const std::string &layout)
+{
+    return KeyboardLayouts::isAvailable(layout) && stage<ConfigSchema::GlobalsKeymap>(globalsSection, layout);
+}
+
+bool SetupUtils::Transaction::setDisplay(
+    const int width, const int height, const int refreshRate,
+    const int stackSize, const bool forceComposition, const bool cursor)
+{
+    ConfigSchema::VideoMode videoMode{width, height, refreshRate};
+    return stage<ConfigSchema::DisplayVideoMode>(displaySection, videoMode) &&
+           stage<ConfigSchema::DisplayStackSize>(displaySection, stackSize) &&
+           stage<ConfigSchema::DisplayForceComposition>(displaySection, forceComposition) &&
+           stage<ConfigSchema::DisplayCursor>(displaySection, cursor);
+}
+
+void SetupUtils::Transaction::setTimezone(const std::string &timezone)
+{
+    pendingTimezone = timezone;
+}
 
-    // Process lines to update network configuration
-    for (size_t i = 0; i < lines.size(); ++i)
+bool SetupUtils::Transaction::setWifi(const std::string &ssid, const std::string &keyMgmt, const std::string &psk)
+{
+    const Workspace::Document document = Workspace::Document::WifiConfig;
+    if (!workspace.isLoaded(document))
     {
-        std::string &currentLine = lines[i];
+        std::cerr << "Error: Configuration file is not loaded: " << workspace.getPath(document) << std::endl;
+        return false;
+    }
+    // The network block is added on commit if the file has none yet
+    addWifiEdits(workspace.get(document), ssid, keyMgmt, psk, pendingEdits[static_cast<size_t>(document)]);
+    return true;
+}
 
-        // Check if we're entering a network block
-        if (currentLine.find("network={") != std::string::npos)
-        {
-            inNetworkBlock = true;
-            foundNetwork = true;
+std::vector<SetupUtils::Change> SetupUtils::Transaction::plan()
+{
+    std::vector<Change> changes;
+    for (size_t i = 0; i < pendingEdits.size(); ++i)
+    {
+        if (pendingEdits[i].empty())
             continue;
-        }
+        Workspace::Document document = static_cast<Workspace::Document>(i);
+        dropUnchanged(workspace.get(document), workspace.getPath(document), pendingEdits[i], changes);
+    }
+    if (!pendingTimezone.empty())
+    {
+        std::string current = ops.getTimezone();
+        if (current == pendingTimezone)
+            pendingTimezone.clear();
+        else
+            changes.push_back({"system", "timezone", current, pendingTimezone});
+    }
+    return changes;
+}
 
-        // Check if we're exiting a network block
-        if (inNetworkBlock && currentLine.find("}") != std::string::npos)
-        {
-            inNetworkBlock = false;
-            continue;
-        }
+bool SetupUtils::Transaction::commit()
+{
+    // Only what differs from the current state is applied; with nothing left,
+    // no file is rendered or written and the system is not touched
+    if (plan().empty())
+        return true;
 
-        // If we're in a network block, update the relevant fields
-        if (inNetworkBlock)
-        {
-            // Update SSID
-            if (currentLine.find("ssid=") != std::string::npos)
-            {
-                currentLine = "\tssid=\"" + newSSID + "\"";
-            }
-            // Update key_mgmt
-            else if (currentLine.find("key_mgmt=") != std::string::npos)
-            {
-                currentLine = "\tkey_mgmt=" + newKeyMgmt;
-            }
-            // Update PSK
-            else if (currentLine.find("psk=") != std::string::npos)
-            {
-                currentLine = "\tpsk=\"" + newPSK + "\"";
-            }
-        }
-    }
+    std::array<std::string, Workspace::DOCUMENT_COUNT> originals;
+    std::array<ConfigEditor::Snapshot, Workspace::DOCUMENT_COUNT> snapshots;
 
-    // If no network block was found, add one
-    if (!foundNetwork)
+    // Apply the staged edits in memory; nothing is written yet
+    bool applied = true;
+    for (size_t i = 0; i < pendingEdits.size() && applied; ++i)
     {
-        lines.push_back("network={");
-        lines.push_back("\tssid=\"" + newSSID + "\"");
-        lines.push_back("\tkey_mgmt=" + newKeyMgmt);
-        lines.push_back("\tpsk=\"" + newPSK + "\"");
-        lines.push_back("}");
+        if (pendingEdits[i].empty())
+            continue;
+        Workspace::Document document = static_cast<Workspace::Document>(i);
+        ConfigEditor &editor = workspace.get(document);
+        originals[i] = editor.getContents();
+        snapshots[i] = editor.snapshot();
+        if (document == Workspace::Document::WifiConfig && !editor.addSection(wifiNetworkSection))
+            applied = false;
+        else
+            applied = editor.applyEdits(pendingEdits[i]);
+    }
+    if (!applied)
+    {
+        std::cerr << "Error: Unable to apply the configuration changes." << std::endl;
+        restoreFiles(originals, snapshots);
+        return false;
     }
 
-    // Write the modified content back to the file
-    std::ofstream outFile(configPath);
-    if (!outFile.is_open())
+    // One write per changed file; a failed write leaves every file untouched,
+    // a failed rename may have replaced some of them already
+    if (!workspace.commitAll())
     {
-        std::cerr << "Error: Cannot write to config file: " << configPath << std::endl;
+        restoreFiles(originals, snapshots);
         return false;
     }
 
-    for (const auto &line : lines)
+    // Setting the timezone is the one step that is not a file, so it goes last
+    // and only the files need undoing if it fails
+    if (!pendingTimezone.empty())
     {
-        outFile << line << std::endl;
+        if (!ops.setTimezone(pendingTimezone))
+        {
+            std::cerr << "Error: Unable to set timezone to " << pendingTimezone << std::endl;
+            restoreFiles(originals, snapshots);
+            return false;
+        }
     }
-    outFile.close();
 
+    rollback(); // Everything is applied; nothing is left staged
     return true;
 }
+
+void SetupUtils::Transaction::rollback()
+{
+    for (std::vector<ConfigEditor::Edit> &edits : pendingEdits)
+    {
+        edits.clear();
+    }
+    pendingTimezone.clear();
+}
+
+void SetupUtils::Transaction::restoreFiles(const std::array<std::string, Workspace::DOCUMENT_COUNT> &originals,
+                                           const std::array<ConfigEditor::Snapshot, Workspace::DOCUMENT_COUNT> &snapshots)
+{
+    for (size_t i = 0; i < snapshots.size(); ++i)
+    {
+        if (!snapshots[i].valid())
+            continue; // Not touched by this transaction
+        Workspace::Document document = static_cast<Workspace::Document>(i);
+        ConfigEditor &editor = workspace.get(document);
+        const std::string &path = workspace.getPath(document);
+        // Files the commit did not get to still match what was loaded
+        bool replaced = !editor.isUpToDate(path, originals[i]);
+        editor.restore(snapshots[i]);
+        if (!replaced)
+            continue;
+        if (!workspace.replaceFile(document, originals[i]))
+            std::cerr << "Error: Unable to restore configuration file: " << path << std::endl;
+    }
+}
@@ -2,10 +2,27 @@
 #define SETUP_UTILS_HPP
 
 #include "config-editor.hpp"
+#include "keyboard-layouts.hpp"
+#include "system-ops.hpp"
+#include "workspace.hpp"
+#include <array>
 #include <iostream>
 
 class SetupUtils
 {
+public:
+    /**
+     * @brief One setting whose current value differs from the requested one, a step of a plan.
+     */
+    struct Change
+    {
+        std::string target;  // Path of the file, or "system" for the timezone
+        std::string key;     // Key in the file, or "timezone"
+        std::string current; // Value in effect now; empty if not set
+        std::string desired; // Value after the change
+        bool secret = false; // Hide the values when printing, e.g. for a Wi-Fi password
+    };
+
 private:
     /**
      * @brief Path to the configuration file.
@@ -17,7 +34,203 @@ private:
      */
     ConfigEditor configEditor;
 
+    /**
+     * @brief Pre-resolved handles of the sections this utility edits.
+     */
+    static const SectionPath globalsSection;
+    static const SectionPath displaySection;
+    static const SectionPath wifiNetworkSection;
+
+    /**
+     * @brief Configuration edits staged by the setters, applied as one batch by saveConfig().
+     */
+    std::vector<ConfigEditor::Edit> pendingEdits;
+
+    /**
+     * @brief Drop the staged edits that would leave a document as it is.
+     * @param editor The document the edits are for.
+     * @param target Name of the document in the plan, usually its path.
+     * @param edits Staged edits; of several values for one key only the last is kept,
+     *        and only if the document does not already hold it. Commenting out a key
+     *        is kept only if the key is set.
+     * @param plan Receives a change for every value kept, in the order of the edits.
+     */
+    static void dropUnchanged(ConfigEditor &editor, const std::string &target,
+                              std::vector<ConfigEditor::Edit> &edits, std::vector<Change> &plan);
+
+    /**
+     * @brief Add the edits that point the first network block of wpa_supplicant.conf at a network.
+     * @param wifiConfig The loaded wpa_supplicant.conf.
+     * @param ssid SSID of the network.
+     * @param keyMgmt Key management type (e.g., WPA-PSK, or NONE for an open network).
+     * @param psk Pre-shared key; not written for an open network or when empty.
+     * @param edits Receives the edits.
+     * @note wpa_supplicant refuses a file whose psk is shorter than 8 characters, so
+     *       without a psk any psk of the block is commented out instead.
+     */
+    static void addWifiEdits(ConfigEditor &wifiConfig, const std::string &ssid, const std::string &keyMgmt,
+                             const std::string &psk, std::vector<ConfigEditor::Edit> &edits);
+
+    /**
+     * @brief Stage a value to be set in the configuration.
+     * @param sectionPath The section the key belongs to; must exist in the configuration.
+     * @param key The configuration key.
+     * @param value The value to set.
+     * @return true if the value was staged, false if the section does not exist.
+     */
+    bool stageValue(const SectionPath &sectionPath, const std::string &key, const std::string &value);
+
+    /**
+     * @brief Stage a typed value for a key from the configuration schema.
+     * @tparam Key Schema key tag, e.g. ConfigSchema::DisplayCursor.
+     * @param sectionPath The section the key belongs to; must exist in the configuration.
+     * @param value The value to set; validated and formatted by the schema.
+     * @return true if the value was staged, false if it is invalid or the section does not exist.
+     */
+    template <typename Key>
+    bool stage(const SectionPath &sectionPath, const typename Key::value_type &value)
+    {
+        ConfigSchema::FormattedValue text;
+        return ConfigSchema::format<Key>(value, text) &&
+               stageValue(sectionPath, std::string(Key::info.name), std::string(text.view()));
+    }
+
 public:
+    /**
+     * @brief A set of settings applied together, all or nothing.
+     *
+     * The setters only validate and stage their changes in memory; nothing on the
+     * system changes until commit(). plan() compares the staged settings with the
+     * loaded files and the system and drops the ones already in effect, so a
+     * commit only touches what differs and writes nothing at all if the system is
+     * already set up as requested. Committing applies the staged edits to the
+     * workspace documents and writes each changed file exactly once through
+     * Workspace::commitAll(). The timezone is set last, as it is the only change
+     * that is not a file. If any step fails, every file is put back the way it
+     * was and the documents are restored, so a failed setup never leaves the
+     * system half-configured.
+     */
+    class Transaction
+    {
+    private:
+        Workspace &workspace;
+        SystemOps &ops;
+        std::array<std::vector<ConfigEditor::Edit>, Workspace::DOCUMENT_COUNT> pendingEdits;
+        std::string pendingTimezone;
+
+        /**
+         * @brief Stage a value for a loaded workspace document.
+         * @param document The document to edit.
+         * @param sectionPath The section the key belongs to; must exist in the document.
+         * @param key The configuration key.
+         * @param value The value to set.
+         * @return true if the value was staged, false if the document or section is missing.
+         */
+        bool stageValue(Workspace::Document document, const SectionPath &sectionPath,
+                        const std::string &key, const std::string &value);
+
+        /**
+         * @brief Stage a typed value for a key from the configuration schema.
+         * @tparam Key Schema key tag, e.g. ConfigSchema::DisplayCursor.
+         * @param sectionPath The graphics configuration section the key belongs to.
+         * @param value The value to set; validated and formatted by the schema.
+         * @return true if the value was staged, false if it is invalid or the section does not exist.
+         */
+        template <typename Key>
+        bool stage(const SectionPath &sectionPath, const typename Key::value_type &value)
+        {
+            ConfigSchema::FormattedValue text;
+            return ConfigSchema::format<Key>(value, text) &&
+                   stageValue(Workspace::Document::GraphicsConfig, sectionPath,
+                              std::string(Key::info.name), std::string(text.view()));
+        }
+
+        /**
+         * @brief Write the original contents back to every file the failed commit replaced.
+         * @param originals Contents of each document before the commit.
+         * @param snapshots State of each document before the commit.
+         */
+        void restoreFiles(const std::array<std::string, Workspace::DOCUMENT_COUNT> &originals,
+                          const std::array<ConfigEditor::Snapshot, Workspace::DOCUMENT_COUNT> &snapshots);
+
+    public:
+        /**
+         * @brief Constructor
+         * @param configWorkspace The loaded configuration files the settings go to.
+         * @param systemOps Backend that sets the timezone.
+         */
+        explicit Transaction(Workspace &configWorkspace, SystemOps &systemOps = SystemOps::native());
+
+        /**
+         * @brief Stage a new hostname for /boot/network.
+         * @param hostname The desired hostname.
+         * @return true if staged, false if the network configuration is not loaded.
+         */
+        bool setHostname(const std::string &hostname);
+
+        /**
+         * @brief Stage a keyboard layout for the graphics configuration.
+         * @param layout The keyboard layout to set (e.g., `en_CA_101`).
+         * @return true if staged, false if the layout is not installed or the configuration is invalid.
+         */
+        bool setKeyboardLayout(const std::string &layout);
+
+        /**
+         * @brief Stage a display configuration for the graphics configuration.
+         * @param width The display width in pixels (e.g., 1920).
+         * @param height The display height in pixels (e.g., 1080).
+         * @param refreshRate The display refresh rate in Hz (e.g., 60).
+         * @param stackSize The stack size for the display server (default: 65536).
+         * @param forceComposition Whether to force composition (default: true).
+         * @param cursor Whether to enable the cursor (default: true).
+         * @return true if staged, false if a value or the configuration is invalid.
+         */
+        bool setDisplay(const int width, const int height, const int refreshRate,
+                        const int stackSize = 65536, const bool forceComposition = true, const bool cursor = true);
+
+        /**
+         * @brief Stage a new system timezone.
+         * @param timezone The desired timezone (e.g., `America/Toronto`, `UTC`).
+         */
+        void setTimezone(const std::string &timezone);
+
+        /**
+         * @brief Stage the Wi-Fi network of the first network block in wpa_supplicant.conf.
+         * @param ssid New SSID to set.
+         * @param keyMgmt New key management type (e.g., WPA-PSK).
+         * @param psk New pre-shared key (password); not written for an open network (NONE)
+         *        or when empty, and any psk of the block is commented out instead.
+         * @return true if staged, false if the Wi-Fi configuration is not loaded.
+         */
+        bool setWifi(const std::string &ssid, const std::string &keyMgmt, const std::string &psk);
+
+        /**
+         * @brief Work out what commit() has to change, dropping staged settings already in effect.
+         * @return The changes in the order commit() applies them; empty if there is nothing to do.
+         * @note Nothing is written, so this is also the dry run of commit().
+         */
+        std::vector<Change> plan();
+
+        /**
+         * @brief Apply every staged setting that differs from the current state, writing each changed file once.
+         * @return true if everything was applied; false if anything failed, in which
+         *         case nothing was changed.
+         */
+        bool commit();
+
+        /**
+         * @brief Drop every staged setting without applying it.
+         */
+        void rollback();
+    };
+
+    /**
+     * @brief Print a plan, one change per line.
+     * @param plan The changes, e.g. from Transaction::plan().
+     * @param out Stream to print to.
+     */
+    static void printPlan(const std::vector<Change> &plan, std::ostream &out = std::cout);
+
     /**
      * @brief Constructor that initializes the setup utility with a configuration file path.
      * @param configFilePath The path to the configuration file.
@@ -30,101 +243,57 @@ public:
     ~SetupUtils() = default;
 
     /**
-     * @brief Save the configuration changes.
+     * @brief Apply all staged configuration changes in one pass and save them.
      * @return true if the configuration was saved successfully, false otherwise.
+     * @note Values the file already holds are skipped; if none differ, nothing is written.
      */
     bool saveConfig();
 
     /**
      * @brief Get the current system hostname.
      * @return The current hostname as a string.
+     * @note The parsed file is cached; it is only read again after it changes on disk.
      */
-    static std::string getHostname()
-    {
-        // For QNX, the hostname is saved in /boot/network
-        std::string networkConfigPath = "/boot/network";
-        FILE *file = fopen(networkConfigPath.c_str(), "r");
-        if (file)
-        {
-            char buffer[256];
-            while (fgets(buffer, sizeof(buffer), file))
-            {
-                std::string line(buffer);
-                if (line.find("HOSTNAME=") == 0)
-                {
-                    fclose(file);
-                    return line.substr(9, line.find_first_of("\n\r", 9) - 9);
-                }
-            }
-            fclose(file);
-            return "unknown";
-        }
-        else
-        {
-            std::cerr << "Error: Unable to open network configuration file: " << networkConfigPath << std::endl;
-            exit(1);
-        }
-    }
+    static std::string getHostname();
+
+    /**
+     * @brief Get the hostname from an already loaded copy of /boot/network.
+     * @param networkConfig The network configuration, e.g. from a Workspace.
+     * @return The hostname, or "unknown" if the file has no HOSTNAME entry.
+     */
+    static std::string getHostname(ConfigEditor &networkConfig);
 
     /**
      * @brief Set the system hostname.
      * @param hostname The desired hostname.
      * @return The set hostname.
+     * @note Nothing is written if the hostname is already set.
      */
-    static std::string setHostname(const std::string &hostname)
-    {
-        // For QNX, simply write "HOSTNAME=new_hostname" to /boot/network
-        std::string networkConfigPath = "/boot/network";
-        FILE *file = fopen(networkConfigPath.c_str(), "a");
-        if (file)
-        {
-            fprintf(file, "HOSTNAME=%s\n", hostname.c_str());
-            fclose(file);
-            return hostname;
-        }
-        else
-        {
-            std::cerr << "Error: Unable to open network configuration file: " << networkConfigPath << std::endl;
-            exit(1);
-        }
-    }
+    static std::string setHostname(const std::string &hostname);
+
+    /**
+     * @brief Sets the network configuration used by getHostname() and setHostname().
+     * @param path Path of the file, /boot/network by default.
+     */
+    static void setNetworkConfigPath(const std::string &path);
+
+    /**
+     * @brief Gets the network configuration used by getHostname() and setHostname().
+     * @return Path of the file.
+     */
+    static const std::string &getNetworkConfigPath();
 
     /**
      * @brief Get a list of available keyboard layouts.
-     * @return A vector of strings representing available keyboard layouts.
+     * @return The installed layouts, sorted; see KeyboardLayouts::getAvailable().
      */
-    std::vector<std::string> getAvailableKeyboardLayouts() const
-    {
-        return {
-            "cs_CZ_102",
-            "da_DK_102",
-            "de_CH_102",
-            "de_DE_102",
-            "en_CA_101",
-            "en_CA_101_dvorak",
-            "en_GB_102",
-            "en_US_101",
-            "en_US_101_dvorak",
-            "es_ES_102",
-            "fr_BE_102",
-            "fr_CA_102",
-            "fr_CH_102",
-            "fr_FR_102",
-            "hr_HR_102",
-            "it_IT_102",
-            "ja_JP_106",
-            "nl_NL_102",
-            "no_NO_102",
-            "pl_PL_102",
-            "pt_PT_102",
-            "se_SE_102",
-            "sk_SK_102"};
-    }
+    static const std::vector<std::string_view> &getAvailableKeyboardLayouts();
 
     /**
      * @brief Set the keyboard layout in the configuration.
      * @param layout The keyboard layout to set (e.g., `en_CA_101`, `fr_CA_102`).
      * @return std::string The set keyboard layout.
+     * @note The change is staged and written together with the other settings by saveConfig().
      */
     std::string setKeyboardLayout(const std::string &layout);
 
@@ -137,6 +306,7 @@ public:
      * @param forceComposition Whether to force composition (default: true).
      * @param cursor Whether to enable the cursor (default: true, which is to be 'on' in the actual configuration).
      * @return std::string The set display configuration.
+     * @note The change is staged and written together with the other settings by saveConfig().
      */
     std::string setDisplay(
         const int width, const int height, const int refreshRate,
@@ -146,31 +316,23 @@ public:
      * @brief Set the system timezone.
      * @param timezone The desired timezone (e.g., `America/Toronto`, `UTC`, `GMT+2`, `-05:00`).
      * @return std::string The set timezone.
-     * @note This function uses the `_CS_TIMEZONE` to set the timezone in QNX. It is a QNX-only implementation.
+     * @note This function sets `_CS_TIMEZONE` through SystemOps::native(), like `setconf` in QNX,
+     *       unless it already holds the timezone.
      */
-    static std::string setTimezone(const std::string &timezone)
-    {
-        // In QNX, timezone is set via `setconf _CS_TIMEZONE timezone` command.
-        std::string command = "setconf _CS_TIMEZONE " + timezone;
-        if (system(command.c_str()) != 0)
-        {
-            std::cerr << "Error: Unable to set timezone to " << timezone << std::endl;
-            exit(1);
-        }
-        return timezone;
-    }
+    static std::string setTimezone(const std::string &timezone);
 
     /**
      * @brief Update Wi-Fi configuration in a wpa_supplicant.conf file
      *
      * This function updates the SSID, key management type, and pre-shared key (PSK)
-     * in a wpa_supplicant.conf file. It reads the existing configuration, modifies
-     * the relevant fields, and writes the updated configuration back to the file.
+     * of the first network block in a wpa_supplicant.conf file, adding the block if
+     * the file has none. Other blocks and global settings are left untouched.
      *
      * @param configPath Path to the wpa_supplicant.conf file
      * @param newSSID New SSID to set
      * @param newKeyMgmt New key management type (e.g., WPA-PSK)
-     * @param newPSK New pre-shared key (password)
+     * @param newPSK New pre-shared key (password); not written for an open network (NONE)
+     *        or when empty, and any psk of the block is commented out instead
      * @return true if the update was successful, false otherwise
      */
     static bool updateWifiConfig(const std::string &configPath,
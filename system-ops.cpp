@@ -0,0 +1,173 @@
+#include "system-ops.hpp"
+#include "atomic-file.hpp"
+#include "file-buffer.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __QNXNTO__
+#include <sys/sysmgr.h>
+#endif
+
+void SystemOps::record(Operation operation, std::chrono::steady_clock::time_point start)
+{
+    Timing &entry = timings[static_cast<size_t>(operation)];
+    entry.calls++;
+    entry.total += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+}
+
+std::string SystemOps::getTimezone()
+{
+    auto start = std::chrono::steady_clock::now();
+    std::string result = doGetTimezone();
+    record(Operation::GetTimezone, start);
+    return result;
+}
+
+bool SystemOps::setTimezone(const std::string &timezone)
+{
+    auto start = std::chrono::steady_clock::now();
+    bool result = doSetTimezone(timezone);
+    record(Operation::SetTimezone, start);
+    return result;
+}
+
+bool SystemOps::makeDirectories(const std::string &path, mode_t mode)
+{
+    auto start = std::chrono::steady_clock::now();
+    bool result = doMakeDirectories(path, mode);
+    record(Operation::MakeDirectories, start);
+    return result;
+}
+
+bool SystemOps::reboot()
+{
+    auto start = std::chrono::steady_clock::now();
+    bool result = doReboot();
+    record(Operation::Reboot, start);
+    return result;
+}
+
+const SystemOps::Timing &SystemOps::timing(Operation operation) const
+{
+    return timings[static_cast<size_t>(operation)];
+}
+
+void SystemOps::resetTimings()
+{
+    timings.fill(Timing());
+}
+
+std::string SystemOps::doGetTimezone()
+{
+    return std::string(); // Unknown, so every requested timezone counts as a change
+}
+
+bool SystemOps::doMakeDirectories(const std::string &path, mode_t mode)
+{
+    // Create each missing component from the top down; existing ones are fine
+    // as long as they are directories
+    for (size_t end = path.find('/', 1);; end = path.find('/', end + 1))
+    {
+        std::string prefix = path.substr(0, end);
+        if (!prefix.empty() && mkdir(prefix.c_str(), mode) != 0 && errno != EEXIST)
+            return false;
+        if (end == std::string::npos)
+            break;
+    }
+    struct stat statbuf;
+    return stat(path.c_str(), &statbuf) == 0 && S_ISDIR(statbuf.st_mode);
+}
+
+SystemOps &SystemOps::native()
+{
+#ifdef __QNXNTO__
+    static QnxSystemOps ops;
+#else
+    static LinuxSystemOps ops;
+#endif
+    return ops;
+}
+
+#ifdef __QNXNTO__
+std::string QnxSystemOps::doGetTimezone()
+{
+    char timezone[256];
+    size_t length = confstr(_CS_TIMEZONE, timezone, sizeof(timezone));
+    // The length includes the terminator; 0 means the string is not set
+    return length > 0 && length <= sizeof(timezone) ? std::string(timezone) : std::string();
+}
+
+bool QnxSystemOps::doSetTimezone(const std::string &timezone)
+{
+    // What `setconf _CS_TIMEZONE` does, without starting a process for it
+    errno = 0;
+    return confstr(_CS_SET | _CS_TIMEZONE, timezone.c_str(), 0) != 0 || errno == 0;
+}
+
+bool QnxSystemOps::doReboot()
+{
+    // The Raspberry Pi comes back up by itself after the system manager shuts it down
+    sync();
+    return sysmgr_reboot() == 0;
+}
+#endif
+
+std::string LinuxSystemOps::doGetTimezone()
+{
+    const char *timezone = getenv("TZ");
+    return timezone ? timezone : std::string();
+}
+
+bool LinuxSystemOps::doSetTimezone(const std::string &timezone)
+{
+    if (setenv("TZ", timezone.c_str(), 1) != 0)
+        return false;
+    tzset();
+    return true;
+}
+
+bool LinuxSystemOps::doReboot()
+{
+    sync();
+    rebootRequested = true;
+    return true;
+}
+
+OfflineSystemOps::OfflineSystemOps(const std::string &imageRoot) : root(imageRoot)
+{
+}
+
+std::string OfflineSystemOps::getTimezonePath() const
+{
+    return root + "/etc/TIMEZONE";
+}
+
+std::string OfflineSystemOps::doGetTimezone()
+{
+    std::shared_ptr<const FileBuffer> file = FileBuffer::read(getTimezonePath());
+    if (!file)
+        return std::string();
+    std::string_view timezone = file->view();
+    while (!timezone.empty() && (timezone.back() == '\n' || timezone.back() == '\r' || timezone.back() == ' '))
+        timezone.remove_suffix(1);
+    return std::string(timezone);
+}
+
+bool OfflineSystemOps::doSetTimezone(const std::string &timezone)
+{
+    return doMakeDirectories(root + "/etc", 0755) &&
+           AtomicFile::replace(getTimezonePath(), timezone + "\n", syncOnSave);
+}
+
+void OfflineSystemOps::setSyncOnSave(bool sync)
+{
+    syncOnSave = sync;
+}
+
+bool OfflineSystemOps::doReboot()
+{
+    // The image takes the changes when it next boots on the target
+    return true;
+}
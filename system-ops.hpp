@@ -0,0 +1,186 @@
+#ifndef SYSTEM_OPS_HPP
+#define SYSTEM_OPS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+
+/**
+ * @brief Operations on the running system, made with direct calls instead of shell commands
+ *
+ * Starting a shell for every change costs a fork and exec, which is slow on a
+ * Raspberry Pi and adds up in batch use. Each backend makes the calls natively;
+ * SystemOps::native() returns the one for the platform the utility was built for.
+ *
+ * The public methods time every call, so benchmarks and batch runs can see where
+ * the time goes through timing().
+ */
+class SystemOps
+{
+public:
+    /**
+     * @brief The timed operations
+     */
+    enum class Operation
+    {
+        GetTimezone,
+        SetTimezone,
+        MakeDirectories,
+        Reboot
+    };
+
+    static const size_t OPERATION_COUNT = 4;
+
+    /**
+     * @brief Accumulated timing of one operation
+     */
+    struct Timing
+    {
+        size_t calls = 0;
+        std::chrono::nanoseconds total{0};
+    };
+
+private:
+    std::array<Timing, OPERATION_COUNT> timings;
+
+    /**
+     * @brief Add the time since start to an operation's timing
+     * @param operation The operation that ran
+     * @param start When it started
+     */
+    void record(Operation operation, std::chrono::steady_clock::time_point start);
+
+protected:
+    virtual std::string doGetTimezone();
+    virtual bool doSetTimezone(const std::string &timezone) = 0;
+    virtual bool doMakeDirectories(const std::string &path, mode_t mode);
+    virtual bool doReboot() = 0;
+
+public:
+    virtual ~SystemOps() = default;
+
+    /**
+     * @brief Get the system timezone, like `getconf _CS_TIMEZONE`
+     * @return The timezone, empty if none is set or the backend cannot tell
+     */
+    std::string getTimezone();
+
+    /**
+     * @brief Set the system timezone, like `setconf _CS_TIMEZONE`
+     * @param timezone The timezone (e.g., `America/Toronto`, `UTC`)
+     * @return true if set, false otherwise
+     */
+    bool setTimezone(const std::string &timezone);
+
+    /**
+     * @brief Create a directory and any missing parents, like `mkdir -p`
+     * @param path The directory to create
+     * @param mode Permissions of the directories created
+     * @return true if the directory exists afterwards, false otherwise
+     */
+    bool makeDirectories(const std::string &path, mode_t mode = 0755);
+
+    /**
+     * @brief Reboot the system after flushing file system buffers
+     * @return false if the reboot could not be requested; does not return on success
+     *         with the native backend
+     */
+    bool reboot();
+
+    /**
+     * @brief Get the accumulated timing of an operation
+     * @param operation The operation
+     * @return Number of calls and total time spent in them
+     */
+    const Timing &timing(Operation operation) const;
+
+    /**
+     * @brief Reset all timings to zero
+     */
+    void resetTimings();
+
+    /**
+     * @brief Get the backend for the platform the utility was built for
+     * @return QnxSystemOps on QNX, LinuxSystemOps elsewhere
+     */
+    static SystemOps &native();
+};
+
+#ifdef __QNXNTO__
+/**
+ * @brief QNX backend: sets configuration strings with confstr() and reboots through the system manager
+ */
+class QnxSystemOps : public SystemOps
+{
+protected:
+    std::string doGetTimezone() override;
+    bool doSetTimezone(const std::string &timezone) override;
+    bool doReboot() override;
+};
+#endif
+
+/**
+ * @brief Stand-in backend for development hosts and tests
+ *
+ * The timezone only changes for this process, through the TZ environment
+ * variable, and a reboot is only recorded. Directories are created for real.
+ */
+class LinuxSystemOps : public SystemOps
+{
+private:
+    bool rebootRequested = false;
+
+protected:
+    std::string doGetTimezone() override;
+    bool doSetTimezone(const std::string &timezone) override;
+    bool doReboot() override;
+
+public:
+    /**
+     * @brief Check whether reboot() was called
+     * @return true if a reboot was requested
+     */
+    bool wasRebootRequested() const { return rebootRequested; }
+};
+
+/**
+ * @brief Backend for provisioning a mounted system image from a build host
+ *
+ * Nothing on the host changes. Live actions are replaced by their persistent
+ * equivalents inside the image: the timezone is written to /etc/TIMEZONE, which
+ * the target reads at boot, and a reboot does nothing, as the image is not running.
+ */
+class OfflineSystemOps : public SystemOps
+{
+private:
+    std::string root;
+    bool syncOnSave = true;
+
+protected:
+    std::string doGetTimezone() override;
+    bool doSetTimezone(const std::string &timezone) override;
+    bool doReboot() override;
+
+public:
+    /**
+     * @brief Constructor
+     * @param imageRoot Directory the image's root file system is mounted at
+     */
+    explicit OfflineSystemOps(const std::string &imageRoot);
+
+    /**
+     * @brief Get the file setTimezone() writes
+     * @return Path of /etc/TIMEZONE under the image root
+     */
+    std::string getTimezonePath() const;
+
+    /**
+     * @brief Choose whether the files written into the image are flushed to disk
+     * @param sync If true (the default), fsync each file and its directory
+     */
+    void setSyncOnSave(bool sync);
+};
+
+#endif // SYSTEM_OPS_HPP
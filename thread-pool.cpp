@@ -0,0 +1,66 @@
+#include "thread-pool.hpp"
+#include <algorithm>
+
+// The Raspberry Pi 4 has four cores; more threads than that only add contention
+static const size_t MAX_DEFAULT_THREADS = 4;
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([this]
+                             { work(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+    if (workers.empty())
+    {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    ready.notify_one();
+}
+
+void ThreadPool::work()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this]
+                       { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return; // Stopping and nothing left to run
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+size_t ThreadPool::defaultThreadCount()
+{
+    size_t hardware = std::thread::hardware_concurrency();
+    return std::min(std::max<size_t>(hardware, 1), MAX_DEFAULT_THREADS);
+}
@@ -0,0 +1,86 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Small fixed-size pool of worker threads running queued tasks in FIFO order
+ *
+ * Meant for a handful of independent, I/O-bound jobs such as loading or writing
+ * several files at once. Results and exceptions come back through std::future.
+ */
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool stopping = false;
+
+    /**
+     * @brief Worker loop: run queued tasks until the pool is destroyed
+     */
+    void work();
+
+    /**
+     * @brief Queue a task and wake one worker
+     * @param task Task to run
+     */
+    void enqueue(std::function<void()> task);
+
+public:
+    /**
+     * @brief Constructor that starts the workers
+     * @param threads Number of worker threads; with 0, submit() runs each task on
+     *        the calling thread before returning
+     */
+    explicit ThreadPool(size_t threads = defaultThreadCount());
+
+    /**
+     * @brief Destructor, runs the tasks still queued and joins the workers
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &other) = delete;
+    ThreadPool &operator=(const ThreadPool &other) = delete;
+
+    /**
+     * @brief Queue a task
+     * @param task Callable taking no arguments
+     * @return Future for the task's result; get() rethrows anything the task threw
+     */
+    template <typename Function>
+    auto submit(Function task) -> std::future<decltype(task())>
+    {
+        using Result = decltype(task());
+        // std::function needs a copyable target, so the move-only task is shared
+        auto job = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        std::future<Result> result = job->get_future();
+        enqueue([job]
+                { (*job)(); });
+        return result;
+    }
+
+    /**
+     * @brief Get the number of worker threads
+     * @return Worker count
+     */
+    size_t size() const { return workers.size(); }
+
+    /**
+     * @brief Pick a worker count for I/O-bound work on this machine
+     * @return Number of hardware threads, between 1 and 4
+     */
+    static size_t defaultThreadCount();
+};
+
+#endif // THREAD_POOL_HPP
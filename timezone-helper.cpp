@@ -7,6 +7,25 @@
 #include <vector>
 #include <algorithm>
 
+namespace
+{
+    std::string &zoneinfoPath()
+    {
+        static std::string path = "/usr/share/zoneinfo";
+        return path;
+    }
+}
+
+void TimezoneHelper::setZoneinfoPath(const std::string &path)
+{
+    zoneinfoPath() = path;
+}
+
+const std::string &TimezoneHelper::getZoneinfoPath()
+{
+    return zoneinfoPath();
+}
+
 bool TimezoneHelper::internal::fileExists(const std::string &path)
 {
     struct stat buffer;
@@ -52,9 +71,9 @@ bool TimezoneHelper::isValidTimezone(const std::string &timezone)
     }
 
     // Check if timezone file exists in system zoneinfo directory
-    const std::string zoneinfoPath = "/usr/share/zoneinfo/" + timezone;
+    const std::string zoneinfoFile = getZoneinfoPath() + "/" + timezone;
 
-    if (TimezoneHelper::internal::fileExists(zoneinfoPath) && TimezoneHelper::internal::isTimezoneFile(zoneinfoPath))
+    if (TimezoneHelper::internal::fileExists(zoneinfoFile) && TimezoneHelper::internal::isTimezoneFile(zoneinfoFile))
     {
         return true;
     }
@@ -129,9 +148,7 @@ void TimezoneHelper::internal::scanDirectory(const std::string &basePath, const
 std::vector<std::string> TimezoneHelper::getAvailableTimezones()
 {
     std::vector<std::string> timezones;
-    const std::string zoneinfoDir = "/usr/share/zoneinfo";
-
-    TimezoneHelper::internal::scanDirectory(zoneinfoDir, "", timezones);
+    TimezoneHelper::internal::scanDirectory(getZoneinfoPath(), "", timezones);
     std::sort(timezones.begin(), timezones.end());
     return timezones;
 }
@@ -159,8 +176,8 @@ bool TimezoneHelper::isValidTimezoneNoRegex(const std::string &timezone)
     }
 
     // Check system timezone file
-    const std::string zoneinfoPath = "/usr/share/zoneinfo/" + timezone;
-    if (TimezoneHelper::internal::fileExists(zoneinfoPath) && TimezoneHelper::internal::isTimezoneFile(zoneinfoPath))
+    const std::string zoneinfoFile = getZoneinfoPath() + "/" + timezone;
+    if (TimezoneHelper::internal::fileExists(zoneinfoFile) && TimezoneHelper::internal::isTimezoneFile(zoneinfoFile))
     {
         return true;
     }
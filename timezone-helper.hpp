@@ -98,6 +98,22 @@ namespace TimezoneHelper
      */
     std::string getSystemTimezone();
 
+    /**
+     * @brief Sets the directory holding the timezone database
+     *
+     * Defaults to /usr/share/zoneinfo. Useful to point the helper at a fixture
+     * tree or at the zoneinfo directory of a mounted system image.
+     *
+     * @param path The zoneinfo directory, without trailing slash
+     */
+    void setZoneinfoPath(const std::string &path);
+
+    /**
+     * @brief Gets the directory holding the timezone database
+     * @return The zoneinfo directory, without trailing slash
+     */
+    const std::string &getZoneinfoPath();
+
     /**
      * @brief Exception class for timezone validation errors
      */
@@ -8,13 +8,13 @@
 #include <ftxui/dom/elements.hpp>
 #include <ftxui/util/ref.hpp>
 
-int UTF8TUI::run() { return dashboard(); }
+int UTF8TUI::run(Workspace &workspace) { return dashboard(workspace); }
 
-int UTF8TUI::dashboard()
+int UTF8TUI::dashboard(Workspace &workspace)
 {
     using namespace ftxui;
 
-    std::string hostname = SetupUtils::getHostname();
+    std::string hostname = SetupUtils::getHostname(workspace.get(Workspace::Document::NetworkConfig));
     std::string username = getenv("USER");
 
     std::string option;
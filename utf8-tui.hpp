@@ -1,19 +1,23 @@
 #ifndef UTF8_TUI_HPP
 #define UTF8_TUI_HPP
 
+#include "workspace.hpp"
+
 namespace UTF8TUI
 {
     /**
      * @brief Run the UTF-8 TUI. Show the dashboard interface to start.
+     * @param workspace The loaded configuration files.
      * @return int Status Code (0 for success, non-zero for errors).
      */
-    int run();
+    int run(Workspace &workspace);
 
     /**
      * @brief The dashboard interface for TUI in UTF-8 supported terminal.
+     * @param workspace The loaded configuration files.
      * @return int Status Code (0 for success, non-zero for errors).
      */
-    int dashboard();
+    int dashboard(Workspace &workspace);
 }
 
 #endif // UTF8_TUI_HPP
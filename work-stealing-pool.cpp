@@ -0,0 +1,108 @@
+#include "work-stealing-pool.hpp"
+#include <algorithm>
+
+namespace
+{
+    // The pool and queue of the worker running on this thread, if any
+    thread_local const WorkStealingPool *currentPool = nullptr;
+    thread_local size_t currentQueue = 0;
+}
+
+WorkStealingPool::WorkStealingPool(size_t threads)
+{
+    threads = std::max<size_t>(threads, 1);
+    queues.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+    {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([this, i]
+                             { work(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void WorkStealingPool::enqueue(std::function<void()> task)
+{
+    size_t index = currentPool == this ? currentQueue : nextQueue++ % queues.size();
+    {
+        // Counted under the sleep lock, so a worker about to sleep cannot miss it,
+        // and before the push, so taking the task never drops the count below zero
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        ++pending;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    ready.notify_one();
+}
+
+bool WorkStealingPool::take(size_t index, std::function<void()> &task)
+{
+    {
+        Queue &own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --pending;
+            return true;
+        }
+    }
+    // Start with the next worker, so thieves spread out over the queues
+    for (size_t offset = 1; offset < queues.size(); ++offset)
+    {
+        Queue &victim = *queues[(index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --pending;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::work(size_t index)
+{
+    currentPool = this;
+    currentQueue = index;
+    while (true)
+    {
+        std::function<void()> task;
+        if (take(index, task))
+        {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        ready.wait(lock, [this]
+                   { return stopping || pending > 0; });
+        if (stopping && pending == 0)
+            return; // Stopping and nothing left to run
+    }
+}
+
+size_t WorkStealingPool::defaultThreadCount()
+{
+    return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
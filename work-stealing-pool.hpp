@@ -0,0 +1,110 @@
+#ifndef WORK_STEALING_POOL_HPP
+#define WORK_STEALING_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Pool of worker threads for large batches of CPU and I/O heavy tasks
+ *
+ * Unlike ThreadPool, which shares one FIFO queue among a few workers, every
+ * worker here owns a deque. Tasks submitted from outside are dealt out to the
+ * workers in turn; a task submitted by a running task goes to its own worker.
+ * A worker takes its newest task first and, once its deque is empty, steals the
+ * oldest task of another worker. Workers do not contend on a single lock, and
+ * uneven tasks still keep every core busy until the batch is done.
+ */
+class WorkStealingPool
+{
+private:
+    /**
+     * @brief Tasks of one worker
+     */
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // One per worker
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable ready;
+    std::atomic<size_t> pending{0};   // Tasks queued and not yet taken
+    std::atomic<size_t> nextQueue{0}; // Queue the next outside submission goes to
+    bool stopping = false; // Guarded by sleepMutex
+
+    /**
+     * @brief Worker loop: run own and stolen tasks until the pool is destroyed
+     * @param index Index of the worker and its queue
+     */
+    void work(size_t index);
+
+    /**
+     * @brief Take a task: the newest of the worker's own queue, else the oldest of another one
+     * @param index Index of the worker taking the task
+     * @param task Receives the task
+     * @return true if a task was taken, false if every queue is empty
+     */
+    bool take(size_t index, std::function<void()> &task);
+
+    /**
+     * @brief Queue a task and wake a sleeping worker
+     * @param task Task to run
+     */
+    void enqueue(std::function<void()> task);
+
+public:
+    /**
+     * @brief Constructor that starts the workers
+     * @param threads Number of worker threads; at least one is started
+     */
+    explicit WorkStealingPool(size_t threads = defaultThreadCount());
+
+    /**
+     * @brief Destructor, runs the tasks still queued and joins the workers
+     */
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &other) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &other) = delete;
+
+    /**
+     * @brief Queue a task
+     * @param task Callable taking no arguments
+     * @return Future for the task's result; get() rethrows anything the task threw
+     */
+    template <typename Function>
+    auto submit(Function task) -> std::future<decltype(task())>
+    {
+        using Result = decltype(task());
+        // std::function needs a copyable target, so the move-only task is shared
+        auto job = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        std::future<Result> result = job->get_future();
+        enqueue([job]
+                { (*job)(); });
+        return result;
+    }
+
+    /**
+     * @brief Get the number of worker threads
+     * @return Worker count
+     */
+    size_t size() const { return workers.size(); }
+
+    /**
+     * @brief Pick a worker count for batch work on this machine
+     * @return Number of hardware threads, at least 1
+     */
+    static size_t defaultThreadCount();
+};
+
+#endif // WORK_STEALING_POOL_HPP
@@ -0,0 +1,215 @@
+#include "workspace.hpp"
+#include "atomic-file.hpp"
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+const char *const Workspace::BOOT_MOUNT_POINT = "/boot";
+
+Workspace::Workspace() : Workspace(Paths())
+{
+}
+
+Workspace::Workspace(const Paths &paths, size_t threads)
+    : pool(std::min({threads, entries.size(), ThreadPool::defaultThreadCount()}))
+{
+    entry(Document::GraphicsConfig).path = paths.graphicsConfig;
+    entry(Document::WifiConfig).path = paths.wifiConfig;
+    entry(Document::NetworkConfig).path = paths.networkConfig;
+    entry(Document::WifiConfig).editor.setDialect(ConfigDialect::BraceBlocks);
+    entry(Document::NetworkConfig).editor.setDialect(ConfigDialect::FlatKeyValue);
+}
+
+Workspace::Workspace(const Paths &paths, std::shared_ptr<Fat32Image> image, size_t threads)
+    : Workspace(paths, threads)
+{
+    bootImage = std::move(image);
+    if (!bootImage)
+        return;
+    const std::string mountPoint = std::string(BOOT_MOUNT_POINT) + "/";
+    for (Entry &file : entries)
+    {
+        if (file.path.compare(0, mountPoint.size(), mountPoint) == 0)
+            file.imagePath = file.path.substr(mountPoint.size() - 1);
+        file.path = bootImage->getPath() + ":" + (file.imagePath.empty() ? file.path : file.imagePath);
+    }
+}
+
+bool Workspace::loadAll(ConfigEditor::LoadMode mode)
+{
+    return load(nullptr, mode);
+}
+
+bool Workspace::loadAll(const Workspace &base, ConfigEditor::LoadMode mode)
+{
+    return load(&base, mode);
+}
+
+bool Workspace::load(const Workspace *base, ConfigEditor::LoadMode mode)
+{
+    // Each task only touches its own entry, so they need no locking
+    std::vector<std::future<bool>> loads;
+    loads.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        Entry &file = entries[i];
+        const Entry *shared = base && base->entries[i].loaded ? &base->entries[i] : nullptr;
+        if (bootImage)
+        {
+            loads.push_back(pool.submit([this, &file, shared]
+                                        { return loadFromImage(file, shared); }));
+            continue;
+        }
+        loads.push_back(pool.submit([&file, shared, mode]
+                                    { return shared ? file.editor.loadFile(file.path, shared->editor, mode)
+                                                    : file.editor.loadFile(file.path, mode); }));
+    }
+
+    bool allLoaded = true;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        entries[i].loaded = loads[i].get();
+        allLoaded = allLoaded && entries[i].loaded;
+    }
+    return allLoaded;
+}
+
+bool Workspace::loadFromImage(Entry &file, const Entry *shared)
+{
+    if (file.imagePath.empty())
+        return false; // Not on the boot partition
+    std::shared_ptr<const FileBuffer> buffer = bootImage->read(file.imagePath);
+    if (!buffer)
+    {
+        std::cerr << "Error: Could not open file " << file.path << std::endl;
+        return false;
+    }
+    if (shared)
+        file.editor.loadBuffer(file.path, std::move(buffer), shared->editor);
+    else
+        file.editor.loadBuffer(file.path, std::move(buffer));
+    return true;
+}
+
+bool Workspace::isLoaded(Document document) const
+{
+    return entry(document).loaded;
+}
+
+ConfigEditor &Workspace::get(Document document)
+{
+    return entry(document).editor;
+}
+
+const std::string &Workspace::getPath(Document document) const
+{
+    return entry(document).path;
+}
+
+void Workspace::setSyncOnCommit(bool sync)
+{
+    syncOnCommit = sync;
+    if (bootImage)
+        bootImage->setSyncOnSave(sync);
+}
+
+bool Workspace::commitAll()
+{
+    // A staged write: the rendered contents and the temporary file holding them
+    struct Staged
+    {
+        Entry *file = nullptr;
+        ConfigEditor::Rendering rendering;
+        std::unique_ptr<AtomicFile> temp;
+    };
+
+    // Render and write the temporary files in parallel; with fsync on, the
+    // writes are where a save spends its time
+    std::vector<std::future<Staged>> writes;
+    for (Entry &file : entries)
+    {
+        if (!file.loaded)
+            continue;
+        bool sync = syncOnCommit;
+        writes.push_back(pool.submit([&file, sync]
+                                     {
+                                         Staged staged;
+                                         staged.rendering = file.editor.render();
+                                         if (file.editor.isUpToDate(file.path, staged.rendering))
+                                             return staged;
+                                         staged.file = &file;
+                                         if (!file.imagePath.empty())
+                                             return staged; // Rewritten in place after the renames
+                                         staged.temp = std::make_unique<AtomicFile>(file.path, sync);
+                                         if (!staged.temp->write(staged.rendering.segments))
+                                             staged.temp.reset();
+                                         return staged; }));
+    }
+
+    std::vector<Staged> staged;
+    bool allWritten = true;
+    for (auto &write : writes)
+    {
+        staged.push_back(write.get());
+        if (staged.back().file && staged.back().file->imagePath.empty() && !staged.back().temp)
+        {
+            std::cerr << "Error: Could not write to file " << staged.back().file->path << std::endl;
+            allWritten = false;
+        }
+    }
+    if (!allWritten)
+        return false; // The AtomicFile destructors remove the temporary files
+
+    // Swap the new files in only after every write succeeded
+    bool allCommitted = true;
+    for (Staged &change : staged)
+    {
+        if (!change.file || !change.temp)
+            continue;
+        if (!change.temp->commit())
+        {
+            std::cerr << "Error: Could not replace file " << change.file->path << std::endl;
+            allCommitted = false;
+            continue;
+        }
+        change.file->editor.markSaved(change.file->path, change.rendering);
+    }
+    // Files on the boot image have no temporary copy and are rewritten in place
+    // last, and not at all once a rename failed, so a failed commit changes as
+    // little of the image as possible
+    if (!allCommitted)
+        return false;
+    for (Staged &change : staged)
+    {
+        if (!change.file || change.temp)
+            continue;
+        if (!bootImage->write(change.file->imagePath, change.rendering.segments))
+        {
+            std::cerr << "Error: Could not write file " << change.file->path << std::endl;
+            allCommitted = false;
+            continue;
+        }
+        change.file->editor.markSaved(change.file->path, change.rendering);
+    }
+    return allCommitted;
+}
+
+bool Workspace::replaceFile(Document document, const std::string &contents)
+{
+    Entry &file = entry(document);
+    bool written = file.imagePath.empty() ? AtomicFile::replace(file.path, contents, syncOnCommit)
+                                          : bootImage->write(file.imagePath, contents);
+    if (!written)
+        return false;
+
+    // markSaved() can only re-point lines that already hold these contents;
+    // anything else is parsed again
+    if (file.editor.getContents() == contents)
+        file.editor.markSaved(file.path, contents);
+    else
+        file.editor.loadBuffer(file.path, FileBuffer::copyOf(contents));
+    file.loaded = true;
+    return true;
+}
@@ -0,0 +1,202 @@
+#ifndef WORKSPACE_HPP
+#define WORKSPACE_HPP
+
+#include "config-editor.hpp"
+#include "fat32-image.hpp"
+#include "thread-pool.hpp"
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * @brief All configuration files managed by the setup utility, loaded and saved as one unit
+ *
+ * Every file is opened as a ConfigEditor document. loadAll() reads them in parallel
+ * on a small thread pool, so startup takes as long as the slowest file rather than
+ * the sum of all of them.
+ *
+ * commitAll() first writes every changed document to a temporary file next to it, in
+ * parallel, and only renames them over the originals once all writes succeeded. A
+ * failed write leaves every file untouched. Documents are written from
+ * ConfigEditor::render() with writev(), so unchanged text is never copied.
+ *
+ * The files on the boot partition can also be edited inside a raw SD card image
+ * through a Fat32Image, without mounting it. Those are rewritten in place once
+ * every other file has been written.
+ */
+class Workspace
+{
+public:
+    /**
+     * @brief The managed files
+     */
+    enum class Document
+    {
+        GraphicsConfig, // Screen configuration, edited through SetupUtils
+        WifiConfig,     // wpa_supplicant.conf
+        NetworkConfig   // /boot/network, which holds the hostname
+    };
+
+    static const size_t DOCUMENT_COUNT = 3;
+
+    /**
+     * @brief Locations of the managed files
+     */
+    struct Paths
+    {
+        std::string graphicsConfig = "/system/lib/graphics/rpi4-drm/graphics-rpi4.conf";
+        std::string wifiConfig = "/boot/wpa_supplicant.conf";
+        std::string networkConfig = "/boot/network";
+
+        /**
+         * @brief Get these locations inside a mounted system image
+         * @param root Directory the image's root file system is mounted at, without trailing slash
+         * @return The paths with root prepended
+         */
+        Paths under(const std::string &root) const
+        {
+            return {root + graphicsConfig, root + wifiConfig, root + networkConfig};
+        }
+    };
+
+    // Where the target mounts its boot partition, the one a Fat32Image edits
+    static const char *const BOOT_MOUNT_POINT;
+
+private:
+    struct Entry
+    {
+        std::string path;
+        std::string imagePath; // Path on the boot image, empty if the file is not in it
+        ConfigEditor editor;
+        bool loaded = false;
+    };
+
+    std::array<Entry, DOCUMENT_COUNT> entries;
+    std::shared_ptr<Fat32Image> bootImage;
+    ThreadPool pool;
+    bool syncOnCommit = true;
+
+    Entry &entry(Document document) { return entries[static_cast<size_t>(document)]; }
+
+    /**
+     * @brief Load every file, from scratch or by sharing the documents of base
+     * @param base Workspace to share documents with, or nullptr
+     * @param mode How each document brings its file into memory
+     * @return true if all files were loaded
+     */
+    bool load(const Workspace *base, ConfigEditor::LoadMode mode);
+
+    const Entry &entry(Document document) const { return entries[static_cast<size_t>(document)]; }
+
+    /**
+     * @brief Load a document from the boot image
+     * @param file The document's entry
+     * @param shared Entry of a base workspace to share the document with, or nullptr
+     * @return false if the file is not on the boot partition or could not be read
+     */
+    bool loadFromImage(Entry &file, const Entry *shared);
+
+public:
+    /**
+     * @brief Constructor for the files at their standard locations; nothing is read until loadAll()
+     */
+    Workspace();
+
+    /**
+     * @brief Constructor; nothing is read until loadAll()
+     * @param paths Locations of the managed files
+     * @param threads Most threads to load and save the files on; 0 does all the
+     *        work on the calling thread, for callers that run many workspaces in parallel
+     */
+    explicit Workspace(const Paths &paths, size_t threads = DOCUMENT_COUNT);
+
+    /**
+     * @brief Constructor for the files of a raw SD card image; nothing is read until loadAll()
+     * @param paths Locations of the managed files on the target
+     * @param image Boot partition of the image, nullptr for files on the host as
+     *        with Workspace(const Paths &, size_t); files under BOOT_MOUNT_POINT are
+     *        read from and written to it, the others are out of reach and never load
+     * @param threads Most threads to load and save the files on
+     *
+     * Documents on the image are named <image path>:<path on the boot partition>.
+     */
+    Workspace(const Paths &paths, std::shared_ptr<Fat32Image> image, size_t threads = DOCUMENT_COUNT);
+
+    Workspace(const Workspace &other) = delete;
+    Workspace &operator=(const Workspace &other) = delete;
+
+    /**
+     * @brief Load every managed file in parallel
+     * @param mode How each document brings its file into memory
+     * @return true if all files were loaded; documents that failed stay empty and
+     *         report false from isLoaded()
+     */
+    bool loadAll(ConfigEditor::LoadMode mode = ConfigEditor::LoadMode::Buffered);
+
+    /**
+     * @brief Load every managed file, reusing the documents of another workspace
+     * @param base Workspace whose loaded documents are shared where a file has the
+     *             same contents, e.g. the same files in another copy of a system image
+     * @param mode How each document brings its file into memory
+     * @return true if all files were loaded
+     *
+     * See ConfigEditor::loadFile(const std::string &, const ConfigEditor &, LoadMode).
+     * The base is only read, so many workspaces can load from it in parallel.
+     */
+    bool loadAll(const Workspace &base, ConfigEditor::LoadMode mode = ConfigEditor::LoadMode::Buffered);
+
+    /**
+     * @brief Check whether a document was loaded from its file
+     * @param document The document
+     * @return true if the last loadAll() read it successfully
+     */
+    bool isLoaded(Document document) const;
+
+    /**
+     * @brief Get a document for reading or editing
+     * @param document The document
+     * @return The document's editor; empty if it was not loaded
+     */
+    ConfigEditor &get(Document document);
+
+    /**
+     * @brief Get the path of a managed file
+     * @param document The document
+     * @return Path of its file
+     */
+    const std::string &getPath(Document document) const;
+
+    /**
+     * @brief Choose whether commitAll() flushes the new files to disk
+     * @param sync If true (the default), fsync each file and its directory, and
+     *        the boot image after writing to it
+     */
+    void setSyncOnCommit(bool sync);
+
+    /**
+     * @brief Save every loaded document that changed, all or nothing
+     * @return true if every changed document was written, false if any failed
+     *
+     * Documents whose contents match their file are skipped. If writing any
+     * temporary file fails, none of the originals is replaced. The renames
+     * themselves happen one after another; each one is atomic on its own.
+     * Files on a boot image are rewritten in place after that, which is not atomic,
+     * and only if every rename succeeded.
+     */
+    bool commitAll();
+
+    /**
+     * @brief Overwrite the file of a document, e.g. to put back what it held before a failed commit
+     * @param document The document
+     * @param contents New contents of the file
+     * @return true if the file was written
+     *
+     * Afterwards the document holds the new contents. If it held the same text
+     * already, as after restoring a snapshot, its lines and undo history are kept;
+     * otherwise it is loaded again from the contents.
+     */
+    bool replaceFile(Document document, const std::string &contents);
+};
+
+#endif // WORKSPACE_HPP